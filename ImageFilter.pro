@@ -9,12 +9,36 @@ SOURCES += \
     main.cpp \
     mainwindow.cpp \
     filter2d.cpp \
-    imageinfowidget.cpp
+    convolution.cpp \
+    fftconvolution.cpp \
+    adaptivethreshold.cpp \
+    histogram.cpp \
+    grayscale.cpp \
+    parallel.cpp \
+    imageinfowidget.cpp \
+    filtersettings.cpp \
+    batchprocessor.cpp \
+    streamprocessor.cpp \
+    tiledimage.cpp \
+    pipeline.cpp \
+    resultcache.cpp \
+    undohistory.cpp \
+    tracing.cpp
 
 HEADERS += \
     mainwindow.h \
     filter2d.h \
-    imageinfowidget.h
+    convolution.h \
+    parallel.h \
+    imageinfowidget.h \
+    filtersettings.h \
+    batchprocessor.h \
+    streamprocessor.h \
+    tiledimage.h \
+    pipeline.h \
+    resultcache.h \
+    undohistory.h \
+    tracing.h
 
 QMAKE_CXXFLAGS += -Wall -Wextra
 
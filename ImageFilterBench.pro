@@ -0,0 +1,40 @@
+# Замеры операций filter2d.h (см. benchmark.cpp); собирается отдельно:
+#   qmake ImageFilterBench.pro && make && ./ImageFilterBench --json bench.json
+#   ./ImageFilterBench --verify   (сверка быстрых вариантов с эталоном, код возврата 1 при расхождении)
+QT += core gui concurrent
+
+TARGET = ImageFilterBench
+TEMPLATE = app
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+SOURCES += \
+    benchmark.cpp \
+    conformance.cpp \
+    filter2d.cpp \
+    convolution.cpp \
+    fftconvolution.cpp \
+    adaptivethreshold.cpp \
+    histogram.cpp \
+    grayscale.cpp \
+    parallel.cpp \
+    tracing.cpp
+
+HEADERS += \
+    conformance.h \
+    filter2d.h \
+    convolution.h \
+    parallel.h \
+    tracing.h
+
+QMAKE_CXXFLAGS += -Wall -Wextra
+
+# Замеры всегда на оптимизированной сборке
+CONFIG -= debug
+CONFIG += release
+DEFINES += QT_NO_DEBUG_OUTPUT
+
+win32 {
+    LIBS += -lpsapi
+}
@@ -0,0 +1,430 @@
+#include "filter2d.h"
+#include "parallel.h"
+#include "tracing.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+// ============ ЛОКАЛЬНАЯ БИНАРИЗАЦИЯ ============
+//
+// Niblack, Sauvola и Wolf-Jolion берут среднее и стандартное отклонение
+// в окне из таблиц сумм (summed-area tables) яркости и её квадрата,
+// поэтому стоимость пикселя не зависит от размера окна. Bernsen использует
+// минимум и максимум в окне, которые считаются сепарабельно алгоритмом
+// ван Херка - Гил-Вермана за O(1) на пиксель.
+// У краёв окно обрезается по границам изображения.
+
+namespace {
+
+// Полутоновая плоскость без выравнивания строк: изображение уже Grayscale8
+std::vector<uchar> grayPlane(const QImage &image) {
+    int width = image.width();
+    int height = image.height();
+    std::vector<uchar> gray(static_cast<size_t>(width) * height);
+
+    parallelForRows(height, [&](int yBegin, int yEnd) {
+        for (int y = yBegin; y < yEnd; ++y) {
+            const uchar *src = image.constScanLine(y);
+            std::copy(src, src + width, &gray[static_cast<size_t>(y) * width]);
+        }
+    });
+    return gray;
+}
+
+// Таблицы сумм размера (width + 1) x (height + 1) с 64-битными накопителями:
+// sum[y][x] - сумма яркостей прямоугольника [0, x) x [0, y)
+class IntegralImages {
+public:
+    // Таблицы не обнуляются заранее: нулевые строка и столбец пишутся явно,
+    // остальное - проходами, где первое касание страниц параллельно и
+    // прерывается отменой
+    IntegralImages(const std::vector<uchar> &gray, int width, int height)
+        : stride(width + 1),
+          sum(new quint64[static_cast<size_t>(width + 1) * (height + 1)]),
+          sumSq(new quint64[static_cast<size_t>(width + 1) * (height + 1)]) {
+        TRACE_SCOPE("integral images");
+        std::fill(sum.get(), sum.get() + stride, 0);
+        std::fill(sumSq.get(), sumSq.get() + stride, 0);
+        // Префиксные суммы по строкам независимы
+        parallelForRows(height, [&](int yBegin, int yEnd) {
+            for (int y = yBegin; y < yEnd && !isCancelled(); ++y) {
+                const uchar *src = &gray[static_cast<size_t>(y) * width];
+                quint64 *rowSum = &sum[static_cast<size_t>(y + 1) * stride];
+                quint64 *rowSumSq = &sumSq[static_cast<size_t>(y + 1) * stride];
+                rowSum[0] = 0;
+                rowSumSq[0] = 0;
+                quint64 s = 0, sq = 0;
+                for (int x = 0; x < width; ++x) {
+                    quint64 value = src[x];
+                    s += value;
+                    sq += value * value;
+                    rowSum[x + 1] = s;
+                    rowSumSq[x + 1] = sq;
+                }
+            }
+        });
+
+        // Накопление по столбцам: независимы группы столбцов. Кусок проходит
+        // всю высоту, поэтому отмена проверяется и внутри него
+        parallelForRows(width, [&](int xBegin, int xEnd) {
+            for (int y = 1; y <= height; ++y) {
+                if (y % CANCEL_CHECK_ROWS == 0 && isCancelled()) return;
+                quint64 *rowSum = &sum[static_cast<size_t>(y) * stride];
+                quint64 *rowSumSq = &sumSq[static_cast<size_t>(y) * stride];
+                const quint64 *prevSum = rowSum - stride;
+                const quint64 *prevSumSq = rowSumSq - stride;
+                for (int x = xBegin + 1; x <= xEnd; ++x) {
+                    rowSum[x] += prevSum[x];
+                    rowSumSq[x] += prevSumSq[x];
+                }
+            }
+        });
+    }
+
+    // Среднее и стандартное отклонение в прямоугольнике [x0, x1] x [y0, y1]
+    void windowStats(int x0, int y0, int x1, int y1, double &mean, double &stdDev) const {
+        size_t top = static_cast<size_t>(y0) * stride;
+        size_t bottom = static_cast<size_t>(y1 + 1) * stride;
+        double s = static_cast<double>(sum[bottom + x1 + 1] - sum[bottom + x0] - sum[top + x1 + 1] + sum[top + x0]);
+        double sq = static_cast<double>(sumSq[bottom + x1 + 1] - sumSq[bottom + x0] - sumSq[top + x1 + 1] + sumSq[top + x0]);
+        int count = (x1 - x0 + 1) * (y1 - y0 + 1);
+
+        mean = s / count;
+        double variance = (sq / count) - (mean * mean);
+        stdDev = std::sqrt(std::max(0.0, variance));
+    }
+
+private:
+    int stride;
+    std::unique_ptr<quint64[]> sum;
+    std::unique_ptr<quint64[]> sumSq;
+};
+
+// Столбцов в одном блоке вертикального прохода Бернсена: строка блока -
+// одна кэш-линия, буферы блока на высоту 10 тысяч строк - около 2.5 МБ
+const int MIN_MAX_COLUMN_LANES = 64;
+
+// Скользящий минимум и максимум по окну 2 * radius + 1 (ван Херк - Гил-Верман)
+// сразу для lanes соседних линий: элемент i линии l лежит в src[i * stride + l],
+// результат пишется так же. Минимум берётся из minSrc, максимум - из maxSrc:
+// во втором проходе это разные плоскости, и каждая обрабатывается один раз.
+// Линия дополняется крайними значениями, что для min/max равносильно
+// обрезанию окна по границе.
+void slidingMinMax(const uchar *minSrc, const uchar *maxSrc, int count, int stride, int lanes,
+                   int radius, uchar *outMin, uchar *outMax, std::vector<uchar> &buffer) {
+    int window = 2 * radius + 1;
+    int padded = count + 2 * radius;
+    // Длина кратна окну, чтобы блоки не выходили за буфер
+    int blocks = (padded + window - 1) / window;
+    int length = blocks * window;
+
+    size_t plane = static_cast<size_t>(length) * lanes;
+    buffer.resize(plane * 4);
+    uchar *prefixMin = buffer.data();
+    uchar *suffixMin = prefixMin + plane;
+    uchar *prefixMax = suffixMin + plane;
+    uchar *suffixMax = prefixMax + plane;
+
+    // Смещение источника для позиции i дополненной линии
+    auto source = [count, radius, stride](int i) {
+        return static_cast<size_t>(std::max(0, std::min(count - 1, i - radius))) * stride;
+    };
+
+    for (int start = 0; start < length; start += window) {
+        int end = start + window - 1;
+        std::copy(minSrc + source(start), minSrc + source(start) + lanes, prefixMin + static_cast<size_t>(start) * lanes);
+        std::copy(maxSrc + source(start), maxSrc + source(start) + lanes, prefixMax + static_cast<size_t>(start) * lanes);
+        for (int i = start + 1; i <= end; ++i) {
+            const uchar *low = minSrc + source(i);
+            const uchar *high = maxSrc + source(i);
+            uchar *pMin = prefixMin + static_cast<size_t>(i) * lanes;
+            uchar *pMax = prefixMax + static_cast<size_t>(i) * lanes;
+            for (int l = 0; l < lanes; ++l) {
+                pMin[l] = std::min(pMin[l - lanes], low[l]);
+                pMax[l] = std::max(pMax[l - lanes], high[l]);
+            }
+        }
+        std::copy(minSrc + source(end), minSrc + source(end) + lanes, suffixMin + static_cast<size_t>(end) * lanes);
+        std::copy(maxSrc + source(end), maxSrc + source(end) + lanes, suffixMax + static_cast<size_t>(end) * lanes);
+        for (int i = end - 1; i >= start; --i) {
+            const uchar *low = minSrc + source(i);
+            const uchar *high = maxSrc + source(i);
+            uchar *sMin = suffixMin + static_cast<size_t>(i) * lanes;
+            uchar *sMax = suffixMax + static_cast<size_t>(i) * lanes;
+            for (int l = 0; l < lanes; ++l) {
+                sMin[l] = std::min(sMin[l + lanes], low[l]);
+                sMax[l] = std::max(sMax[l + lanes], high[l]);
+            }
+        }
+    }
+
+    // Окно [x, x + window - 1] в координатах дополненной линии
+    for (int x = 0; x < count; ++x) {
+        const uchar *sMin = suffixMin + static_cast<size_t>(x) * lanes;
+        const uchar *sMax = suffixMax + static_cast<size_t>(x) * lanes;
+        const uchar *pMin = prefixMin + static_cast<size_t>(x + window - 1) * lanes;
+        const uchar *pMax = prefixMax + static_cast<size_t>(x + window - 1) * lanes;
+        uchar *dstMin = outMin + static_cast<size_t>(x) * stride;
+        uchar *dstMax = outMax + static_cast<size_t>(x) * stride;
+        for (int l = 0; l < lanes; ++l) {
+            dstMin[l] = std::min(sMin[l], pMin[l]);
+            dstMax[l] = std::max(sMax[l], pMax[l]);
+        }
+    }
+}
+
+// Потокобезопасный счётчик готовых строк для progressCallback
+class RowProgress {
+public:
+    RowProgress(int totalRows, int from, int to, const std::function<void(int)> &callback)
+        : total(std::max(1, totalRows)), from(from), to(to), callback(callback), done(0), reported(-1) {}
+
+    void addRows(int rows) {
+        if (!callback) return;
+        int percent = from + static_cast<int>(static_cast<qint64>(to - from) * (done += rows) / total);
+        int previous = reported.load();
+        if (percent > previous && reported.compare_exchange_strong(previous, percent)) {
+            callback(percent);
+        }
+    }
+
+private:
+    int total, from, to;
+    const std::function<void(int)> &callback;
+    std::atomic<int> done;
+    std::atomic<int> reported;
+};
+
+// Общий проход для порогов вида T = f(mean, stdDev)
+template <typename ThresholdFunction>
+void thresholdByLocalStats(QImage &image, const std::vector<uchar> &gray, const IntegralImages &integral,
+                           int windowSize, ThresholdFunction threshold,
+                           const std::function<void(int)> &progressCallback, int progressFrom) {
+    TRACE_SCOPE("local threshold");
+    int width = image.width();
+    int height = image.height();
+    int halfWindow = windowSize / 2;
+
+    uchar *bits = image.bits();
+    int bytesPerLine = image.bytesPerLine();
+    RowProgress progress(height, progressFrom, 100, progressCallback);
+
+    parallelForRows(height, [&](int yBegin, int yEnd) {
+        for (int y = yBegin; y < yEnd; ++y) {
+            int y0 = std::max(0, y - halfWindow);
+            int y1 = std::min(height - 1, y + halfWindow);
+            const uchar *src = &gray[static_cast<size_t>(y) * width];
+            uchar *out = bits + static_cast<size_t>(y) * bytesPerLine;
+
+            for (int x = 0; x < width; ++x) {
+                int x0 = std::max(0, x - halfWindow);
+                int x1 = std::min(width - 1, x + halfWindow);
+                double mean, stdDev;
+                integral.windowStats(x0, y0, x1, y1, mean, stdDev);
+
+                out[x] = (src[x] >= threshold(mean, stdDev)) ? 255 : 0;
+            }
+            progress.addRows(1);
+        }
+    });
+}
+
+template <typename ThresholdFunction>
+void binarizeByLocalStats(QImage &image, int windowSize, ThresholdFunction threshold,
+                          const std::function<void(int)> &progressCallback) {
+    std::vector<uchar> gray = grayPlane(image);
+    IntegralImages integral(gray, image.width(), image.height());
+    if (progressCallback) progressCallback(10);
+
+    thresholdByLocalStats(image, gray, integral, windowSize, threshold, progressCallback, 10);
+}
+
+} // namespace
+
+// ============ АЛГОРИТМ НИБЛАКА (NIBLACK) ============
+
+void binarizeNiblack(QImage &image, int windowSize, double k, std::function<void(int)> progressCallback) {
+    TRACE_SCOPE("binarizeNiblack");
+    convertToGrayscale(image);
+
+    // Порог Ниблака: T = mean + k * stdDev
+    binarizeByLocalStats(image, windowSize, [k](double mean, double stdDev) {
+        return mean + k * stdDev;
+    }, progressCallback);
+}
+
+// ============ АЛГОРИТМ САУВОЛЫ (SAUVOLA) ============
+
+void binarizeSauvola(QImage &image, int windowSize, double k, std::function<void(int)> progressCallback) {
+    TRACE_SCOPE("binarizeSauvola");
+    convertToGrayscale(image);
+
+    // Порог Саувола: T = mean * (1 + k * (stdDev / R - 1)), R = 128
+    binarizeByLocalStats(image, windowSize, [k](double mean, double stdDev) {
+        return mean * (1.0 + k * (stdDev / SAUVOLA_DYNAMIC_RANGE - 1.0));
+    }, progressCallback);
+}
+
+// ============ АЛГОРИТМ ВОЛЬФА - ЖОЛИОНА (WOLF-JOLION) ============
+
+namespace {
+
+// Минимальная яркость M и максимальное отклонение R по окнам строк [rowBegin, rowEnd)
+WolfStatistics wolfStatistics(const std::vector<uchar> &gray, const IntegralImages &integral,
+                              int width, int height, int windowSize, int rowBegin, int rowEnd) {
+    TRACE_SCOPE("wolf statistics");
+    int halfWindow = windowSize / 2;
+    rowBegin = std::max(0, rowBegin);
+    rowEnd = std::min(height, rowEnd);
+
+    std::atomic<int> minGray(255);
+    std::vector<double> rowMaxStdDev(static_cast<size_t>(std::max(0, rowEnd - rowBegin)), 0.0);
+    parallelForRows(rowEnd - rowBegin, [&](int begin, int end) {
+        int localMin = 255;
+        for (int y = rowBegin + begin; y < rowBegin + end; ++y) {
+            int y0 = std::max(0, y - halfWindow);
+            int y1 = std::min(height - 1, y + halfWindow);
+            const uchar *src = &gray[static_cast<size_t>(y) * width];
+            double rowMax = 0.0;
+            for (int x = 0; x < width; ++x) {
+                localMin = std::min(localMin, static_cast<int>(src[x]));
+                double mean, stdDev;
+                integral.windowStats(std::max(0, x - halfWindow), y0,
+                                     std::min(width - 1, x + halfWindow), y1, mean, stdDev);
+                rowMax = std::max(rowMax, stdDev);
+            }
+            rowMaxStdDev[y - rowBegin] = rowMax;
+        }
+        int current = minGray.load();
+        while (localMin < current && !minGray.compare_exchange_weak(current, localMin)) {
+        }
+    });
+
+    WolfStatistics statistics;
+    statistics.minGray = minGray.load();
+    if (!rowMaxStdDev.empty()) {
+        statistics.maxStdDev = *std::max_element(rowMaxStdDev.begin(), rowMaxStdDev.end());
+    }
+    return statistics;
+}
+
+void thresholdWolf(QImage &image, const std::vector<uchar> &gray, const IntegralImages &integral,
+                   int windowSize, double k, const WolfStatistics &statistics,
+                   const std::function<void(int)> &progressCallback, int progressFrom) {
+    TRACE_SCOPE("local threshold");
+    double minValue = statistics.minGray;
+    double maxStdDev = statistics.maxStdDev > 0.0 ? statistics.maxStdDev : 1.0;
+
+    // Порог Вольфа: T = (1 - k) * mean + k * M + k * (stdDev / R) * (mean - M)
+    thresholdByLocalStats(image, gray, integral, windowSize,
+                          [k, minValue, maxStdDev](double mean, double stdDev) {
+        return (1.0 - k) * mean + k * minValue + k * (stdDev / maxStdDev) * (mean - minValue);
+    }, progressCallback, progressFrom);
+}
+
+} // namespace
+
+void binarizeWolf(QImage &image, int windowSize, double k, std::function<void(int)> progressCallback) {
+    TRACE_SCOPE("binarizeWolf");
+    convertToGrayscale(image);
+
+    int width = image.width();
+    int height = image.height();
+
+    // Первый проход: M и R по всему изображению, таблицы сумм общие для обоих проходов
+    std::vector<uchar> gray = grayPlane(image);
+    IntegralImages integral(gray, width, height);
+    WolfStatistics statistics = wolfStatistics(gray, integral, width, height, windowSize, 0, height);
+    if (progressCallback) progressCallback(40);
+
+    thresholdWolf(image, gray, integral, windowSize, k, statistics, progressCallback, 40);
+}
+
+WolfStatistics calculateWolfStatistics(QImage &image, int windowSize, int rowBegin, int rowEnd) {
+    convertToGrayscale(image);
+
+    std::vector<uchar> gray = grayPlane(image);
+    IntegralImages integral(gray, image.width(), image.height());
+    return wolfStatistics(gray, integral, image.width(), image.height(), windowSize, rowBegin, rowEnd);
+}
+
+void mergeWolfStatistics(WolfStatistics &total, const WolfStatistics &part) {
+    total.minGray = std::min(total.minGray, part.minGray);
+    total.maxStdDev = std::max(total.maxStdDev, part.maxStdDev);
+}
+
+void binarizeWolf(QImage &image, int windowSize, double k, const WolfStatistics &statistics,
+                  std::function<void(int)> progressCallback) {
+    TRACE_SCOPE("binarizeWolf");
+    convertToGrayscale(image);
+
+    std::vector<uchar> gray = grayPlane(image);
+    IntegralImages integral(gray, image.width(), image.height());
+    if (progressCallback) progressCallback(10);
+
+    thresholdWolf(image, gray, integral, windowSize, k, statistics, progressCallback, 10);
+}
+
+// ============ АЛГОРИТМ БЕРНСЕНА (BERNSEN) ============
+
+void binarizeBernsen(QImage &image, int windowSize, int contrastThreshold,
+                     std::function<void(int)> progressCallback) {
+    TRACE_SCOPE("binarizeBernsen");
+    convertToGrayscale(image);
+
+    int width = image.width();
+    int height = image.height();
+    int radius = windowSize / 2;
+
+    std::vector<uchar> gray = grayPlane(image);
+    std::vector<uchar> rowMin(gray.size()), rowMax(gray.size());
+
+    // Минимум и максимум сначала вдоль строк, затем вдоль столбцов
+    parallelForRows(height, [&](int yBegin, int yEnd) {
+        std::vector<uchar> buffer;
+        for (int y = yBegin; y < yEnd; ++y) {
+            size_t offset = static_cast<size_t>(y) * width;
+            slidingMinMax(&gray[offset], &gray[offset], width, 1, 1, radius,
+                          &rowMin[offset], &rowMax[offset], buffer);
+        }
+    });
+    if (progressCallback) progressCallback(30);
+
+    // Вдоль столбцов - блоками по MIN_MAX_COLUMN_LANES соседних столбцов:
+    // каждая строка блока читается подряд, а не шагом width по байту
+    std::vector<uchar> windowMin(gray.size()), windowMax(gray.size());
+    const int columnBlocks = (width + MIN_MAX_COLUMN_LANES - 1) / MIN_MAX_COLUMN_LANES;
+    parallelForRows(columnBlocks, [&](int blockBegin, int blockEnd) {
+        std::vector<uchar> buffer;
+        for (int block = blockBegin; block < blockEnd; ++block) {
+            int x = block * MIN_MAX_COLUMN_LANES;
+            int lanes = std::min(MIN_MAX_COLUMN_LANES, width - x);
+            slidingMinMax(&rowMin[x], &rowMax[x], height, width, lanes, radius,
+                          &windowMin[x], &windowMax[x], buffer);
+        }
+    }, 1);
+    if (progressCallback) progressCallback(60);
+
+    uchar *bits = image.bits();
+    int bytesPerLine = image.bytesPerLine();
+
+    // Порог - середина диапазона; при низком контрасте окно однородно
+    // и пиксель относится к фону или объекту по середине диапазона
+    parallelForRows(height, [&](int yBegin, int yEnd) {
+        for (int y = yBegin; y < yEnd; ++y) {
+            size_t offset = static_cast<size_t>(y) * width;
+            uchar *out = bits + static_cast<size_t>(y) * bytesPerLine;
+            for (int x = 0; x < width; ++x) {
+                int low = windowMin[offset + x];
+                int high = windowMax[offset + x];
+                int mid = (low + high) / 2;
+                bool white = (high - low < contrastThreshold) ? (mid >= 128) : (gray[offset + x] >= mid);
+                out[x] = white ? 255 : 0;
+            }
+        }
+    });
+
+    if (progressCallback) progressCallback(100);
+}
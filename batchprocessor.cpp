@@ -0,0 +1,472 @@
+#include "batchprocessor.h"
+#include "filter2d.h"
+#include "pipeline.h"
+#include "resultcache.h"
+#include "streamprocessor.h"
+#include "tiledimage.h"
+#include "tracing.h"
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSet>
+#include <QTextStream>
+#include <QThreadPool>
+#include <QAtomicInt>
+#include <QVector>
+#include <QtConcurrent/QtConcurrent>
+#include <cstring>
+
+namespace {
+
+const char BATCH_FLAG[] = "--batch";
+
+struct BatchJob {
+    QString input;
+    QString output;
+    bool ok = false;
+    QString error;
+};
+
+QTextStream &errStream() {
+    static QTextStream stream(stderr);
+    return stream;
+}
+
+// Каталоги раскрываются в список изображений тех же типов, что и в диалоге открытия
+void appendInput(const QString &path, QStringList *files) {
+    QFileInfo info(path);
+    if (info.isDir()) {
+        QDir dir(path);
+        const QStringList filters = {"*.png", "*.jpg", "*.jpeg", "*.bmp", "*.pgm", "*.ppm", "*.ift"};
+        for (const QFileInfo &entry : dir.entryInfoList(filters, QDir::Files, QDir::Name)) {
+            files->append(entry.filePath());
+        }
+    } else {
+        files->append(path);
+    }
+}
+
+bool readListFile(const QString &path, QStringList *files, QString *errorMessage) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        *errorMessage = QString("Не удалось открыть список файлов: %1").arg(path);
+        return false;
+    }
+    QTextStream in(&file);
+    while (!in.atEnd()) {
+        QString line = in.readLine().trimmed();
+        if (!line.isEmpty() && !line.startsWith('#')) {
+            appendInput(line, files);
+        }
+    }
+    return true;
+}
+
+// Ключ сравнения путей: существующий файл - по каноническому пути (ссылки
+// раскрыты), новый - по абсолютному; на Windows и macOS без учёта регистра
+QString pathKey(const QString &path) {
+    QFileInfo info(path);
+    QString key = info.exists() ? info.canonicalFilePath() : info.absoluteFilePath();
+#if defined(Q_OS_WIN) || defined(Q_OS_MACOS)
+    key = key.toLower();
+#endif
+    return key;
+}
+
+// Пути результатов в outputDir. Совпадающие имена (a.png и a.jpg, одно имя
+// из разных каталогов) получают суффикс _2, _3, ...; результат поверх
+// любого из входов - ошибка: вход обрезался бы, пока его ещё читают
+bool assignOutputs(QVector<BatchJob> &jobs, const QDir &outputDir, const BatchOptions &options,
+                   QString *errorMessage) {
+    QSet<QString> inputs;
+    for (const BatchJob &job : jobs) inputs.insert(pathKey(job.input));
+
+    QSet<QString> outputs;
+    for (BatchJob &job : jobs) {
+        QFileInfo info(job.input);
+        QString suffix = options.outputFormat;
+        if (suffix.isEmpty()) suffix = options.stream ? QString("pnm") : info.suffix();
+        const QString base = info.completeBaseName();
+        job.output = outputDir.filePath(base + "." + suffix);
+        for (int copy = 2; outputs.contains(pathKey(job.output)); ++copy) {
+            job.output = outputDir.filePath(QString("%1_%2.%3").arg(base).arg(copy).arg(suffix));
+        }
+        if (inputs.contains(pathKey(job.output))) {
+            *errorMessage = QString("Результат %1 перезаписал бы входной файл: укажите другой каталог "
+                                    "(--output) или формат (--format).").arg(job.output);
+            return false;
+        }
+        outputs.insert(pathKey(job.output));
+    }
+    return true;
+}
+
+bool parseInt(const QString &text, const QString &name, int *value, QString *errorMessage) {
+    bool ok = false;
+    int parsed = text.toInt(&ok);
+    if (!ok) {
+        *errorMessage = QString("Некорректное значение --%1: %2").arg(name, text);
+        return false;
+    }
+    *value = parsed;
+    return true;
+}
+
+bool parseDouble(const QString &text, const QString &name, double *value, QString *errorMessage) {
+    bool ok = false;
+    double parsed = text.toDouble(&ok);
+    if (!ok) {
+        *errorMessage = QString("Некорректное значение --%1: %2").arg(name, text);
+        return false;
+    }
+    *value = parsed;
+    return true;
+}
+
+} // namespace
+
+bool isBatchInvocation(int argc, char *argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], BATCH_FLAG) == 0) return true;
+    }
+    return false;
+}
+
+bool parseBatchArguments(const QStringList &arguments, BatchOptions *options, QString *errorMessage) {
+    QCommandLineParser parser;
+    parser.setApplicationDescription("ImageFilter: пакетная обработка изображений");
+    parser.addHelpOption();
+
+    QCommandLineOption batchOption("batch", "Пакетный режим без графического интерфейса.");
+    QCommandLineOption filterOption({"f", "filter"},
+                                    QString("Фильтр: %1. Повторяется для конвейера; параметры стадии "
+                                            "через двоеточие: gaussian:size=15:sigma=3.")
+                                        .arg(filterTypeNames().join(", ")), "name");
+    QCommandLineOption outputOption({"o", "output"}, "Каталог для результатов.", "dir");
+    QCommandLineOption listOption("list", "Файл со списком входных путей, по одному в строке.", "file");
+    QCommandLineOption formatOption("format", "Формат результата (png, jpg, bmp, pgm, ppm, ift).", "ext");
+    QCommandLineOption jobsOption({"j", "jobs"}, "Число потоков (по умолчанию все ядра).", "n");
+    QCommandLineOption sizeOption("size", "Размер ядра Гаусса.", "n", "9");
+    QCommandLineOption sigmaOption("sigma", "Сигма Гаусса.", "value", "4.0");
+    QCommandLineOption gaussModeOption("gauss-mode", "Режим Гаусса: auto, exact, fast (IIR).", "mode", "auto");
+    QCommandLineOption borderOption("border", "Продолжение за краем для gaussian, sharpen и sobel: " +
+                                    borderModeNames().join(", ") + ".", "mode", "replicate");
+    QCommandLineOption kernelOption("kernel", "Ядро 3x3 для sharpen/sobel: 9 чисел через запятую.", "values");
+    QCommandLineOption windowOption("window", "Размер окна локальной бинаризации "
+                                    "(niblack, sauvola, wolf, bernsen).", "n");
+    QCommandLineOption kOption("k", "Коэффициент k для niblack, sauvola, wolf "
+                               "(по умолчанию -0.2, 0.5, 0.5).", "value");
+    QCommandLineOption contrastOption("contrast", "Минимальный контраст окна Бернсена.", "n", "15");
+    QCommandLineOption thresholdsOption("thresholds", "Число порогов многоуровневого Оцу (1-4).", "n", "2");
+    QCommandLineOption streamOption("stream", "Обрабатывать полосами, не загружая изображение целиком "
+                                    "(результат в PGM/PPM).");
+    QCommandLineOption compressOption("compress", "Сжимать тайлы .ift (zlib).");
+    QCommandLineOption cacheOption("cache", "Каталог кэша результатов: при повторном запуске "
+                                   "уже обработанные изображения не пересчитываются.", "dir");
+    QCommandLineOption memoryOption("memory", "Бюджет памяти потокового режима, МБ.", "mb",
+                                    QString::number(DEFAULT_STREAM_MEMORY_MB));
+    QCommandLineOption traceOption("trace", "Записать трассу Chrome (chrome://tracing, ui.perfetto.dev) "
+                                   "и вывести время по стадиям; по умолчанию IMAGEFILTER_TRACE.", "file");
+
+    parser.addOptions({batchOption, filterOption, outputOption, listOption, formatOption, jobsOption,
+                       sizeOption, sigmaOption, gaussModeOption, borderOption, kernelOption, windowOption,
+                       kOption, contrastOption, thresholdsOption, streamOption, memoryOption, compressOption,
+                       cacheOption, traceOption});
+    parser.addPositionalArgument("inputs", "Входные файлы или каталоги.", "[inputs...]");
+
+    if (!parser.parse(arguments)) {
+        *errorMessage = parser.errorText();
+        return false;
+    }
+    if (parser.isSet("help")) {
+        *errorMessage = parser.helpText();
+        return false;
+    }
+
+    if (!parser.isSet(filterOption)) {
+        *errorMessage = "Не указан фильтр (--filter).";
+        return false;
+    }
+
+    if (!parser.isSet(outputOption)) {
+        *errorMessage = "Не указан каталог для результатов (--output).";
+        return false;
+    }
+    options->outputDir = parser.value(outputOption);
+    options->outputFormat = parser.value(formatOption);
+
+    options->tiledOptions.compressed = parser.isSet(compressOption);
+    options->cacheDir = parser.value(cacheOption);
+    options->stream = parser.isSet(streamOption);
+    options->traceFile = parser.isSet(traceOption) ? parser.value(traceOption) : traceFileFromEnvironment();
+    if (!parseInt(parser.value(memoryOption), "memory", &options->memoryMb, errorMessage)) return false;
+    if (options->memoryMb < 1) {
+        *errorMessage = "Бюджет памяти должен быть положительным.";
+        return false;
+    }
+    if (options->stream && !options->outputFormat.isEmpty() && !isStreamOutputFileName("out." + options->outputFormat)) {
+        *errorMessage = "Потоковый режим сохраняет только pgm, ppm, pnm или ift.";
+        return false;
+    }
+
+    FilterSettings &settings = options->settings;
+    if (!parseInt(parser.value(sizeOption), "size", &settings.gaussSize, errorMessage) ||
+        !parseDouble(parser.value(sigmaOption), "sigma", &settings.gaussSigma, errorMessage) ||
+        !parseInt(parser.value(contrastOption), "contrast", &settings.bernsenContrast, errorMessage) ||
+        !parseInt(parser.value(thresholdsOption), "thresholds", &settings.otsuThresholds, errorMessage)) {
+        return false;
+    }
+    // Окно и k общие для локальных методов; без них у каждого свои значения по умолчанию
+    if (parser.isSet(windowOption)) {
+        int window = 0;
+        if (!parseInt(parser.value(windowOption), "window", &window, errorMessage)) return false;
+        settings.niblackWindow = settings.sauvolaWindow = settings.wolfWindow = settings.bernsenWindow = window;
+    }
+    if (parser.isSet(kOption)) {
+        double k = 0.0;
+        if (!parseDouble(parser.value(kOption), "k", &k, errorMessage)) return false;
+        settings.niblackK = settings.sauvolaK = settings.wolfK = k;
+    }
+    const QString gaussMode = parser.value(gaussModeOption).toLower();
+    if (gaussMode == "auto") {
+        settings.gaussMode = GaussianMode::Auto;
+    } else if (gaussMode == "exact") {
+        settings.gaussMode = GaussianMode::Exact;
+    } else if (gaussMode == "fast") {
+        settings.gaussMode = GaussianMode::Fast;
+    } else {
+        *errorMessage = QString("Неизвестный режим Гаусса: %1").arg(gaussMode);
+        return false;
+    }
+    if (!borderModeFromName(parser.value(borderOption), &settings.border)) {
+        *errorMessage = QString("Неизвестный режим края: %1").arg(parser.value(borderOption));
+        return false;
+    }
+    if (settings.gaussSize < 1 || settings.gaussSigma <= 0.0 || settings.niblackWindow < 1 ||
+        settings.sauvolaWindow < 1 || settings.wolfWindow < 1 || settings.bernsenWindow < 1) {
+        *errorMessage = "Размеры ядра и окна должны быть положительными.";
+        return false;
+    }
+
+    if (settings.otsuThresholds < 1 || settings.otsuThresholds > MULTI_OTSU_MAX_THRESHOLDS) {
+        *errorMessage = QString("Число порогов должно быть от 1 до %1.").arg(MULTI_OTSU_MAX_THRESHOLDS);
+        return false;
+    }
+
+    if (parser.isSet(kernelOption)) {
+        const QStringList values = parser.value(kernelOption).split(',');
+        if (values.size() != 9) {
+            *errorMessage = "Ядро должно содержать 9 значений.";
+            return false;
+        }
+        settings.kernel.clear();
+        for (const QString &value : values) {
+            double parsed = 0.0;
+            if (!parseDouble(value.trimmed(), "kernel", &parsed, errorMessage)) return false;
+            settings.kernel.push_back(parsed);
+        }
+    }
+
+    // Стадии конвейера в порядке --filter; общие параметры выше - значения по умолчанию
+    options->pipeline.clear();
+    for (const QString &spec : parser.values(filterOption)) {
+        FilterSettings stage;
+        if (!parsePipelineStage(spec, settings, &stage, errorMessage)) return false;
+        options->pipeline.push_back(stage);
+    }
+    settings.type = options->pipeline.front().type;
+    if (options->stream && options->pipeline.size() > 1) {
+        *errorMessage = "Потоковый режим выполняет одну операцию.";
+        return false;
+    }
+
+    if (parser.isSet(jobsOption) &&
+        !parseInt(parser.value(jobsOption), "jobs", &options->threads, errorMessage)) {
+        return false;
+    }
+
+    if (parser.isSet(listOption) &&
+        !readListFile(parser.value(listOption), &options->inputFiles, errorMessage)) {
+        return false;
+    }
+    for (const QString &path : parser.positionalArguments()) {
+        appendInput(path, &options->inputFiles);
+    }
+    if (options->inputFiles.isEmpty()) {
+        *errorMessage = "Нет входных файлов.";
+        return false;
+    }
+
+    return true;
+}
+
+namespace {
+
+// Файлы по одному: параллелизм внутри фильтра, в памяти одна полоса
+int runStreamBatch(const BatchOptions &options, QVector<BatchJob> &jobs) {
+    const qint64 memoryBudget = static_cast<qint64>(options.memoryMb) << 20;
+    int failed = 0;
+    for (int i = 0; i < jobs.size(); ++i) {
+        BatchJob &job = jobs[i];
+        errStream() << "[" << (i + 1) << "/" << jobs.size() << "] " << job.input;
+        errStream().flush();
+
+        std::unique_ptr<StripReader> reader = openStripReader(job.input, &job.error);
+        std::unique_ptr<StripWriter> writer;
+        if (reader) {
+            if (!reader->isStreaming()) {
+                errStream() << " (формат не читается полосами, загружено целиком)";
+            }
+            writer = createStripWriter(job.output, reader->size(), &job.error, options.tiledOptions);
+        }
+        job.ok = writer && processStream(*reader, *writer, options.pipeline.front(), memoryBudget,
+                                              &job.error);
+
+        if (job.ok) {
+            errStream() << " -> " << job.output << '\n';
+        } else {
+            errStream() << ": " << job.error << '\n';
+            ++failed;
+        }
+        errStream().flush();
+    }
+
+    errStream() << "Готово: " << (jobs.size() - failed) << " из " << jobs.size();
+    if (failed > 0) errStream() << ", ошибок: " << failed;
+    errStream() << '\n';
+    errStream().flush();
+    return failed > 0 ? 1 : 0;
+}
+
+int runBatchJobs(const BatchOptions &options) {
+    if (!QDir().mkpath(options.outputDir)) {
+        errStream() << "Не удалось создать каталог: " << options.outputDir << '\n';
+        errStream().flush();
+        return 1;
+    }
+    if (options.threads > 0) {
+        QThreadPool::globalInstance()->setMaxThreadCount(options.threads);
+    }
+    // Когда файлов не меньше, чем потоков, параллелим по файлам, а не внутри фильтра
+    if (!options.stream && options.inputFiles.size() >= QThreadPool::globalInstance()->maxThreadCount()) {
+        setFilterThreadCount(1);
+    }
+
+    QVector<BatchJob> jobs;
+    jobs.reserve(options.inputFiles.size());
+    for (const QString &input : options.inputFiles) {
+        BatchJob job;
+        job.input = input;
+        jobs.append(job);
+    }
+    QString error;
+    if (!assignOutputs(jobs, QDir(options.outputDir), options, &error)) {
+        errStream() << error << '\n';
+        errStream().flush();
+        return 1;
+    }
+
+    if (options.stream) return runStreamBatch(options, jobs);
+
+    if (options.pipeline.size() > 1) {
+        errStream() << "Конвейер: " << options.pipeline.size() << " стадий, "
+                    << pipelinePassCount(options.pipeline) << " проходов по изображению\n";
+    }
+
+    // Только диск: результаты разных файлов в памяти не повторяются
+    ResultCache cache(0);
+    if (!options.cacheDir.isEmpty()) {
+        if (!cache.setDiskDirectory(options.cacheDir, &error)) {
+            errStream() << error << '\n';
+            errStream().flush();
+            return 1;
+        }
+    }
+
+    const int total = jobs.size();
+    QAtomicInt finished(0);
+    QMutex logMutex;
+
+    // Каждый файл обрабатывается целиком в своём потоке пула
+    QtConcurrent::blockingMap(jobs, [&](BatchJob &job) {
+        TRACE_SCOPE("batch job");
+        // PGM/PPM и несжатые .ift читаются без декодирования
+        QImage image;
+        bool cached = false;
+        if (loadImageFile(job.input, &image, &job.error)) {
+            QString key;
+            if (!options.cacheDir.isEmpty()) {
+                key = resultCacheKey(imageContentHash(image), options.pipeline);
+                cached = cache.find(key, &image);
+            }
+            if (!cached) {
+                applyPipeline(image, options.pipeline);
+                if (!key.isEmpty()) cache.insert(key, image);
+            }
+            job.ok = saveImageFile(image, job.output, options.tiledOptions, &job.error);
+        }
+
+        int index = finished.fetchAndAddRelaxed(1) + 1;
+        QMutexLocker locker(&logMutex);
+        errStream() << "[" << index << "/" << total << "] " << job.input;
+        if (cached) errStream() << " (из кэша)";
+        if (job.ok) {
+            errStream() << " -> " << job.output << '\n';
+        } else {
+            errStream() << ": " << job.error << '\n';
+        }
+        errStream().flush();
+    });
+
+    int failed = 0;
+    for (const BatchJob &job : jobs) {
+        if (!job.ok) ++failed;
+    }
+    errStream() << "Готово: " << (total - failed) << " из " << total;
+    if (failed > 0) errStream() << ", ошибок: " << failed;
+    errStream() << '\n';
+    errStream().flush();
+
+    return failed > 0 ? 1 : 0;
+}
+
+} // namespace
+
+int runBatch(const BatchOptions &options) {
+    if (options.traceFile.isEmpty()) return runBatchJobs(options);
+
+    setTracingEnabled(true);
+    const int result = runBatchJobs(options);
+    setTracingEnabled(false);
+
+    // Время стадий суммируется по всем потокам пула
+    errStream() << "Трассировка, по стадиям:\n";
+    for (const QString &line : traceSummary()) errStream() << "  " << line << '\n';
+    QString error;
+    if (writeChromeTrace(options.traceFile, &error)) {
+        errStream() << "Трасса: " << options.traceFile << '\n';
+    } else {
+        errStream() << error << '\n';
+    }
+    errStream().flush();
+    return result;
+}
+
+int batchMain(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("ImageFilter");
+
+    BatchOptions options;
+    QString errorMessage;
+    if (!parseBatchArguments(QCoreApplication::arguments(), &options, &errorMessage)) {
+        errStream() << errorMessage << '\n';
+        errStream().flush();
+        return 2;
+    }
+    return runBatch(options);
+}
@@ -0,0 +1,39 @@
+#ifndef BATCHPROCESSOR_H
+#define BATCHPROCESSOR_H
+
+#include <QString>
+#include <QStringList>
+#include "filtersettings.h"
+#include "pipeline.h"
+#include "streamprocessor.h"
+
+// Пакетный режим без графического интерфейса:
+//   ImageFilter --batch --filter otsu -o out/ scans/ extra.png
+//   ImageFilter --batch -f gaussian:size=5:sigma=1.2 -f bt601 -f otsu -o out/ scans/
+//   ImageFilter --batch --stream --memory 512 --filter sauvola -o out/ huge.ppm
+//   ImageFilter --batch --cache .cache --filter niblack -o out/ scans/   (повтор пропустит готовое)
+//   ImageFilter --batch --trace trace.json --filter otsu -o out/ scans/
+struct BatchOptions {
+    QStringList inputFiles;
+    QString outputDir;
+    QString outputFormat;   // пусто - формат входного файла
+    FilterSettings settings;         // общие параметры, значения по умолчанию для стадий
+    FilterPipeline pipeline;         // стадии в порядке --filter
+    int threads = 0;        // 0 - все доступные ядра
+    TiledImageOptions tiledOptions;  // для результатов .ift
+    bool stream = false;    // обработка полосами с записью в PGM/PPM или .ift
+    int memoryMb = DEFAULT_STREAM_MEMORY_MB;  // бюджет памяти потокового режима
+    QString cacheDir;       // каталог кэша результатов; пусто - без кэша
+    QString traceFile;      // трасса Chrome и сводка по стадиям в stderr; пусто - без трассировки
+};
+
+// Проверка argv до создания QApplication
+bool isBatchInvocation(int argc, char *argv[]);
+
+// Точка входа пакетного режима: создаёт только QCoreApplication
+int batchMain(int argc, char *argv[]);
+
+bool parseBatchArguments(const QStringList &arguments, BatchOptions *options, QString *errorMessage);
+int runBatch(const BatchOptions &options);
+
+#endif // BATCHPROCESSOR_H
@@ -0,0 +1,494 @@
+#include "conformance.h"
+#include "filter2d.h"
+#include "parallel.h"
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QStringList>
+#include <QSysInfo>
+#include <QTextStream>
+#include <QThreadPool>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#include <psapi.h>
+#elif !defined(Q_OS_LINUX)
+#include <sys/resource.h>
+#endif
+
+// Замеры всех операций filter2d.h по сетке размеров, форматов, ядер и окон:
+//   ImageFilterBench --sizes 1,16 --formats rgb32 --filter sauvola,gaussian
+//   ImageFilterBench --json bench.json
+//   ImageFilterBench --verify scans/page.png   (сверка быстрых вариантов с эталоном)
+// Для каждого случая: лучшее и медианное время, МП/с и нс/пиксель по медиане,
+// пиковая память процесса
+
+namespace {
+
+QTextStream &outStream() {
+    static QTextStream stream(stdout);
+    return stream;
+}
+
+QTextStream &errStream() {
+    static QTextStream stream(stderr);
+    return stream;
+}
+
+// Операция с одним набором параметров; работает над копией исходного изображения
+struct BenchOperation {
+    QString name;
+    QString parameters;
+    std::function<void(QImage &)> run;
+};
+
+struct BenchFormat {
+    const char *name;
+    QImage::Format format;
+};
+
+const BenchFormat BENCH_FORMATS[] = {
+    {"rgb32", QImage::Format_RGB32},
+    {"argb32", QImage::Format_ARGB32},
+    {"rgb888", QImage::Format_RGB888},
+    {"gray8", QImage::Format_Grayscale8}
+};
+
+struct BenchOptions {
+    std::vector<double> megapixels;
+    std::vector<int> kernelSizes;
+    std::vector<int> windowSizes;
+    std::vector<BenchFormat> formats;
+    QStringList filters;        // пусто - все операции
+    int repeat = 3;             // не меньше стольких замеров на случай
+    qint64 minTimeMs = 500;     // и не меньше стольких миллисекунд в сумме
+    int threads = 0;
+    QString jsonPath;           // "-" - JSON в stdout, таблица в stderr
+    bool list = false;
+    bool verify = false;        // вместо замеров - проверка по эталону (conformance.h)
+    QStringList verifyImages;   // дополнительные входы проверки
+};
+
+// Ядро владеет памятью create*Kernel
+std::shared_ptr<std::vector<double>> takeKernel(double *kernel, size_t length) {
+    auto result = std::make_shared<std::vector<double>>(kernel, kernel + length);
+    delete[] kernel;
+    return result;
+}
+
+// Неразделимое ядро (ранг больше 1): filter2D сворачивает его напрямую или через БПФ
+std::shared_ptr<std::vector<double>> nonSeparableKernel(size_t size) {
+    auto kernel = std::make_shared<std::vector<double>>(size * size);
+    const double center = (size - 1) / 2.0;
+    double sum = 0.0;
+    for (size_t y = 0; y < size; ++y) {
+        for (size_t x = 0; x < size; ++x) {
+            double distance = std::fabs(x - center) + std::fabs(y - center);
+            double value = 1.0 / (1.0 + distance);
+            (*kernel)[y * size + x] = value;
+            sum += value;
+        }
+    }
+    for (double &value : *kernel) value /= sum;
+    return kernel;
+}
+
+std::vector<BenchOperation> benchOperations(const BenchOptions &options) {
+    std::vector<BenchOperation> operations;
+    auto add = [&operations](const QString &name, const QString &parameters,
+                             std::function<void(QImage &)> run) {
+        operations.push_back(BenchOperation{name, parameters, run});
+    };
+
+    auto sharpen = takeKernel(createSharpenKernel(), 9);
+    auto sobel = takeKernel(createSobelXKernel(), 9);
+    add("filter2d", "kernel=sharpen", [sharpen](QImage &image) { filter2D(image, sharpen->data(), 3, 3); });
+    add("filter2d", "kernel=sobelx", [sobel](QImage &image) { filter2D(image, sobel->data(), 3, 3); });
+
+    for (int size : options.kernelSizes) {
+        const size_t n = static_cast<size_t>(size);
+        const double sigma = std::max(RECURSIVE_GAUSSIAN_MIN_SIGMA, size / 6.0);
+        const QString kernel = QString("size=%1").arg(size);
+        const QString gauss = QString("size=%1:sigma=%2").arg(size).arg(sigma);
+        auto gauss2d = takeKernel(createGaussianKernel(n, sigma), n * n);
+        auto gauss1d = takeKernel(createGaussianKernel1D(n, sigma), n);
+        auto dense = nonSeparableKernel(n);
+
+        add("filter2d", gauss + ":kernel=gaussian",
+            [gauss2d, n](QImage &image) { filter2D(image, gauss2d->data(), n, n); });
+        add("filter2d", kernel + ":kernel=nonseparable",
+            [dense, n](QImage &image) { filter2D(image, dense->data(), n, n); });
+        add("sepfilter2d", gauss,
+            [gauss1d, n](QImage &image) { sepFilter2D(image, gauss1d->data(), n, gauss1d->data(), n); });
+        add("fftfilter2d", kernel + ":kernel=nonseparable",
+            [dense, n](QImage &image) { fftFilter2D(image, dense->data(), n, n); });
+        add("gaussian", gauss + ":mode=exact",
+            [n, sigma](QImage &image) { gaussianBlur(image, n, sigma, GaussianMode::Exact); });
+        add("gaussian", gauss + ":mode=fast",
+            [n, sigma](QImage &image) { gaussianBlur(image, n, sigma, GaussianMode::Fast); });
+        add("recursivegaussian", QString("sigma=%1").arg(sigma),
+            [sigma](QImage &image) { recursiveGaussianBlur(image, sigma); });
+    }
+
+    add("bt601", "", [](QImage &image) { toGrayscaleBT601(image); });
+    add("bt709", "", [](QImage &image) { toGrayscaleBT709(image); });
+    add("bt2020", "", [](QImage &image) { toGrayscaleBT2020(image); });
+    add("grayscale", "histogram=yes", [](QImage &image) {
+        GrayHistogram histogram;
+        toGrayscale(image, LumaStandard::BT709, histogram);
+    });
+    add("isgrayscale", "", [](QImage &image) { isGrayscale(image); });
+    add("histogram", "", [](QImage &image) { computeGrayHistogram(image); });
+    add("graylut", "lut=posterize3", [](QImage &image) {
+        uchar lut[256];
+        buildPosterizeLut({64, 128, 192}, lut);
+        applyGrayLut(image, lut);
+    });
+    add("threshold", "threshold=128", [](QImage &image) { applyThreshold(image, 128); });
+
+    add("otsu", "", [](QImage &image) { binarizeOtsu(image); });
+    add("huang", "", [](QImage &image) { binarizeHuang(image); });
+    add("isodata", "", [](QImage &image) { binarizeISODATA(image); });
+    for (int thresholds = 2; thresholds <= MULTI_OTSU_MAX_THRESHOLDS; thresholds += 2) {
+        add("multiotsu", QString("thresholds=%1").arg(thresholds),
+            [thresholds](QImage &image) { binarizeMultiOtsu(image, thresholds); });
+    }
+
+    for (int window : options.windowSizes) {
+        const QString parameters = QString("window=%1").arg(window);
+        add("niblack", parameters + ":k=-0.2", [window](QImage &image) { binarizeNiblack(image, window, -0.2); });
+        add("sauvola", parameters + ":k=0.5", [window](QImage &image) { binarizeSauvola(image, window, 0.5); });
+        add("wolf", parameters + ":k=0.5", [window](QImage &image) { binarizeWolf(image, window, 0.5); });
+        add("bernsen", parameters + ":contrast=15",
+            [window](QImage &image) { binarizeBernsen(image, window, 15); });
+        add("wolfstatistics", parameters, [window](QImage &image) {
+            calculateWolfStatistics(image, window, 0, image.height());
+        });
+    }
+
+    if (options.filters.isEmpty()) return operations;
+    std::vector<BenchOperation> selected;
+    for (const BenchOperation &operation : operations) {
+        if (options.filters.contains(operation.name)) selected.push_back(operation);
+    }
+    return selected;
+}
+
+// Синтетическая «страница»: градиент фона, тёмные штрихи и шум, чтобы у порогов
+// было что разделять, а у свёрток - не постоянный сигнал
+QImage syntheticImage(double megapixels, QImage::Format format) {
+    const double pixels = megapixels * 1e6;
+    const int width = std::max(1, static_cast<int>(std::lround(std::sqrt(pixels * 4.0 / 3.0))));
+    const int height = std::max(1, static_cast<int>(std::lround(pixels / width)));
+
+    QImage image(width, height, QImage::Format_RGB32);
+    parallelForRows(height, [&](int yBegin, int yEnd) {
+        for (int y = yBegin; y < yEnd; ++y) {
+            QRgb *line = reinterpret_cast<QRgb *>(image.scanLine(y));
+            for (int x = 0; x < width; ++x) {
+                quint32 noise = (static_cast<quint32>(x) * 73856093u) ^ (static_cast<quint32>(y) * 19349663u);
+                noise = (noise * 2654435761u) >> 27;
+                int value = 150 + 60 * x / width + static_cast<int>(noise);
+                bool stroke = (x / 24 + y / 32) % 5 == 0 && x % 24 < 6 && y % 32 < 26;
+                if (stroke) value = 40 + static_cast<int>(noise);
+                line[x] = qRgb(std::min(value + 10, 255), value, std::max(value - 20, 0));
+            }
+        }
+    });
+    return format == QImage::Format_RGB32 ? image : image.convertToFormat(format);
+}
+
+// Пиковая память процесса. В Linux пик сбрасывается перед каждым случаем
+// (clear_refs), и замер относится к случаю; иначе это пик за весь запуск
+#if defined(Q_OS_LINUX)
+bool resetPeakMemory() {
+    QFile file("/proc/self/clear_refs");
+    return file.open(QIODevice::WriteOnly) && file.write("5") == 1;
+}
+
+qint64 peakMemoryBytes() {
+    QFile file("/proc/self/status");
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) return 0;
+    for (QByteArray line = file.readLine(); !line.isEmpty(); line = file.readLine()) {
+        if (line.startsWith("VmHWM:")) {
+            return line.mid(6).trimmed().split(' ').first().toLongLong() * 1024;
+        }
+    }
+    return 0;
+}
+#elif defined(Q_OS_WIN)
+bool resetPeakMemory() { return false; }
+
+qint64 peakMemoryBytes() {
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+    return static_cast<qint64>(counters.PeakWorkingSetSize);
+}
+#else
+bool resetPeakMemory() { return false; }
+
+qint64 peakMemoryBytes() {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#if defined(Q_OS_MACOS)
+    return static_cast<qint64>(usage.ru_maxrss);         // байты
+#else
+    return static_cast<qint64>(usage.ru_maxrss) * 1024;  // килобайты
+#endif
+}
+#endif
+
+struct BenchResult {
+    int runs = 0;
+    double bestMs = 0.0;
+    double medianMs = 0.0;
+    qint64 peakBytes = 0;
+};
+
+// Каждый замер - над свежей копией: операции меняют изображение на месте,
+// а копирование в замер не входит
+BenchResult measure(const QImage &source, const BenchOperation &operation, const BenchOptions &options) {
+    std::vector<double> times;
+    qint64 totalNs = 0;
+    while (static_cast<int>(times.size()) < options.repeat || totalNs < options.minTimeMs * 1000000) {
+        QImage work = source.copy();
+        QElapsedTimer timer;
+        timer.start();
+        operation.run(work);
+        const qint64 elapsed = timer.nsecsElapsed();
+        totalNs += elapsed;
+        times.push_back(elapsed / 1e6);
+        // Медленные случаи (100 МП) не повторяются сверх --repeat
+        if (static_cast<int>(times.size()) >= options.repeat && elapsed > options.minTimeMs * 1000000) break;
+    }
+
+    BenchResult result;
+    result.runs = static_cast<int>(times.size());
+    std::sort(times.begin(), times.end());
+    result.bestMs = times.front();
+    result.medianMs = times.size() % 2 ? times[times.size() / 2]
+                                       : (times[times.size() / 2 - 1] + times[times.size() / 2]) / 2.0;
+    result.peakBytes = peakMemoryBytes();
+    return result;
+}
+
+template <typename T>
+bool parseList(const QString &text, const QString &name, std::vector<T> *values, QString *errorMessage) {
+    values->clear();
+    for (const QString &item : text.split(',', QString::SkipEmptyParts)) {
+        bool ok = false;
+        double parsed = item.trimmed().toDouble(&ok);
+        if (!ok || parsed <= 0.0) {
+            *errorMessage = QString("Некорректное значение --%1: %2").arg(name, item);
+            return false;
+        }
+        values->push_back(static_cast<T>(parsed));
+    }
+    if (values->empty()) {
+        *errorMessage = QString("Пустой список --%1").arg(name);
+        return false;
+    }
+    return true;
+}
+
+bool parseBenchArguments(const QStringList &arguments, BenchOptions *options, QString *errorMessage) {
+    QCommandLineParser parser;
+    parser.setApplicationDescription("ImageFilterBench: замеры операций filter2d.h");
+    parser.addHelpOption();
+
+    QCommandLineOption sizesOption("sizes", "Размеры изображений в мегапикселях через запятую.",
+                                   "mp", "0.25,1,4,16,100");
+    QCommandLineOption formatsOption("formats", "Форматы: rgb32, argb32, rgb888, gray8.", "list", "rgb32,gray8");
+    QCommandLineOption kernelsOption("kernels", "Размеры ядер свёрток и Гаусса.", "list", "3,9,31");
+    QCommandLineOption windowsOption("windows", "Размеры окон локальной бинаризации.", "list", "15,31,101");
+    QCommandLineOption filterOption({"f", "filter"}, "Только эти операции (через запятую, см. --list).", "names");
+    QCommandLineOption repeatOption("repeat", "Не меньше замеров на случай.", "n", "3");
+    QCommandLineOption minTimeOption("min-time", "Не меньше суммарного времени замеров на случай, мс.",
+                                     "ms", "500");
+    QCommandLineOption jobsOption({"j", "jobs"}, "Число потоков (по умолчанию все ядра).", "n", "0");
+    QCommandLineOption jsonOption("json", "Записать результаты в JSON (- для stdout).", "file");
+    QCommandLineOption listOption("list", "Показать операции и выйти.");
+    QCommandLineOption verifyOption("verify", "Сверить быстрые варианты с эталоном на синтетических "
+                                    "изображениях и файлах из аргументов.");
+
+    parser.addOptions({sizesOption, formatsOption, kernelsOption, windowsOption, filterOption,
+                       repeatOption, minTimeOption, jobsOption, jsonOption, listOption, verifyOption});
+    parser.addPositionalArgument("images", "Изображения для --verify.", "[images...]");
+
+    if (!parser.parse(arguments)) {
+        *errorMessage = parser.errorText();
+        return false;
+    }
+    if (parser.isSet("help")) {
+        *errorMessage = parser.helpText();
+        return false;
+    }
+
+    if (!parseList(parser.value(sizesOption), "sizes", &options->megapixels, errorMessage) ||
+        !parseList(parser.value(kernelsOption), "kernels", &options->kernelSizes, errorMessage) ||
+        !parseList(parser.value(windowsOption), "windows", &options->windowSizes, errorMessage)) {
+        return false;
+    }
+    for (int size : options->kernelSizes) {
+        if (size % 2 == 0) {
+            *errorMessage = QString("Размер ядра должен быть нечётным: %1").arg(size);
+            return false;
+        }
+    }
+
+    options->formats.clear();
+    for (const QString &name : parser.value(formatsOption).split(',', QString::SkipEmptyParts)) {
+        auto it = std::find_if(std::begin(BENCH_FORMATS), std::end(BENCH_FORMATS),
+                               [&name](const BenchFormat &format) { return name.trimmed() == format.name; });
+        if (it == std::end(BENCH_FORMATS)) {
+            *errorMessage = QString("Неизвестный формат: %1").arg(name);
+            return false;
+        }
+        options->formats.push_back(*it);
+    }
+
+    for (const QString &name : parser.value(filterOption).split(',', QString::SkipEmptyParts)) {
+        options->filters << name.trimmed().toLower();
+    }
+
+    bool repeatOk = false, minTimeOk = false, jobsOk = false;
+    options->repeat = parser.value(repeatOption).toInt(&repeatOk);
+    options->minTimeMs = parser.value(minTimeOption).toLongLong(&minTimeOk);
+    options->threads = parser.value(jobsOption).toInt(&jobsOk);
+    if (!repeatOk || !minTimeOk || !jobsOk || options->repeat < 1 || options->minTimeMs < 0 ||
+        options->threads < 0) {
+        *errorMessage = "Некорректное значение --repeat, --min-time или --jobs.";
+        return false;
+    }
+
+    options->jsonPath = parser.value(jsonOption);
+    options->list = parser.isSet(listOption);
+    options->verify = parser.isSet(verifyOption);
+    options->verifyImages = parser.positionalArguments();
+    if (!options->verify && !options->verifyImages.isEmpty()) {
+        *errorMessage = "Изображения указываются только с --verify.";
+        return false;
+    }
+    return true;
+}
+
+int runBench(const BenchOptions &options) {
+    if (options.threads > 0) {
+        QThreadPool::globalInstance()->setMaxThreadCount(options.threads);
+    }
+    setFilterThreadCount(options.threads);
+
+    const std::vector<BenchOperation> operations = benchOperations(options);
+    if (options.list) {
+        QStringList names;
+        for (const BenchOperation &operation : operations) {
+            if (!names.contains(operation.name)) names << operation.name;
+        }
+        outStream() << names.join('\n') << '\n';
+        return 0;
+    }
+    if (operations.empty()) {
+        errStream() << "Нет операций для замера (см. --list).\n";
+        return 2;
+    }
+
+    // При JSON в stdout таблица уходит в stderr
+    QTextStream &table = options.jsonPath == "-" ? errStream() : outStream();
+    const bool perCasePeak = resetPeakMemory();
+    table << QString("%1 %2 %3 %4 %5 %6 %7\n")
+                 .arg("операция", -18).arg("параметры", -40).arg("формат", -7).arg("МП", 7)
+                 .arg("МП/с", 9).arg("нс/пикс", 8).arg(perCasePeak ? "пик, МБ" : "пик процесса, МБ");
+    table.flush();
+
+    QJsonArray results;
+    for (double megapixels : options.megapixels) {
+        for (const BenchFormat &format : options.formats) {
+            const QImage source = syntheticImage(megapixels, format.format);
+            const double pixels = static_cast<double>(source.width()) * source.height();
+
+            for (const BenchOperation &operation : operations) {
+                resetPeakMemory();
+                const BenchResult result = measure(source, operation, options);
+                const double mpPerSecond = pixels / 1e6 / (result.medianMs / 1e3);
+                const double nsPerPixel = result.medianMs * 1e6 / pixels;
+                const double peakMb = result.peakBytes / double(1 << 20);
+
+                table << QString("%1 %2 %3 %4 %5 %6 %7\n")
+                             .arg(operation.name, -18).arg(operation.parameters, -40).arg(format.name, -7)
+                             .arg(pixels / 1e6, 7, 'f', 2).arg(mpPerSecond, 9, 'f', 1)
+                             .arg(nsPerPixel, 8, 'f', 2).arg(peakMb, 0, 'f', 0);
+                table.flush();
+
+                QJsonObject entry;
+                entry["operation"] = operation.name;
+                entry["parameters"] = operation.parameters;
+                entry["format"] = QString(format.name);
+                entry["width"] = source.width();
+                entry["height"] = source.height();
+                entry["megapixels"] = pixels / 1e6;
+                entry["runs"] = result.runs;
+                entry["best_ms"] = result.bestMs;
+                entry["median_ms"] = result.medianMs;
+                entry["mp_per_s"] = mpPerSecond;
+                entry["ns_per_pixel"] = nsPerPixel;
+                entry["peak_rss_bytes"] = result.peakBytes;
+                results.append(entry);
+            }
+        }
+    }
+
+    if (options.jsonPath.isEmpty()) return 0;
+
+    QJsonObject machine;
+    machine["cpu"] = QSysInfo::currentCpuArchitecture();
+    machine["os"] = QSysInfo::prettyProductName();
+    machine["qt"] = QString(qVersion());
+    machine["threads"] = options.threads > 0 ? options.threads : QThreadPool::globalInstance()->maxThreadCount();
+
+    QJsonObject report;
+    report["machine"] = machine;
+    report["repeat"] = options.repeat;
+    report["min_time_ms"] = options.minTimeMs;
+    report["peak_rss_scope"] = perCasePeak ? "case" : "process";
+    report["results"] = results;
+    const QByteArray json = QJsonDocument(report).toJson();
+
+    if (options.jsonPath == "-") {
+        outStream() << json;
+        return 0;
+    }
+    QFile file(options.jsonPath);
+    if (!file.open(QIODevice::WriteOnly) || file.write(json) != json.size()) {
+        errStream() << "Не удалось записать " << options.jsonPath << '\n';
+        return 1;
+    }
+    return 0;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("ImageFilterBench");
+
+    BenchOptions options;
+    QString errorMessage;
+    if (!parseBenchArguments(QCoreApplication::arguments(), &options, &errorMessage)) {
+        errStream() << errorMessage << '\n';
+        errStream().flush();
+        return 2;
+    }
+    if (options.verify) {
+        return runConformance(options.verifyImages, outStream()) > 0 ? 1 : 0;
+    }
+    return runBench(options);
+}
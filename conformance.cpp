@@ -0,0 +1,994 @@
+#include "conformance.h"
+#include "convolution.h"
+#include "filter2d.h"
+#include <QFileInfo>
+#include <QImage>
+#include <QRgb>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace {
+
+typedef std::function<void(QImage &)> Operation;
+typedef std::shared_ptr<std::vector<double>> Kernel;
+
+// Допуск: наибольшее и среднее отклонение канала в уровнях 0..255
+struct Tolerance {
+    int maxDifference;
+    double meanDifference;
+};
+
+// Векторные уровни, потоки, путь Grayscale8, прямая свёртка и пороги
+// считают то же самое в том же порядке
+const Tolerance EXACT = {0, 0.0};
+
+// Разделимая свёртка складывает те же произведения в другом порядке:
+// суммы расходятся на единицы младшего разряда double, и округление
+// меняется только у значений почти ровно на половине уровня. У ядер с
+// двоичными или полуцелыми весами (1-2-1, sharpen) такие половины часты,
+// поэтому среднее ограничено четвертью уровня, а не нулём
+const Tolerance REORDERED_SUM = {1, 0.25};
+
+// БПФ в double: ошибка суммы порядка 1e-12 от суммы модулей ядра * 255,
+// после округления - те же ±1 у половин уровня, что и у REORDERED_SUM.
+// Так же расходятся серый и цветной пути: в одно комплексное БПФ
+// упакованы разные данные (два блока серого или каналы R и G)
+const Tolerance FFT_ROUNDING = {1, 0.25};
+
+// Рекурсивный Гаусс Янга - ван Влита приближает гауссиану фильтром третьего
+// порядка, и при малых sigma приближение грубое: импульс 255 при sigma = 1
+// даёт в центре 52 вместо 62. Допуски сняты на синтетике с одиночными
+// пикселями 0 и 255 (худший случай) с запасом
+const Tolerance RECURSIVE_GAUSSIAN_SIGMA1 = {20, 4.0};
+const Tolerance RECURSIVE_GAUSSIAN_SIGMA3 = {8, 2.0};
+
+// Яркость в фиксированной точке против прежнего усечения в double: ±1.
+// На малых изображениях среднее не показательно (прежняя формула уменьшает
+// на 1 каждый четвёртый уровень серого, 1x1 может попасть целиком), долю
+// отличий проверяет полный перебор троек RGB ниже
+const Tolerance LUMA_FIXED_POINT = {1, 1.0};
+// Доли троек из 2^24, где яркости расходятся: 30653 (BT.601), 18972
+// (BT.709), 4296 (BT.2020); при ±1 среднее отклонение и есть эта доля
+const Tolerance LUMA_CUBE_BT601 = {1, 0.0019};
+const Tolerance LUMA_CUBE_BT709 = {1, 0.0012};
+const Tolerance LUMA_CUBE_BT2020 = {1, 0.0003};
+
+struct ConformanceCase {
+    QString operation;
+    QString variant;
+    Operation reference;
+    Operation candidate;
+    Tolerance tolerance;
+};
+
+struct ConformanceImage {
+    QString name;
+    QImage image;
+};
+
+// ============ ЭТАЛОНЫ ПО ОПРЕДЕЛЕНИЮ ============
+
+// Формат, в котором работают построчные ядра (prepareConvolutionImage)
+QImage convolutionInput(const QImage &image) {
+    QImage::Format format = image.format();
+    if (format == QImage::Format_Grayscale8 || format == QImage::Format_RGB32 ||
+        format == QImage::Format_ARGB32) {
+        return image;
+    }
+    return image.convertToFormat(QImage::Format_RGB32);
+}
+
+// Позиция за краем по определению режима: отражение или сдвиг на период
+// повторяется, пока позиция не попадёт внутрь; -1 - постоянный цвет
+int referenceBorderIndex(int position, int size, BorderMode mode) {
+    switch (mode) {
+    case BorderMode::Replicate:
+        return std::max(0, std::min(size - 1, position));
+    case BorderMode::Reflect:
+        while (position < 0 || position >= size) {
+            position = position < 0 ? -1 - position : 2 * size - 1 - position;
+        }
+        return position;
+    case BorderMode::Reflect101:
+        if (size == 1) return 0;
+        while (position < 0 || position >= size) {
+            position = position < 0 ? -position : 2 * size - 2 - position;
+        }
+        return position;
+    case BorderMode::Wrap:
+        while (position < 0) position += size;
+        while (position >= size) position -= size;
+        return position;
+    case BorderMode::Constant:
+        break;
+    }
+    return position >= 0 && position < size ? position : -1;
+}
+
+// Корреляция с ядром kW x kH, центр (kW / 2, kH / 2), за краем - по border;
+// суммы в double по ky, затем kx, округление std::round. С border по
+// умолчанию (Replicate) это прежний filter2D
+void referenceFilter(QImage &image, const std::vector<double> &kernel, int kW, int kH,
+                     const ImageBorder &border = ImageBorder()) {
+    const QImage source = convolutionInput(image);
+    const bool gray = source.format() == QImage::Format_Grayscale8;
+    const int width = source.width();
+    const int height = source.height();
+    QImage result(width, height, gray ? QImage::Format_Grayscale8 : QImage::Format_RGB32);
+    const int constantGray = qGray(border.value);
+
+    auto toByte = [](double value) { return std::max(0, std::min(255, static_cast<int>(std::round(value)))); };
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            double sumR = 0.0, sumG = 0.0, sumB = 0.0;
+            for (int ky = 0; ky < kH; ++ky) {
+                int sy = referenceBorderIndex(y + ky - kH / 2, height, border.mode);
+                for (int kx = 0; kx < kW; ++kx) {
+                    int sx = referenceBorderIndex(x + kx - kW / 2, width, border.mode);
+                    bool outside = sy < 0 || sx < 0;
+                    double k = kernel[static_cast<size_t>(ky) * kW + kx];
+                    if (gray) {
+                        sumR += (outside ? constantGray : source.constScanLine(sy)[sx]) * k;
+                    } else {
+                        QRgb pixel = outside ? border.value
+                                             : reinterpret_cast<const QRgb *>(source.constScanLine(sy))[sx];
+                        sumR += qRed(pixel) * k;
+                        sumG += qGreen(pixel) * k;
+                        sumB += qBlue(pixel) * k;
+                    }
+                }
+            }
+            if (gray) {
+                result.scanLine(y)[x] = static_cast<uchar>(toByte(sumR));
+            } else {
+                reinterpret_cast<QRgb *>(result.scanLine(y))[x] = qRgb(toByte(sumR), toByte(sumG), toByte(sumB));
+            }
+        }
+    }
+    image = result;
+}
+
+// Внешнее произведение: двумерное ядро разделимой свёртки
+std::vector<double> outerProduct(const std::vector<double> &column, const std::vector<double> &row) {
+    std::vector<double> kernel;
+    for (double c : column) {
+        for (double r : row) kernel.push_back(c * r);
+    }
+    return kernel;
+}
+
+// ============ ПРЕЖНИЕ РЕАЛИЗАЦИИ ============
+//
+// Скалярный код filter2d.cpp до оптимизаций (pixel()/setPixel(), суммы в
+// double): эталон для всего, что существовало до ускоренных вариантов.
+// Правки только там, где прежний код не обобщается: режимы края вместо
+// прижатия к краю и double вместо переполнявшегося int в Оцу
+
+// Прежние toGrayscaleBT601/BT709: усечение суммы в double. У BT.2020
+// прежней версии не было, формула та же
+void baselineLuma(QImage &image, double kr, double kg, double kb) {
+    for (int y = 0; y < image.height(); ++y) {
+        for (int x = 0; x < image.width(); ++x) {
+            QRgb pixel = image.pixel(x, y);
+            int r = qRed(pixel);
+            int g = qGreen(pixel);
+            int b = qBlue(pixel);
+
+            int gray = static_cast<int>(kr * r + kg * g + kb * b);
+            gray = std::max(0, std::min(255, gray));
+
+            image.setPixel(x, y, qRgb(gray, gray, gray));
+        }
+    }
+}
+
+// Прежний gaussianBlur: строки, затем столбцы, оба прохода округляются до
+// байта. Изображение переводится в RGB32, как и раньше
+void baselineGaussianBlur(QImage &image, size_t size, double sigma, const ImageBorder &border = ImageBorder()) {
+    image = image.convertToFormat(QImage::Format_RGB32);
+    int width = image.width();
+    int height = image.height();
+    double* kernel = createGaussianKernel1D(size, sigma);
+    if (size % 2 == 0) size++;
+    int kCenter = static_cast<int>(size) / 2;
+
+    QImage tempImage(image.size(), image.format());
+
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            double sumR = 0.0, sumG = 0.0, sumB = 0.0;
+            for (size_t k = 0; k < size; ++k) {
+                int pixelX = referenceBorderIndex(x + static_cast<int>(k) - kCenter, width, border.mode);
+
+                QRgb pixel = pixelX < 0 ? border.value : image.pixel(pixelX, y);
+                double kernelValue = kernel[k];
+
+                sumR += qRed(pixel) * kernelValue;
+                sumG += qGreen(pixel) * kernelValue;
+                sumB += qBlue(pixel) * kernelValue;
+            }
+            int r = std::max(0, std::min(255, static_cast<int>(std::round(sumR))));
+            int g = std::max(0, std::min(255, static_cast<int>(std::round(sumG))));
+            int b = std::max(0, std::min(255, static_cast<int>(std::round(sumB))));
+            tempImage.setPixel(x, y, qRgb(r, g, b));
+        }
+    }
+
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            double sumR = 0.0, sumG = 0.0, sumB = 0.0;
+            for (size_t k = 0; k < size; ++k) {
+                int pixelY = referenceBorderIndex(y + static_cast<int>(k) - kCenter, height, border.mode);
+
+                QRgb pixel = pixelY < 0 ? border.value : tempImage.pixel(x, pixelY);
+                double kernelValue = kernel[k];
+
+                sumR += qRed(pixel) * kernelValue;
+                sumG += qGreen(pixel) * kernelValue;
+                sumB += qBlue(pixel) * kernelValue;
+            }
+            int r = std::max(0, std::min(255, static_cast<int>(std::round(sumR))));
+            int g = std::max(0, std::min(255, static_cast<int>(std::round(sumG))));
+            int b = std::max(0, std::min(255, static_cast<int>(std::round(sumB))));
+            image.setPixel(x, y, qRgb(r, g, b));
+        }
+    }
+
+    delete[] kernel;
+}
+
+// Прежний calculateOtsuThreshold. Произведение wB * wF считалось в int и
+// переполнялось начиная примерно с 92 тысяч пикселей; здесь оно в double
+// (для меньших изображений результат тот же, текущий код тоже в double)
+int baselineOtsuThreshold(const QImage &image) {
+    // Гистограмма
+    int histogram[256] = {0};
+    int totalPixels = image.width() * image.height();
+
+    for (int y = 0; y < image.height(); ++y) {
+        for (int x = 0; x < image.width(); ++x) {
+            int gray = qGray(image.pixel(x, y));
+            histogram[gray]++;
+        }
+    }
+
+    double sum = 0;
+    for (int i = 0; i < 256; ++i) {
+        sum += i * histogram[i];
+    }
+
+    double sumB = 0;
+    int wB = 0;
+    int wF = 0;
+    double maxVariance = 0;
+    int threshold = 0;
+
+    for (int t = 0; t < 256; ++t) {
+        wB += histogram[t];
+        if (wB == 0) continue;
+
+        wF = totalPixels - wB;
+        if (wF == 0) break;
+
+        sumB += t * histogram[t];
+
+        double mB = sumB / wB;
+        double mF = (sum - sumB) / wF;
+
+        double variance = static_cast<double>(wB) * wF * (mB - mF) * (mB - mF);
+
+        if (variance > maxVariance) {
+            maxVariance = variance;
+            threshold = t;
+        }
+    }
+
+    return threshold;
+}
+
+// Прежний calculateHuangThreshold
+int baselineHuangThreshold(const QImage &image) {
+    // Гистограмма
+    int histogram[256] = {0};
+    int totalPixels = image.width() * image.height();
+
+    for (int y = 0; y < image.height(); ++y) {
+        for (int x = 0; x < image.width(); ++x) {
+            int gray = qGray(image.pixel(x, y));
+            histogram[gray]++;
+        }
+    }
+
+    // Нормализованная гистограмма (вероятности)
+    double prob[256];
+    for (int i = 0; i < 256; ++i) {
+        prob[i] = static_cast<double>(histogram[i]) / totalPixels;
+    }
+
+    double maxEntropy = -1;
+    int threshold = 0;
+
+    for (int t = 0; t < 256; ++t) {
+        // Энтропия фона
+        double sumProb0 = 0;
+        double entropy0 = 0;
+        for (int i = 0; i <= t; ++i) {
+            sumProb0 += prob[i];
+            if (prob[i] > 0) {
+                double p = prob[i] / (sumProb0 + 1e-10);
+                entropy0 -= p * std::log(p + 1e-10);
+            }
+        }
+
+        // Энтропия объекта
+        double sumProb1 = 0;
+        double entropy1 = 0;
+        for (int i = t + 1; i < 256; ++i) {
+            sumProb1 += prob[i];
+            if (prob[i] > 0) {
+                double p = prob[i] / (sumProb1 + 1e-10);
+                entropy1 -= p * std::log(p + 1e-10);
+            }
+        }
+
+        double totalEntropy = entropy0 + entropy1;
+
+        if (totalEntropy > maxEntropy) {
+            maxEntropy = totalEntropy;
+            threshold = t;
+        }
+    }
+
+    return threshold;
+}
+
+// Порог прежнего binarizeISODATA: итерации по всем пикселям
+int baselineISODATAThreshold(const QImage &image) {
+    // Начальный порог - среднее значение яркости
+    long long sum = 0;
+    int totalPixels = image.width() * image.height();
+
+    for (int y = 0; y < image.height(); ++y) {
+        for (int x = 0; x < image.width(); ++x) {
+            sum += qGray(image.pixel(x, y));
+        }
+    }
+
+    int threshold = sum / totalPixels;
+    int oldThreshold;
+    int iteration = 0;
+    const int maxIterations = 100;
+
+    do {
+        oldThreshold = threshold;
+
+        long long sum0 = 0, sum1 = 0;
+        int count0 = 0, count1 = 0;
+
+        for (int y = 0; y < image.height(); ++y) {
+            for (int x = 0; x < image.width(); ++x) {
+                int gray = qGray(image.pixel(x, y));
+                if (gray < threshold) {
+                    sum0 += gray;
+                    count0++;
+                } else {
+                    sum1 += gray;
+                    count1++;
+                }
+            }
+        }
+
+        int mean0 = (count0 > 0) ? sum0 / count0 : 0;
+        int mean1 = (count1 > 0) ? sum1 / count1 : 255;
+
+        threshold = (mean0 + mean1) / 2;
+
+        iteration++;
+    } while (std::abs(threshold - oldThreshold) > 1 && iteration < maxIterations);
+
+    return threshold;
+}
+
+// Применение порога, как в прежних binarize*
+void baselineApplyThreshold(QImage &image, int threshold) {
+    for (int y = 0; y < image.height(); ++y) {
+        for (int x = 0; x < image.width(); ++x) {
+            int gray = qGray(image.pixel(x, y));
+            int binary = (gray >= threshold) ? 255 : 0;
+            image.setPixel(x, y, qRgb(binary, binary, binary));
+        }
+    }
+}
+
+// Серый вход порогов. Яркость берётся из библиотеки: её отличие от прежней
+// формулы (±1) проверяют случаи bt601/bt709/bt2020, а пороги сравниваются с
+// прежними алгоритмами на одном и том же сером изображении
+void thresholdInput(QImage &image) {
+    convertToGrayscale(image);
+}
+
+// Глобальный порог прежнего алгоритма на сером входе
+Operation baselineGlobalThreshold(std::function<int(const QImage &)> threshold) {
+    return [threshold](QImage &image) {
+        thresholdInput(image);
+        image = image.convertToFormat(QImage::Format_RGB32);
+        baselineApplyThreshold(image, threshold(image));
+    };
+}
+
+// ============ ЭТАЛОНЫ ПО ОПРЕДЕЛЕНИЮ ДЛЯ НОВЫХ ОПЕРАЦИЙ ============
+
+// Многоуровневый Оцу полным перебором троек порогов: максимум суммы
+// S^2 / P по четырём классам [0, t1], [t1 + 1, t2], [t2 + 1, t3], [t3 + 1, 255].
+// При равных суммах берётся наименьшая тройка (t3, t2, t1) - так же
+// выбирает динамическое программирование
+std::vector<int> exhaustiveOtsuThresholds3(const QImage &gray) {
+    double P[257] = {0.0}, S[257] = {0.0};
+    for (int y = 0; y < gray.height(); ++y) {
+        for (int x = 0; x < gray.width(); ++x) {
+            int value = qGray(gray.pixel(x, y));
+            P[value + 1] += 1.0;
+            S[value + 1] += value;
+        }
+    }
+    for (int i = 0; i < 256; ++i) {
+        P[i + 1] += P[i];
+        S[i + 1] += S[i];
+    }
+    auto score = [&P, &S](int first, int last) {
+        double weight = P[last + 1] - P[first];
+        if (weight <= 0.0) return 0.0;
+        double moment = S[last + 1] - S[first];
+        return moment * moment / weight;
+    };
+
+    double best = -1.0;
+    std::vector<int> thresholds(3, 0);
+    for (int t3 = 2; t3 < 255; ++t3) {
+        for (int t2 = 1; t2 < t3; ++t2) {
+            for (int t1 = 0; t1 < t2; ++t1) {
+                double total = score(0, t1) + score(t1 + 1, t2) + score(t2 + 1, t3) + score(t3 + 1, 255);
+                if (total > best) {
+                    best = total;
+                    thresholds = {t1, t2, t3};
+                }
+            }
+        }
+    }
+    return thresholds;
+}
+
+// Постеризация по порогам: класс - число достигнутых порогов, уровни
+// классов равномерно от 0 до 255 с округлением
+void referencePosterize(QImage &image, const std::vector<int> &thresholds) {
+    const int classes = static_cast<int>(thresholds.size()) + 1;
+    for (int y = 0; y < image.height(); ++y) {
+        for (int x = 0; x < image.width(); ++x) {
+            int gray = qGray(image.pixel(x, y));
+            int level = 0;
+            for (int threshold : thresholds) level += gray >= threshold ? 1 : 0;
+            int value = static_cast<int>(std::lround(255.0 * level / (classes - 1)));
+            image.setPixel(x, y, qRgb(value, value, value));
+        }
+    }
+}
+
+// Сумма и сумма квадратов окна, обрезанного по границам, перебором
+struct WindowSums {
+    quint64 sum = 0;
+    quint64 sumSq = 0;
+    int count = 0;
+    int minGray = 255;
+    int maxGray = 0;
+};
+
+WindowSums windowSums(const QImage &gray, int x, int y, int windowSize) {
+    const int half = windowSize / 2;
+    WindowSums sums;
+    for (int sy = std::max(0, y - half); sy <= std::min(gray.height() - 1, y + half); ++sy) {
+        for (int sx = std::max(0, x - half); sx <= std::min(gray.width() - 1, x + half); ++sx) {
+            quint64 value = gray.constScanLine(sy)[sx];
+            sums.sum += value;
+            sums.sumSq += value * value;
+            sums.count++;
+            sums.minGray = std::min(sums.minGray, static_cast<int>(value));
+            sums.maxGray = std::max(sums.maxGray, static_cast<int>(value));
+        }
+    }
+    return sums;
+}
+
+void windowMeanStdDev(const WindowSums &sums, double &mean, double &stdDev) {
+    mean = static_cast<double>(sums.sum) / sums.count;
+    double variance = static_cast<double>(sums.sumSq) / sums.count - mean * mean;
+    stdDev = std::sqrt(std::max(0.0, variance));
+}
+
+// Порог T = f(mean, stdDev) для каждого пикселя
+void referenceLocalThreshold(QImage &image, int windowSize,
+                             const std::function<double(double, double)> &threshold) {
+    thresholdInput(image);
+    QImage result(image.width(), image.height(), QImage::Format_Grayscale8);
+    for (int y = 0; y < image.height(); ++y) {
+        for (int x = 0; x < image.width(); ++x) {
+            double mean, stdDev;
+            windowMeanStdDev(windowSums(image, x, y, windowSize), mean, stdDev);
+            result.scanLine(y)[x] = image.constScanLine(y)[x] >= threshold(mean, stdDev) ? 255 : 0;
+        }
+    }
+    image = result;
+}
+
+void referenceWolf(QImage &image, int windowSize, double k) {
+    QImage gray = image;
+    thresholdInput(gray);
+    int minGray = 255;
+    double maxStdDev = 0.0;
+    for (int y = 0; y < gray.height(); ++y) {
+        for (int x = 0; x < gray.width(); ++x) {
+            double mean, stdDev;
+            windowMeanStdDev(windowSums(gray, x, y, windowSize), mean, stdDev);
+            minGray = std::min(minGray, static_cast<int>(gray.constScanLine(y)[x]));
+            maxStdDev = std::max(maxStdDev, stdDev);
+        }
+    }
+    const double m = minGray;
+    const double r = maxStdDev > 0.0 ? maxStdDev : 1.0;
+    referenceLocalThreshold(image, windowSize, [k, m, r](double mean, double stdDev) {
+        return (1.0 - k) * mean + k * m + k * (stdDev / r) * (mean - m);
+    });
+}
+
+void referenceBernsen(QImage &image, int windowSize, int contrastThreshold) {
+    thresholdInput(image);
+    QImage result(image.width(), image.height(), QImage::Format_Grayscale8);
+    for (int y = 0; y < image.height(); ++y) {
+        for (int x = 0; x < image.width(); ++x) {
+            WindowSums sums = windowSums(image, x, y, windowSize);
+            int mid = (sums.minGray + sums.maxGray) / 2;
+            bool white = sums.maxGray - sums.minGray < contrastThreshold
+                             ? mid >= 128 : image.constScanLine(y)[x] >= mid;
+            result.scanLine(y)[x] = white ? 255 : 0;
+        }
+    }
+    image = result;
+}
+
+// ============ ВАРИАНТЫ ============
+
+Kernel takeKernel(double *kernel, size_t length) {
+    Kernel result = std::make_shared<std::vector<double>>(kernel, kernel + length);
+    delete[] kernel;
+    return result;
+}
+
+// Неразделимое ядро со знакопеременными весами (ранг больше 1)
+Kernel nonSeparableKernel(int kW, int kH) {
+    Kernel kernel = std::make_shared<std::vector<double>>();
+    for (int ky = 0; ky < kH; ++ky) {
+        for (int kx = 0; kx < kW; ++kx) {
+            kernel->push_back(((kx * 7 + ky * 3) % 5 - 1.5) / (kW * kH) + (kx == kW / 2 && ky == kH / 2));
+        }
+    }
+    return kernel;
+}
+
+// Неразделимое ядро из коэффициентов, кратных step: при step, кратном 0.5,
+// ядра 3x3, 5x5 и 7x7 идут целочисленным проходом
+Kernel steppedKernel(int size, double step) {
+    Kernel kernel = std::make_shared<std::vector<double>>();
+    for (int ky = 0; ky < size; ++ky) {
+        for (int kx = 0; kx < size; ++kx) {
+            kernel->push_back(((kx * 7 + ky * 3) % 5 - 2) * step + (kx == size / 2 && ky == size / 2));
+        }
+    }
+    return kernel;
+}
+
+Operation atSimdLevel(SimdLevel level, const Operation &operation) {
+    return [level, operation](QImage &image) {
+        SimdLevel previous = activeSimdLevel();
+        setSimdLevel(level);
+        operation(image);
+        setSimdLevel(previous);
+    };
+}
+
+Operation withThreads(int threads, const Operation &operation) {
+    return [threads, operation](QImage &image) {
+        int previous = filterThreadCount();
+        setFilterThreadCount(threads);
+        operation(image);
+        setFilterThreadCount(previous);
+    };
+}
+
+// Та же операция над серым изображением в RGB32: результат должен совпасть
+// с путём Grayscale8
+Operation onGrayAsRgb(const Operation &operation) {
+    return [operation](QImage &image) {
+        convertToGrayscale(image);
+        image = image.convertToFormat(QImage::Format_RGB32);
+        operation(image);
+    };
+}
+
+Operation onGray(const Operation &operation) {
+    return [operation](QImage &image) {
+        convertToGrayscale(image);
+        operation(image);
+    };
+}
+
+struct LibraryOperation {
+    QString name;
+    Operation run;
+    Operation reference;        // по определению
+    Tolerance tolerance;        // относительно reference
+    Tolerance grayTolerance;    // серое в RGB32 относительно Grayscale8
+};
+
+std::vector<LibraryOperation> libraryOperations() {
+    std::vector<LibraryOperation> operations;
+    auto add = [&operations](const QString &name, Operation run, Operation reference, Tolerance tolerance) {
+        operations.push_back(LibraryOperation{name, run, reference, tolerance, EXACT});
+    };
+
+    // Прямая свёртка (неразделимые ядра до FFT_MIN_KERNEL_AREA, ядра 1xN и Nx1)
+    Kernel sharpen = takeKernel(createSharpenKernel(), 9);
+    Kernel sobel = takeKernel(createSobelXKernel(), 9);
+    const int directSizes[][2] = {{3, 3}, {4, 4}, {5, 5}, {7, 7}, {15, 15}, {7, 1}, {1, 7}};
+    add("filter2d sharpen 3x3", [sharpen](QImage &image) { filter2D(image, sharpen->data(), 3, 3); },
+        [sharpen](QImage &image) { referenceFilter(image, *sharpen, 3, 3); }, EXACT);
+    add("filter2d sobelx 3x3", [sobel](QImage &image) { filter2D(image, sobel->data(), 3, 3); },
+        [sobel](QImage &image) { referenceFilter(image, *sobel, 3, 3); }, EXACT);
+    for (const auto &size : directSizes) {
+        const int kW = size[0], kH = size[1];
+        Kernel kernel = nonSeparableKernel(kW, kH);
+        add(QString("filter2d %1x%2").arg(kW).arg(kH),
+            [kernel, kW, kH](QImage &image) { filter2D(image, kernel->data(), kW, kH); },
+            [kernel, kW, kH](QImage &image) { referenceFilter(image, *kernel, kW, kH); }, EXACT);
+    }
+
+    // Целочисленный проход: полуцелые веса, целые и целые с суммами шире
+    // int16 (векторные уровни считают их в double, скалярный - в int)
+    const struct { int size; double step; } steppedKernels[] = {{3, 0.5}, {5, 1.0}, {7, 40.0}};
+    for (const auto &stepped : steppedKernels) {
+        const int kSize = stepped.size;
+        Kernel kernel = steppedKernel(kSize, stepped.step);
+        add(QString("filter2d %1x%2 step %3").arg(kSize).arg(kSize).arg(stepped.step),
+            [kernel, kSize](QImage &image) { filter2D(image, kernel->data(), kSize, kSize); },
+            [kernel, kSize](QImage &image) { referenceFilter(image, *kernel, kSize, kSize); }, EXACT);
+    }
+
+    // Разделимые целочисленные ядра (производная по x, как у Собеля) идут
+    // целочисленным проходом, а не раскладываются
+    for (int kSize : {3, 5, 7}) {
+        std::vector<double> ones(kSize, 1.0), slope;
+        for (int i = 0; i < kSize; ++i) slope.push_back(i - kSize / 2);
+        Kernel derivative = std::make_shared<std::vector<double>>(outerProduct(ones, slope));
+        add(QString("filter2d derivative %1x%2").arg(kSize).arg(kSize),
+            [derivative, kSize](QImage &image) { filter2D(image, derivative->data(), kSize, kSize); },
+            [derivative, kSize](QImage &image) { referenceFilter(image, *derivative, kSize, kSize); }, EXACT);
+    }
+
+    // Разделимое ядро: filter2D раскладывает его сам
+    Kernel gauss2d = takeKernel(createGaussianKernel(9, 2.0), 81);
+    add("filter2d gaussian 9x9", [gauss2d](QImage &image) { filter2D(image, gauss2d->data(), 9, 9); },
+        [gauss2d](QImage &image) { referenceFilter(image, *gauss2d, 9, 9); }, REORDERED_SUM);
+
+    Kernel row = takeKernel(createGaussianKernel1D(7, 1.5), 7);
+    Kernel column = std::make_shared<std::vector<double>>(std::vector<double>{0.25, 0.5, 0.25});
+    add("sepfilter2d 7x3", [row, column](QImage &image) { sepFilter2D(image, row->data(), 7, column->data(), 3); },
+        [row, column](QImage &image) { referenceFilter(image, outerProduct(*column, *row), 7, 3); },
+        REORDERED_SUM);
+
+    // БПФ: неразделимое ядро больше FFT_MIN_KERNEL_AREA и явный вызов
+    Kernel large = nonSeparableKernel(17, 17);
+    add("filter2d 17x17 (fft)", [large](QImage &image) { filter2D(image, large->data(), 17, 17); },
+        [large](QImage &image) { referenceFilter(image, *large, 17, 17); }, FFT_ROUNDING);
+    add("fftfilter2d sharpen 3x3", [sharpen](QImage &image) { fftFilter2D(image, sharpen->data(), 3, 3); },
+        [sharpen](QImage &image) { referenceFilter(image, *sharpen, 3, 3); }, FFT_ROUNDING);
+    operations[operations.size() - 2].grayTolerance = FFT_ROUNDING;
+    operations.back().grayTolerance = FFT_ROUNDING;
+
+    // Одномерные ядра длиннее FFT_MIN_KERNEL_AREA идут прямым проходом
+    Kernel longRow = nonSeparableKernel(301, 1);
+    add("filter2d 301x1", [longRow](QImage &image) { filter2D(image, longRow->data(), 301, 1); },
+        [longRow](QImage &image) { referenceFilter(image, *longRow, 301, 1); }, EXACT);
+    add("filter2d 1x301", [longRow](QImage &image) { filter2D(image, longRow->data(), 1, 301); },
+        [longRow](QImage &image) { referenceFilter(image, *longRow, 1, 301); }, EXACT);
+
+    // Точный Гаусс - тот же алгоритм, что прежний gaussianBlur
+    for (int size : {3, 9}) {
+        const double sigma = size / 3.0;
+        add(QString("gaussian exact %1").arg(size),
+            [size, sigma](QImage &image) { gaussianBlur(image, size, sigma, GaussianMode::Exact); },
+            [size, sigma](QImage &image) { baselineGaussianBlur(image, size, sigma); }, EXACT);
+    }
+
+    // Авто с усечённым ядром (33 < 2*ceil(3*8)+1) остаётся точной свёрткой
+    add("gaussian auto 33 sigma=8",
+        [](QImage &image) { gaussianBlur(image, 33, 8.0, GaussianMode::Auto); },
+        [](QImage &image) { baselineGaussianBlur(image, 33, 8.0); }, EXACT);
+
+    // Рекурсивный Гаусс против свёртки с ядром до 4 sigma
+    const struct {
+        double sigma;
+        Tolerance tolerance;
+    } recursive[] = {{1.0, RECURSIVE_GAUSSIAN_SIGMA1}, {3.0, RECURSIVE_GAUSSIAN_SIGMA3}};
+    for (const auto &entry : recursive) {
+        const double sigma = entry.sigma;
+        const int size = 2 * static_cast<int>(std::ceil(4.0 * sigma)) + 1;
+        Kernel kernel = takeKernel(createGaussianKernel1D(size, sigma), size);
+        add(QString("gaussian fast sigma=%1").arg(sigma),
+            [sigma](QImage &image) { gaussianBlur(image, 3, sigma, GaussianMode::Fast); },
+            [kernel, size](QImage &image) { referenceFilter(image, outerProduct(*kernel, *kernel), size, size); },
+            entry.tolerance);
+    }
+
+    // Режимы края на каждом пути свёртки. Постоянный цвет серый: иначе
+    // серое изображение в RGB32 и в Grayscale8 дополнялось бы по-разному
+    const struct {
+        const char *name;
+        ImageBorder border;
+    } borders[] = {{"reflect", BorderMode::Reflect},
+                   {"reflect101", BorderMode::Reflect101},
+                   {"wrap", BorderMode::Wrap},
+                   {"constant", ImageBorder(BorderMode::Constant, qRgb(160, 160, 160))}};
+    Kernel direct = nonSeparableKernel(5, 5);
+    Kernel gaussFast = takeKernel(createGaussianKernel1D(25, 3.0), 25);
+    for (const auto &entry : borders) {
+        const ImageBorder border = entry.border;
+        add(QString("filter2d 5x5 %1").arg(entry.name),
+            [direct, border](QImage &image) { filter2D(image, direct->data(), 5, 5, border); },
+            [direct, border](QImage &image) { referenceFilter(image, *direct, 5, 5, border); }, EXACT);
+        add(QString("sepfilter2d 7x3 %1").arg(entry.name),
+            [row, column, border](QImage &image) { sepFilter2D(image, row->data(), 7, column->data(), 3, border); },
+            [row, column, border](QImage &image) { referenceFilter(image, outerProduct(*column, *row), 7, 3, border); },
+            REORDERED_SUM);
+        add(QString("filter2d 17x17 (fft) %1").arg(entry.name),
+            [large, border](QImage &image) { filter2D(image, large->data(), 17, 17, border); },
+            [large, border](QImage &image) { referenceFilter(image, *large, 17, 17, border); }, FFT_ROUNDING);
+        operations.back().grayTolerance = FFT_ROUNDING;
+        add(QString("gaussian exact 9 %1").arg(entry.name),
+            [border](QImage &image) { gaussianBlur(image, 9, 3.0, GaussianMode::Exact, border); },
+            [border](QImage &image) { baselineGaussianBlur(image, 9, 3.0, border); }, EXACT);
+        add(QString("gaussian fast sigma=3 %1").arg(entry.name),
+            [border](QImage &image) { gaussianBlur(image, 3, 3.0, GaussianMode::Fast, border); },
+            [gaussFast, border](QImage &image) {
+                referenceFilter(image, outerProduct(*gaussFast, *gaussFast), 25, 25, border);
+            }, RECURSIVE_GAUSSIAN_SIGMA3);
+    }
+
+    add("bt601", [](QImage &image) { toGrayscaleBT601(image); },
+        [](QImage &image) { baselineLuma(image, 0.299, 0.587, 0.114); }, LUMA_FIXED_POINT);
+    add("bt709", [](QImage &image) { toGrayscaleBT709(image); },
+        [](QImage &image) { baselineLuma(image, 0.2126, 0.7152, 0.0722); }, LUMA_FIXED_POINT);
+    add("bt2020", [](QImage &image) { toGrayscaleBT2020(image); },
+        [](QImage &image) { baselineLuma(image, 0.2627, 0.6780, 0.0593); }, LUMA_FIXED_POINT);
+
+    add("otsu", [](QImage &image) { binarizeOtsu(image); }, baselineGlobalThreshold(baselineOtsuThreshold), EXACT);
+    add("huang", [](QImage &image) { binarizeHuang(image); }, baselineGlobalThreshold(baselineHuangThreshold), EXACT);
+    add("isodata", [](QImage &image) { binarizeISODATA(image); },
+        baselineGlobalThreshold(baselineISODATAThreshold), EXACT);
+    add("multiotsu 3", [](QImage &image) { binarizeMultiOtsu(image, 3); }, [](QImage &image) {
+        thresholdInput(image);
+        referencePosterize(image, exhaustiveOtsuThresholds3(image));
+    }, EXACT);
+
+    // Окна больше изображения проверяют обрезание по краям
+    for (int window : {3, 15, 31}) {
+        add(QString("niblack %1").arg(window), [window](QImage &image) { binarizeNiblack(image, window, -0.2); },
+            [window](QImage &image) {
+                referenceLocalThreshold(image, window, [](double mean, double stdDev) { return mean - 0.2 * stdDev; });
+            }, EXACT);
+        add(QString("sauvola %1").arg(window), [window](QImage &image) { binarizeSauvola(image, window, 0.5); },
+            [window](QImage &image) {
+                referenceLocalThreshold(image, window, [](double mean, double stdDev) {
+                    return mean * (1.0 + 0.5 * (stdDev / SAUVOLA_DYNAMIC_RANGE - 1.0));
+                });
+            }, EXACT);
+        add(QString("wolf %1").arg(window), [window](QImage &image) { binarizeWolf(image, window, 0.5); },
+            [window](QImage &image) { referenceWolf(image, window, 0.5); }, EXACT);
+        add(QString("bernsen %1").arg(window), [window](QImage &image) { binarizeBernsen(image, window, 15); },
+            [window](QImage &image) { referenceBernsen(image, window, 15); }, EXACT);
+    }
+    return operations;
+}
+
+std::vector<ConformanceCase> conformanceCases() {
+    std::vector<ConformanceCase> cases;
+    const SimdLevel levels[] = {SimdLevel::SSE41, SimdLevel::AVX2};
+
+    for (const LibraryOperation &operation : libraryOperations()) {
+        // Эталон вариантов - скалярный однопоточный проход
+        const Operation scalar = withThreads(1, atSimdLevel(SimdLevel::Scalar, operation.run));
+
+        cases.push_back(ConformanceCase{operation.name, "по определению", operation.reference,
+                                        scalar, operation.tolerance});
+        for (SimdLevel level : levels) {
+            if (level > supportedSimdLevel()) continue;
+            cases.push_back(ConformanceCase{operation.name, simdLevelName(level), scalar,
+                                            withThreads(1, atSimdLevel(level, operation.run)), EXACT});
+        }
+        cases.push_back(ConformanceCase{operation.name, "потоки", scalar,
+                                        withThreads(0, operation.run), EXACT});
+        cases.push_back(ConformanceCase{operation.name, "серое в RGB32", onGray(operation.run),
+                                        onGrayAsRgb(operation.run), operation.grayTolerance});
+    }
+    return cases;
+}
+
+// ============ ВХОДЫ ============
+
+// Страница со штрихами и шумом; насыщенные 0 и 255 проверяют ограничение сумм
+QImage syntheticImage(int width, int height, int seed) {
+    QImage image(width, height, QImage::Format_ARGB32);
+    for (int y = 0; y < height; ++y) {
+        QRgb *line = reinterpret_cast<QRgb *>(image.scanLine(y));
+        for (int x = 0; x < width; ++x) {
+            quint32 noise = (static_cast<quint32>(x + seed) * 73856093u) ^ (static_cast<quint32>(y) * 19349663u);
+            noise *= 2654435761u;
+            int value = 120 + 100 * x / std::max(1, width) + static_cast<int>(noise >> 28);
+            if ((x / 6 + y / 5) % 4 == 0) value = 20 + static_cast<int>((noise >> 24) & 15);
+            if ((x + y) % 11 == 0) value = (noise & 1) ? 255 : 0;
+            line[x] = qRgba(std::min(255, value + 12), value, std::max(0, value - 30),
+                            static_cast<int>(noise >> 24));
+        }
+    }
+    return image;
+}
+
+// Все 2^24 тройки RGB: 4096 x 4096, R - старшие биты строки
+QImage rgbCubeImage() {
+    QImage image(4096, 4096, QImage::Format_RGB32);
+    for (int y = 0; y < 4096; ++y) {
+        QRgb *line = reinterpret_cast<QRgb *>(image.scanLine(y));
+        for (int x = 0; x < 4096; ++x) line[x] = qRgb(y >> 4, ((y & 15) << 4) | (x >> 8), x & 255);
+    }
+    return image;
+}
+
+// Яркость против прежней формулы на всём кубе RGB
+std::vector<ConformanceCase> lumaCubeCases() {
+    const struct {
+        const char *name;
+        LumaStandard standard;
+        double kr, kg, kb;
+        Tolerance tolerance;
+    } standards[] = {{"bt601", LumaStandard::BT601, 0.299, 0.587, 0.114, LUMA_CUBE_BT601},
+                     {"bt709", LumaStandard::BT709, 0.2126, 0.7152, 0.0722, LUMA_CUBE_BT709},
+                     {"bt2020", LumaStandard::BT2020, 0.2627, 0.6780, 0.0593, LUMA_CUBE_BT2020}};
+    std::vector<ConformanceCase> cases;
+    for (const auto &entry : standards) {
+        const LumaStandard standard = entry.standard;
+        const double kr = entry.kr, kg = entry.kg, kb = entry.kb;
+        cases.push_back(ConformanceCase{QString("%1 куб RGB").arg(entry.name), "по определению",
+                                        [kr, kg, kb](QImage &image) { baselineLuma(image, kr, kg, kb); },
+                                        [standard](QImage &image) { toGrayscale(image, standard); },
+                                        entry.tolerance});
+    }
+    return cases;
+}
+
+std::vector<ConformanceImage> conformanceImages(const QStringList &imageFiles, QTextStream &log) {
+    // Нечётные размеры, полосы и изображения меньше ядра 17x17 и окна 31
+    const int sizes[][2] = {{1, 1}, {1, 37}, {37, 1}, {2, 3}, {5, 4}, {17, 13}, {64, 48}, {203, 151}};
+    const struct {
+        const char *name;
+        QImage::Format format;
+    } formats[] = {
+        {"rgb32", QImage::Format_RGB32},
+        {"argb32", QImage::Format_ARGB32},
+        {"rgb888", QImage::Format_RGB888},
+        {"gray8", QImage::Format_Grayscale8}
+    };
+
+    std::vector<ConformanceImage> images;
+    int seed = 0;
+    for (const auto &size : sizes) {
+        QImage source = syntheticImage(size[0], size[1], seed++);
+        for (const auto &format : formats) {
+            images.push_back(ConformanceImage{QString("%1x%2 %3").arg(size[0]).arg(size[1]).arg(format.name),
+                                              source.convertToFormat(format.format)});
+        }
+    }
+
+    for (const QString &path : imageFiles) {
+        QImage image(path);
+        if (image.isNull()) {
+            log << "Не удалось загрузить " << path << '\n';
+            continue;
+        }
+        images.push_back(ConformanceImage{QFileInfo(path).fileName(), image});
+    }
+    return images;
+}
+
+// Наибольшее и среднее отклонение каналов R, G, B
+struct Deviation {
+    int maxDifference = 0;
+    double meanDifference = 0.0;
+};
+
+Deviation compareImages(const QImage &reference, const QImage &candidate) {
+    Deviation deviation;
+    if (reference.size() != candidate.size()) {
+        deviation.maxDifference = 256;
+        deviation.meanDifference = 256.0;
+        return deviation;
+    }
+    quint64 total = 0;
+    for (int y = 0; y < reference.height(); ++y) {
+        for (int x = 0; x < reference.width(); ++x) {
+            QRgb a = reference.pixel(x, y);
+            QRgb b = candidate.pixel(x, y);
+            int differences[3] = {std::abs(qRed(a) - qRed(b)), std::abs(qGreen(a) - qGreen(b)),
+                                  std::abs(qBlue(a) - qBlue(b))};
+            for (int difference : differences) {
+                deviation.maxDifference = std::max(deviation.maxDifference, difference);
+                total += static_cast<quint64>(difference);
+            }
+        }
+    }
+    const double channels = 3.0 * reference.width() * reference.height();
+    deviation.meanDifference = channels > 0 ? total / channels : 0.0;
+    return deviation;
+}
+
+// Прогон случая на всех входах; false - хотя бы один вход вне допуска
+bool runCase(const ConformanceCase &check, const std::vector<ConformanceImage> &images, QTextStream &log) {
+    Deviation worst;
+    QStringList failed;
+    for (const ConformanceImage &input : images) {
+        QImage reference = input.image.copy();
+        QImage candidate = input.image.copy();
+        check.reference(reference);
+        check.candidate(candidate);
+
+        Deviation deviation = compareImages(reference, candidate);
+        worst.maxDifference = std::max(worst.maxDifference, deviation.maxDifference);
+        worst.meanDifference = std::max(worst.meanDifference, deviation.meanDifference);
+        if (deviation.maxDifference > check.tolerance.maxDifference ||
+            deviation.meanDifference > check.tolerance.meanDifference) {
+            failed << input.name;
+        }
+    }
+
+    log << QString("%1 %2 %3 %4  %5\n").arg(check.operation, -26).arg(check.variant, -16)
+               .arg(QString("%1 (%2)").arg(worst.maxDifference).arg(check.tolerance.maxDifference), -14)
+               .arg(QString("%1 (%2)").arg(worst.meanDifference, 0, 'f', 4)
+                        .arg(check.tolerance.meanDifference), -20)
+               .arg(failed.isEmpty() ? QString("OK") : "ОШИБКА: " + failed.join(", "));
+    log.flush();
+    return failed.isEmpty();
+}
+
+} // namespace
+
+int runConformance(const QStringList &imageFiles, QTextStream &log) {
+    const std::vector<ConformanceImage> images = conformanceImages(imageFiles, log);
+    const std::vector<ConformanceCase> cases = conformanceCases();
+    const std::vector<ConformanceCase> cubeCases = lumaCubeCases();
+    const std::vector<ConformanceImage> cube(1, ConformanceImage{"куб RGB", rgbCubeImage()});
+
+    log << QString("%1 %2 %3 %4  %5\n").arg("операция", -26).arg("вариант", -16)
+               .arg("макс (допуск)", -14).arg("среднее (допуск)", -20).arg("итог");
+    int failures = 0;
+    for (const ConformanceCase &check : cases) {
+        if (!runCase(check, images, log)) ++failures;
+    }
+    for (const ConformanceCase &check : cubeCases) {
+        if (!runCase(check, cube, log)) ++failures;
+    }
+
+    log << "Случаев: " << static_cast<int>(cases.size() + cubeCases.size())
+        << ", изображений: " << static_cast<int>(images.size()) << ", вне допуска: " << failures << '\n';
+    log.flush();
+    return failures;
+}
@@ -0,0 +1,21 @@
+#ifndef CONFORMANCE_H
+#define CONFORMANCE_H
+
+#include <QStringList>
+#include <QTextStream>
+
+// Проверка быстрых вариантов операций filter2d.h по эталону (ImageFilterBench --verify).
+//
+// Эталон - сегодняшний скалярный однопоточный проход и реализации по
+// определению: свёртка перебором ядра с повторением краёв, пороги окон
+// перебором пикселей окна, яркость по формуле с фиксированной точкой.
+// Проверяются векторные уровни (SSE4.1, AVX2), многопоточность, разделимая
+// свёртка, БПФ, рекурсивный Гаусс и путь Grayscale8. Допуск каждого случая
+// (совпадение бит в бит или ограниченное отклонение) задан в conformance.cpp.
+//
+// Входы - синтетические изображения во всех форматах, включая нечётные
+// размеры, полосы 1xN и Nx1 и изображения меньше ядра, а также файлы
+// imageFiles. Возвращает число случаев вне допуска; таблица - в log.
+int runConformance(const QStringList &imageFiles, QTextStream &log);
+
+#endif // CONFORMANCE_H
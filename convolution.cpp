@@ -0,0 +1,1118 @@
+#include "convolution.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define CONVOLUTION_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+inline int roundToByte(double value) {
+    return std::max(0, std::min(255, static_cast<int>(std::round(value))));
+}
+
+// Середина строки копируется целиком, по режиму края пересчитываются
+// только left + right дополняющих пикселей
+template <typename Pixel>
+void padRowWithBorder(const Pixel *src, int width, int left, int right, Pixel *dst, const ImageBorder &border) {
+    Pixel *tail = dst + left + width;
+    if (border.mode == BorderMode::Replicate) {
+        std::fill(dst, dst + left, src[0]);
+        std::copy(src, src + width, dst + left);
+        std::fill(tail, tail + right, src[width - 1]);
+        return;
+    }
+    const Pixel constant = constantBorderPixel<Pixel>(border);
+    for (int i = 0; i < left; ++i) {
+        int x = borderIndex(i - left, width, border.mode);
+        dst[i] = x < 0 ? constant : src[x];
+    }
+    std::copy(src, src + width, dst + left);
+    for (int i = 0; i < right; ++i) {
+        int x = borderIndex(width + i, width, border.mode);
+        tail[i] = x < 0 ? constant : src[x];
+    }
+}
+
+// ============ СКАЛЯРНЫЙ ВАРИАНТ ============
+
+void convolveRowScalar(const QRgb *const *rows, int width,
+                       const double *kernel, int kWidth, int kHeight, QRgb *out) {
+    for (int x = 0; x < width; ++x) {
+        double sumR = 0.0, sumG = 0.0, sumB = 0.0;
+
+        for (int ky = 0; ky < kHeight; ++ky) {
+            const QRgb *src = rows[ky] + x;
+            const double *k = kernel + ky * kWidth;
+            for (int kx = 0; kx < kWidth; ++kx) {
+                QRgb pixel = src[kx];
+                double kernelValue = k[kx];
+
+                sumR += qRed(pixel) * kernelValue;
+                sumG += qGreen(pixel) * kernelValue;
+                sumB += qBlue(pixel) * kernelValue;
+            }
+        }
+
+        out[x] = qRgb(roundToByte(sumR), roundToByte(sumG), roundToByte(sumB));
+    }
+}
+
+void convolveRowToDoubleScalar(const QRgb *paddedRow, int width,
+                               const double *kernel, int kWidth, double *out) {
+    for (int x = 0; x < width; ++x) {
+        double sumR = 0.0, sumG = 0.0, sumB = 0.0;
+        const QRgb *src = paddedRow + x;
+        for (int kx = 0; kx < kWidth; ++kx) {
+            QRgb pixel = src[kx];
+            double kernelValue = kernel[kx];
+
+            sumR += qRed(pixel) * kernelValue;
+            sumG += qGreen(pixel) * kernelValue;
+            sumB += qBlue(pixel) * kernelValue;
+        }
+        double *dst = out + 4 * x;
+        dst[0] = sumB;
+        dst[1] = sumG;
+        dst[2] = sumR;
+        dst[3] = 0.0;
+    }
+}
+
+void convolveColumnsFromDoubleScalar(const double *const *rows, int width,
+                                     const double *kernel, int kHeight, QRgb *out) {
+    for (int x = 0; x < width; ++x) {
+        double sumR = 0.0, sumG = 0.0, sumB = 0.0;
+        for (int ky = 0; ky < kHeight; ++ky) {
+            const double *src = rows[ky] + 4 * x;
+            double kernelValue = kernel[ky];
+
+            sumB += src[0] * kernelValue;
+            sumG += src[1] * kernelValue;
+            sumR += src[2] * kernelValue;
+        }
+        out[x] = qRgb(roundToByte(sumR), roundToByte(sumG), roundToByte(sumB));
+    }
+}
+
+#ifdef CONVOLUTION_X86_SIMD
+
+// Пиксель в памяти хранится как B, G, R, A, поэтому pmovzxbd раскладывает
+// его на четыре 32-битные дорожки в том же порядке; после упаковки
+// обратно в байты получается тот же QRgb.
+
+// ============ SSE4.1 ============
+
+// Округление половины от нуля, как std::round: trunc(x) плюс знак x,
+// если дробная часть (вычисляется точно) по модулю не меньше 0.5
+__attribute__((target("sse4.1")))
+inline __m128d roundAwaySse(__m128d value) {
+    const __m128d signMask = _mm_set1_pd(-0.0);
+    __m128d truncated = _mm_round_pd(value, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+    __m128d fraction = _mm_andnot_pd(signMask, _mm_sub_pd(value, truncated));
+    __m128d needStep = _mm_cmpge_pd(fraction, _mm_set1_pd(0.5));
+    __m128d step = _mm_or_pd(_mm_set1_pd(1.0), _mm_and_pd(signMask, value));
+    return _mm_add_pd(truncated, _mm_and_pd(needStep, step));
+}
+
+__attribute__((target("sse4.1")))
+inline QRgb packPixelSse(__m128d sumBG, __m128d sumRA) {
+    const __m128d zero = _mm_setzero_pd();
+    const __m128d maxValue = _mm_set1_pd(255.0);
+    sumBG = _mm_min_pd(_mm_max_pd(roundAwaySse(sumBG), zero), maxValue);
+    sumRA = _mm_min_pd(_mm_max_pd(roundAwaySse(sumRA), zero), maxValue);
+    __m128i channels = _mm_unpacklo_epi64(_mm_cvttpd_epi32(sumBG), _mm_cvttpd_epi32(sumRA));
+    channels = _mm_packus_epi32(channels, channels);
+    channels = _mm_packus_epi16(channels, channels);
+    return static_cast<QRgb>(_mm_cvtsi128_si32(channels)) | 0xff000000u;
+}
+
+__attribute__((target("sse4.1")))
+inline void accumulateSse(QRgb pixel, __m128d kernelValue, __m128d &sumBG, __m128d &sumRA) {
+    __m128i channels = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(static_cast<int>(pixel)));
+    sumBG = _mm_add_pd(sumBG, _mm_mul_pd(_mm_cvtepi32_pd(channels), kernelValue));
+    sumRA = _mm_add_pd(sumRA, _mm_mul_pd(_mm_cvtepi32_pd(_mm_unpackhi_epi64(channels, channels)), kernelValue));
+}
+
+__attribute__((target("sse4.1")))
+void convolveRowSse41(const QRgb *const *rows, int width,
+                      const double *kernel, int kWidth, int kHeight, QRgb *out) {
+    int x = 0;
+    // Два пикселя за итерацию: независимые цепочки сложений
+    for (; x + 2 <= width; x += 2) {
+        __m128d bg0 = _mm_setzero_pd(), ra0 = _mm_setzero_pd();
+        __m128d bg1 = _mm_setzero_pd(), ra1 = _mm_setzero_pd();
+        for (int ky = 0; ky < kHeight; ++ky) {
+            const QRgb *src = rows[ky] + x;
+            const double *k = kernel + ky * kWidth;
+            for (int kx = 0; kx < kWidth; ++kx) {
+                __m128d kernelValue = _mm_set1_pd(k[kx]);
+                accumulateSse(src[kx], kernelValue, bg0, ra0);
+                accumulateSse(src[kx + 1], kernelValue, bg1, ra1);
+            }
+        }
+        out[x] = packPixelSse(bg0, ra0);
+        out[x + 1] = packPixelSse(bg1, ra1);
+    }
+    for (; x < width; ++x) {
+        __m128d bg = _mm_setzero_pd(), ra = _mm_setzero_pd();
+        for (int ky = 0; ky < kHeight; ++ky) {
+            const QRgb *src = rows[ky] + x;
+            const double *k = kernel + ky * kWidth;
+            for (int kx = 0; kx < kWidth; ++kx) {
+                accumulateSse(src[kx], _mm_set1_pd(k[kx]), bg, ra);
+            }
+        }
+        out[x] = packPixelSse(bg, ra);
+    }
+}
+
+__attribute__((target("sse4.1")))
+void convolveRowToDoubleSse41(const QRgb *paddedRow, int width,
+                              const double *kernel, int kWidth, double *out) {
+    for (int x = 0; x < width; ++x) {
+        __m128d bg = _mm_setzero_pd(), ra = _mm_setzero_pd();
+        const QRgb *src = paddedRow + x;
+        for (int kx = 0; kx < kWidth; ++kx) {
+            accumulateSse(src[kx], _mm_set1_pd(kernel[kx]), bg, ra);
+        }
+        // Альфа-дорожка не используется, обнуляем как в скалярном варианте
+        _mm_storeu_pd(out + 4 * x, bg);
+        _mm_storeu_pd(out + 4 * x + 2, _mm_move_sd(_mm_setzero_pd(), ra));
+    }
+}
+
+__attribute__((target("sse4.1")))
+void convolveColumnsFromDoubleSse41(const double *const *rows, int width,
+                                    const double *kernel, int kHeight, QRgb *out) {
+    for (int x = 0; x < width; ++x) {
+        __m128d bg = _mm_setzero_pd(), ra = _mm_setzero_pd();
+        for (int ky = 0; ky < kHeight; ++ky) {
+            const double *src = rows[ky] + 4 * x;
+            __m128d kernelValue = _mm_set1_pd(kernel[ky]);
+            bg = _mm_add_pd(bg, _mm_mul_pd(_mm_loadu_pd(src), kernelValue));
+            ra = _mm_add_pd(ra, _mm_mul_pd(_mm_loadu_pd(src + 2), kernelValue));
+        }
+        out[x] = packPixelSse(bg, ra);
+    }
+}
+
+// ============ AVX2 ============
+
+__attribute__((target("avx2")))
+inline __m256d roundAwayAvx(__m256d value) {
+    const __m256d signMask = _mm256_set1_pd(-0.0);
+    __m256d truncated = _mm256_round_pd(value, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+    __m256d fraction = _mm256_andnot_pd(signMask, _mm256_sub_pd(value, truncated));
+    __m256d needStep = _mm256_cmp_pd(fraction, _mm256_set1_pd(0.5), _CMP_GE_OQ);
+    __m256d step = _mm256_or_pd(_mm256_set1_pd(1.0), _mm256_and_pd(signMask, value));
+    return _mm256_add_pd(truncated, _mm256_and_pd(needStep, step));
+}
+
+__attribute__((target("avx2")))
+inline QRgb packPixelAvx(__m256d sum) {
+    sum = _mm256_min_pd(_mm256_max_pd(roundAwayAvx(sum), _mm256_setzero_pd()), _mm256_set1_pd(255.0));
+    __m128i channels = _mm256_cvttpd_epi32(sum);
+    channels = _mm_packus_epi32(channels, channels);
+    channels = _mm_packus_epi16(channels, channels);
+    return static_cast<QRgb>(_mm_cvtsi128_si32(channels)) | 0xff000000u;
+}
+
+__attribute__((target("avx2")))
+inline __m256d loadPixelAvx(QRgb pixel) {
+    return _mm256_cvtepi32_pd(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(static_cast<int>(pixel))));
+}
+
+__attribute__((target("avx2")))
+void convolveRowAvx2(const QRgb *const *rows, int width,
+                     const double *kernel, int kWidth, int kHeight, QRgb *out) {
+    int x = 0;
+    // Четыре пикселя за итерацию, все каналы пикселя в одном регистре
+    for (; x + 4 <= width; x += 4) {
+        __m256d sum0 = _mm256_setzero_pd(), sum1 = _mm256_setzero_pd();
+        __m256d sum2 = _mm256_setzero_pd(), sum3 = _mm256_setzero_pd();
+        for (int ky = 0; ky < kHeight; ++ky) {
+            const QRgb *src = rows[ky] + x;
+            const double *k = kernel + ky * kWidth;
+            for (int kx = 0; kx < kWidth; ++kx) {
+                __m256d kernelValue = _mm256_set1_pd(k[kx]);
+                sum0 = _mm256_add_pd(sum0, _mm256_mul_pd(loadPixelAvx(src[kx]), kernelValue));
+                sum1 = _mm256_add_pd(sum1, _mm256_mul_pd(loadPixelAvx(src[kx + 1]), kernelValue));
+                sum2 = _mm256_add_pd(sum2, _mm256_mul_pd(loadPixelAvx(src[kx + 2]), kernelValue));
+                sum3 = _mm256_add_pd(sum3, _mm256_mul_pd(loadPixelAvx(src[kx + 3]), kernelValue));
+            }
+        }
+        out[x] = packPixelAvx(sum0);
+        out[x + 1] = packPixelAvx(sum1);
+        out[x + 2] = packPixelAvx(sum2);
+        out[x + 3] = packPixelAvx(sum3);
+    }
+    for (; x < width; ++x) {
+        __m256d sum = _mm256_setzero_pd();
+        for (int ky = 0; ky < kHeight; ++ky) {
+            const QRgb *src = rows[ky] + x;
+            const double *k = kernel + ky * kWidth;
+            for (int kx = 0; kx < kWidth; ++kx) {
+                sum = _mm256_add_pd(sum, _mm256_mul_pd(loadPixelAvx(src[kx]), _mm256_set1_pd(k[kx])));
+            }
+        }
+        out[x] = packPixelAvx(sum);
+    }
+}
+
+__attribute__((target("avx2")))
+void convolveRowToDoubleAvx2(const QRgb *paddedRow, int width,
+                             const double *kernel, int kWidth, double *out) {
+    const __m256d alphaMask = _mm256_castsi256_pd(_mm256_set_epi64x(0, -1, -1, -1));
+    int x = 0;
+    for (; x + 2 <= width; x += 2) {
+        __m256d sum0 = _mm256_setzero_pd(), sum1 = _mm256_setzero_pd();
+        const QRgb *src = paddedRow + x;
+        for (int kx = 0; kx < kWidth; ++kx) {
+            __m256d kernelValue = _mm256_set1_pd(kernel[kx]);
+            sum0 = _mm256_add_pd(sum0, _mm256_mul_pd(loadPixelAvx(src[kx]), kernelValue));
+            sum1 = _mm256_add_pd(sum1, _mm256_mul_pd(loadPixelAvx(src[kx + 1]), kernelValue));
+        }
+        _mm256_storeu_pd(out + 4 * x, _mm256_and_pd(sum0, alphaMask));
+        _mm256_storeu_pd(out + 4 * x + 4, _mm256_and_pd(sum1, alphaMask));
+    }
+    for (; x < width; ++x) {
+        __m256d sum = _mm256_setzero_pd();
+        const QRgb *src = paddedRow + x;
+        for (int kx = 0; kx < kWidth; ++kx) {
+            sum = _mm256_add_pd(sum, _mm256_mul_pd(loadPixelAvx(src[kx]), _mm256_set1_pd(kernel[kx])));
+        }
+        _mm256_storeu_pd(out + 4 * x, _mm256_and_pd(sum, alphaMask));
+    }
+}
+
+__attribute__((target("avx2")))
+void convolveColumnsFromDoubleAvx2(const double *const *rows, int width,
+                                   const double *kernel, int kHeight, QRgb *out) {
+    int x = 0;
+    for (; x + 2 <= width; x += 2) {
+        __m256d sum0 = _mm256_setzero_pd(), sum1 = _mm256_setzero_pd();
+        for (int ky = 0; ky < kHeight; ++ky) {
+            const double *src = rows[ky] + 4 * x;
+            __m256d kernelValue = _mm256_set1_pd(kernel[ky]);
+            sum0 = _mm256_add_pd(sum0, _mm256_mul_pd(_mm256_loadu_pd(src), kernelValue));
+            sum1 = _mm256_add_pd(sum1, _mm256_mul_pd(_mm256_loadu_pd(src + 4), kernelValue));
+        }
+        out[x] = packPixelAvx(sum0);
+        out[x + 1] = packPixelAvx(sum1);
+    }
+    for (; x < width; ++x) {
+        __m256d sum = _mm256_setzero_pd();
+        for (int ky = 0; ky < kHeight; ++ky) {
+            sum = _mm256_add_pd(sum, _mm256_mul_pd(_mm256_loadu_pd(rows[ky] + 4 * x), _mm256_set1_pd(kernel[ky])));
+        }
+        out[x] = packPixelAvx(sum);
+    }
+}
+
+#endif // CONVOLUTION_X86_SIMD
+
+SimdLevel detectSimdLevel() {
+#ifdef CONVOLUTION_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return SimdLevel::AVX2;
+    if (__builtin_cpu_supports("sse4.1")) return SimdLevel::SSE41;
+#endif
+    return SimdLevel::Scalar;
+}
+
+std::atomic<int> g_activeLevel(-1);
+
+// Ядра 3x3, 5x5 и 7x7 - ниже, после вариантов Grayscale8; false - ядро
+// другого размера
+template <typename Pixel>
+bool convolveRowFixedSize(const Pixel *const *rows, int width,
+                          const double *kernel, int kWidth, int kHeight, Pixel *out);
+
+} // namespace
+
+SimdLevel supportedSimdLevel() {
+    static const SimdLevel level = detectSimdLevel();
+    return level;
+}
+
+SimdLevel activeSimdLevel() {
+    int level = g_activeLevel.load(std::memory_order_relaxed);
+    return level < 0 ? supportedSimdLevel() : static_cast<SimdLevel>(level);
+}
+
+void setSimdLevel(SimdLevel level) {
+    level = std::min(level, supportedSimdLevel());
+    g_activeLevel.store(static_cast<int>(level), std::memory_order_relaxed);
+}
+
+const char *simdLevelName(SimdLevel level) {
+    switch (level) {
+    case SimdLevel::AVX2: return "AVX2";
+    case SimdLevel::SSE41: return "SSE4.1";
+    case SimdLevel::Scalar: break;
+    }
+    return "scalar";
+}
+
+void convolveRow(const QRgb *const *rows, int width,
+                 const double *kernel, int kWidth, int kHeight, QRgb *out) {
+    if (convolveRowFixedSize(rows, width, kernel, kWidth, kHeight, out)) return;
+    switch (activeSimdLevel()) {
+#ifdef CONVOLUTION_X86_SIMD
+    case SimdLevel::AVX2:
+        convolveRowAvx2(rows, width, kernel, kWidth, kHeight, out);
+        return;
+    case SimdLevel::SSE41:
+        convolveRowSse41(rows, width, kernel, kWidth, kHeight, out);
+        return;
+#endif
+    default:
+        convolveRowScalar(rows, width, kernel, kWidth, kHeight, out);
+        return;
+    }
+}
+
+void convolveRowToDouble(const QRgb *paddedRow, int width,
+                         const double *kernel, int kWidth, double *out) {
+    switch (activeSimdLevel()) {
+#ifdef CONVOLUTION_X86_SIMD
+    case SimdLevel::AVX2:
+        convolveRowToDoubleAvx2(paddedRow, width, kernel, kWidth, out);
+        return;
+    case SimdLevel::SSE41:
+        convolveRowToDoubleSse41(paddedRow, width, kernel, kWidth, out);
+        return;
+#endif
+    default:
+        convolveRowToDoubleScalar(paddedRow, width, kernel, kWidth, out);
+        return;
+    }
+}
+
+void convolveColumnsFromDouble(const double *const *rows, int width,
+                               const double *kernel, int kHeight, QRgb *out) {
+    switch (activeSimdLevel()) {
+#ifdef CONVOLUTION_X86_SIMD
+    case SimdLevel::AVX2:
+        convolveColumnsFromDoubleAvx2(rows, width, kernel, kHeight, out);
+        return;
+    case SimdLevel::SSE41:
+        convolveColumnsFromDoubleSse41(rows, width, kernel, kHeight, out);
+        return;
+#endif
+    default:
+        convolveColumnsFromDoubleScalar(rows, width, kernel, kHeight, out);
+        return;
+    }
+}
+
+void padRow(const QRgb *src, int width, int left, int right, QRgb *dst, const ImageBorder &border) {
+    padRowWithBorder(src, width, left, right, dst, border);
+}
+
+// ============ GRAYSCALE8 ============
+
+namespace {
+
+// Скалярные варианты для одного канала обрабатывают пиксели [begin, width):
+// векторные варианты досчитывают ими хвост строки
+
+void convolveRowGrayScalar(const uchar *const *rows, int begin, int width,
+                           const double *kernel, int kWidth, int kHeight, uchar *out) {
+    for (int x = begin; x < width; ++x) {
+        double sum = 0.0;
+        for (int ky = 0; ky < kHeight; ++ky) {
+            const uchar *src = rows[ky] + x;
+            const double *k = kernel + ky * kWidth;
+            for (int kx = 0; kx < kWidth; ++kx) {
+                sum += src[kx] * k[kx];
+            }
+        }
+        out[x] = static_cast<uchar>(roundToByte(sum));
+    }
+}
+
+void convolveRowToDoubleGrayScalar(const uchar *paddedRow, int begin, int width,
+                                   const double *kernel, int kWidth, double *out) {
+    for (int x = begin; x < width; ++x) {
+        double sum = 0.0;
+        const uchar *src = paddedRow + x;
+        for (int kx = 0; kx < kWidth; ++kx) {
+            sum += src[kx] * kernel[kx];
+        }
+        out[x] = sum;
+    }
+}
+
+void convolveColumnsFromDoubleGrayScalar(const double *const *rows, int begin, int width,
+                                         const double *kernel, int kHeight, uchar *out) {
+    for (int x = begin; x < width; ++x) {
+        double sum = 0.0;
+        for (int ky = 0; ky < kHeight; ++ky) {
+            sum += rows[ky][x] * kernel[ky];
+        }
+        out[x] = static_cast<uchar>(roundToByte(sum));
+    }
+}
+
+#ifdef CONVOLUTION_X86_SIMD
+
+// В регистре лежат соседние пиксели, а не каналы одного пикселя
+
+__attribute__((target("sse4.1")))
+inline void loadGraySse(const uchar *src, __m128d &low, __m128d &high) {
+    int bytes;
+    std::memcpy(&bytes, src, sizeof(bytes));
+    __m128i values = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(bytes));
+    low = _mm_cvtepi32_pd(values);
+    high = _mm_cvtepi32_pd(_mm_unpackhi_epi64(values, values));
+}
+
+__attribute__((target("sse4.1")))
+inline void storeGraySse(__m128d low, __m128d high, uchar *out) {
+    const __m128d zero = _mm_setzero_pd();
+    const __m128d maxValue = _mm_set1_pd(255.0);
+    low = _mm_min_pd(_mm_max_pd(roundAwaySse(low), zero), maxValue);
+    high = _mm_min_pd(_mm_max_pd(roundAwaySse(high), zero), maxValue);
+    __m128i values = _mm_unpacklo_epi64(_mm_cvttpd_epi32(low), _mm_cvttpd_epi32(high));
+    values = _mm_packus_epi32(values, values);
+    values = _mm_packus_epi16(values, values);
+    int bytes = _mm_cvtsi128_si32(values);
+    std::memcpy(out, &bytes, sizeof(bytes));
+}
+
+__attribute__((target("sse4.1")))
+void convolveRowGraySse41(const uchar *const *rows, int width,
+                          const double *kernel, int kWidth, int kHeight, uchar *out) {
+    int x = 0;
+    for (; x + 4 <= width; x += 4) {
+        __m128d sumLow = _mm_setzero_pd(), sumHigh = _mm_setzero_pd();
+        for (int ky = 0; ky < kHeight; ++ky) {
+            const uchar *src = rows[ky] + x;
+            const double *k = kernel + ky * kWidth;
+            for (int kx = 0; kx < kWidth; ++kx) {
+                __m128d kernelValue = _mm_set1_pd(k[kx]);
+                __m128d low, high;
+                loadGraySse(src + kx, low, high);
+                sumLow = _mm_add_pd(sumLow, _mm_mul_pd(low, kernelValue));
+                sumHigh = _mm_add_pd(sumHigh, _mm_mul_pd(high, kernelValue));
+            }
+        }
+        storeGraySse(sumLow, sumHigh, out + x);
+    }
+    convolveRowGrayScalar(rows, x, width, kernel, kWidth, kHeight, out);
+}
+
+__attribute__((target("sse4.1")))
+void convolveRowToDoubleGraySse41(const uchar *paddedRow, int width,
+                                  const double *kernel, int kWidth, double *out) {
+    int x = 0;
+    for (; x + 4 <= width; x += 4) {
+        __m128d sumLow = _mm_setzero_pd(), sumHigh = _mm_setzero_pd();
+        const uchar *src = paddedRow + x;
+        for (int kx = 0; kx < kWidth; ++kx) {
+            __m128d kernelValue = _mm_set1_pd(kernel[kx]);
+            __m128d low, high;
+            loadGraySse(src + kx, low, high);
+            sumLow = _mm_add_pd(sumLow, _mm_mul_pd(low, kernelValue));
+            sumHigh = _mm_add_pd(sumHigh, _mm_mul_pd(high, kernelValue));
+        }
+        _mm_storeu_pd(out + x, sumLow);
+        _mm_storeu_pd(out + x + 2, sumHigh);
+    }
+    convolveRowToDoubleGrayScalar(paddedRow, x, width, kernel, kWidth, out);
+}
+
+__attribute__((target("sse4.1")))
+void convolveColumnsFromDoubleGraySse41(const double *const *rows, int width,
+                                        const double *kernel, int kHeight, uchar *out) {
+    int x = 0;
+    for (; x + 4 <= width; x += 4) {
+        __m128d sumLow = _mm_setzero_pd(), sumHigh = _mm_setzero_pd();
+        for (int ky = 0; ky < kHeight; ++ky) {
+            const double *src = rows[ky] + x;
+            __m128d kernelValue = _mm_set1_pd(kernel[ky]);
+            sumLow = _mm_add_pd(sumLow, _mm_mul_pd(_mm_loadu_pd(src), kernelValue));
+            sumHigh = _mm_add_pd(sumHigh, _mm_mul_pd(_mm_loadu_pd(src + 2), kernelValue));
+        }
+        storeGraySse(sumLow, sumHigh, out + x);
+    }
+    convolveColumnsFromDoubleGrayScalar(rows, x, width, kernel, kHeight, out);
+}
+
+__attribute__((target("avx2")))
+inline void loadGrayAvx(const uchar *src, __m256d &low, __m256d &high) {
+    __m256i values = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(src)));
+    low = _mm256_cvtepi32_pd(_mm256_castsi256_si128(values));
+    high = _mm256_cvtepi32_pd(_mm256_extracti128_si256(values, 1));
+}
+
+__attribute__((target("avx2")))
+inline void storeGrayAvx(__m256d low, __m256d high, uchar *out) {
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d maxValue = _mm256_set1_pd(255.0);
+    low = _mm256_min_pd(_mm256_max_pd(roundAwayAvx(low), zero), maxValue);
+    high = _mm256_min_pd(_mm256_max_pd(roundAwayAvx(high), zero), maxValue);
+    __m128i values = _mm_packus_epi32(_mm256_cvttpd_epi32(low), _mm256_cvttpd_epi32(high));
+    values = _mm_packus_epi16(values, values);
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(out), values);
+}
+
+__attribute__((target("avx2")))
+void convolveRowGrayAvx2(const uchar *const *rows, int width,
+                         const double *kernel, int kWidth, int kHeight, uchar *out) {
+    int x = 0;
+    // Восемь пикселей за итерацию
+    for (; x + 8 <= width; x += 8) {
+        __m256d sumLow = _mm256_setzero_pd(), sumHigh = _mm256_setzero_pd();
+        for (int ky = 0; ky < kHeight; ++ky) {
+            const uchar *src = rows[ky] + x;
+            const double *k = kernel + ky * kWidth;
+            for (int kx = 0; kx < kWidth; ++kx) {
+                __m256d kernelValue = _mm256_set1_pd(k[kx]);
+                __m256d low, high;
+                loadGrayAvx(src + kx, low, high);
+                sumLow = _mm256_add_pd(sumLow, _mm256_mul_pd(low, kernelValue));
+                sumHigh = _mm256_add_pd(sumHigh, _mm256_mul_pd(high, kernelValue));
+            }
+        }
+        storeGrayAvx(sumLow, sumHigh, out + x);
+    }
+    convolveRowGrayScalar(rows, x, width, kernel, kWidth, kHeight, out);
+}
+
+__attribute__((target("avx2")))
+void convolveRowToDoubleGrayAvx2(const uchar *paddedRow, int width,
+                                 const double *kernel, int kWidth, double *out) {
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        __m256d sumLow = _mm256_setzero_pd(), sumHigh = _mm256_setzero_pd();
+        const uchar *src = paddedRow + x;
+        for (int kx = 0; kx < kWidth; ++kx) {
+            __m256d kernelValue = _mm256_set1_pd(kernel[kx]);
+            __m256d low, high;
+            loadGrayAvx(src + kx, low, high);
+            sumLow = _mm256_add_pd(sumLow, _mm256_mul_pd(low, kernelValue));
+            sumHigh = _mm256_add_pd(sumHigh, _mm256_mul_pd(high, kernelValue));
+        }
+        _mm256_storeu_pd(out + x, sumLow);
+        _mm256_storeu_pd(out + x + 4, sumHigh);
+    }
+    convolveRowToDoubleGrayScalar(paddedRow, x, width, kernel, kWidth, out);
+}
+
+__attribute__((target("avx2")))
+void convolveColumnsFromDoubleGrayAvx2(const double *const *rows, int width,
+                                       const double *kernel, int kHeight, uchar *out) {
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        __m256d sumLow = _mm256_setzero_pd(), sumHigh = _mm256_setzero_pd();
+        for (int ky = 0; ky < kHeight; ++ky) {
+            const double *src = rows[ky] + x;
+            __m256d kernelValue = _mm256_set1_pd(kernel[ky]);
+            sumLow = _mm256_add_pd(sumLow, _mm256_mul_pd(_mm256_loadu_pd(src), kernelValue));
+            sumHigh = _mm256_add_pd(sumHigh, _mm256_mul_pd(_mm256_loadu_pd(src + 4), kernelValue));
+        }
+        storeGrayAvx(sumLow, sumHigh, out + x);
+    }
+    convolveColumnsFromDoubleGrayScalar(rows, x, width, kernel, kHeight, out);
+}
+
+#endif // CONVOLUTION_X86_SIMD
+
+// ============ ЯДРА 3x3, 5x5 И 7x7 ============
+
+// Размер ядра - параметр шаблона: циклы по ядру разворачиваются полностью,
+// коэффициенты готовятся один раз на строку. Порядок сложений тот же, что
+// и в общих вариантах, поэтому результат совпадает с ними бит в бит.
+#if defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 8)
+#define CONVOLUTION_UNROLL _Pragma("GCC unroll 64")
+#else
+#define CONVOLUTION_UNROLL
+#endif
+
+// Ядро с коэффициентами, кратными 0.5 (повышение резкости, Лаплас):
+// weights = kernel * 2^shift - целые, сумма считается без округлений,
+// затем делится на 2^shift с округлением половины от нуля. Произведения
+// и суммы в double для таких ядер тоже точны, поэтому целочисленный
+// проход даёт тот же результат, что и вещественный.
+struct IntegerKernel {
+    int weights[7 * 7];
+    int shift;
+    // Наибольший модуль частичной суммы: 255 * sum |weights|
+    int limit;
+};
+
+// Дальше сумма модулей 49 весов на 255 может не поместиться в int
+const double MAX_INTEGER_WEIGHT = 65536.0;
+// Суммы до этого предела копятся в 16-битных дорожках векторных вариантов
+const int INT16_SUM_LIMIT = 32767;
+
+bool toIntegerKernel(const double *kernel, int count, IntegerKernel &result) {
+    bool allIntegers = true;
+    for (int i = 0; i < count; ++i) {
+        double doubled = kernel[i] * 2.0;
+        // NaN и бесконечности тоже отсекаются здесь
+        if (!(std::fabs(doubled) <= MAX_INTEGER_WEIGHT) || doubled != std::floor(doubled)) return false;
+        if (kernel[i] != std::floor(kernel[i])) allIntegers = false;
+    }
+    result.shift = allIntegers ? 0 : 1;
+    int sumAbs = 0;
+    for (int i = 0; i < count; ++i) {
+        result.weights[i] = static_cast<int>(std::ldexp(kernel[i], result.shift));
+        sumAbs += std::abs(result.weights[i]);
+    }
+    result.limit = 255 * sumAbs;
+    return true;
+}
+
+// sum / 2^shift с округлением половины от нуля, ограниченное 0..255;
+// отрицательные суммы дают 0 при любом округлении
+inline int integerToByte(int sum, int shift) {
+    return std::min(255, (std::max(sum, 0) + shift) >> shift);
+}
+
+// Скалярные варианты обрабатывают пиксели [begin, width) и досчитывают
+// хвосты строк за векторными
+
+template <int K>
+void convolveRowFixedScalar(const QRgb *const *rows, int begin, int width,
+                            const double *kernel, QRgb *out) {
+    for (int x = begin; x < width; ++x) {
+        double sumR = 0.0, sumG = 0.0, sumB = 0.0;
+        CONVOLUTION_UNROLL
+        for (int ky = 0; ky < K; ++ky) {
+            const QRgb *src = rows[ky] + x;
+            CONVOLUTION_UNROLL
+            for (int kx = 0; kx < K; ++kx) {
+                QRgb pixel = src[kx];
+                double kernelValue = kernel[ky * K + kx];
+                sumR += qRed(pixel) * kernelValue;
+                sumG += qGreen(pixel) * kernelValue;
+                sumB += qBlue(pixel) * kernelValue;
+            }
+        }
+        out[x] = qRgb(roundToByte(sumR), roundToByte(sumG), roundToByte(sumB));
+    }
+}
+
+template <int K>
+void convolveRowFixedGrayScalar(const uchar *const *rows, int begin, int width,
+                                const double *kernel, uchar *out) {
+    for (int x = begin; x < width; ++x) {
+        double sum = 0.0;
+        CONVOLUTION_UNROLL
+        for (int ky = 0; ky < K; ++ky) {
+            const uchar *src = rows[ky] + x;
+            CONVOLUTION_UNROLL
+            for (int kx = 0; kx < K; ++kx) {
+                sum += src[kx] * kernel[ky * K + kx];
+            }
+        }
+        out[x] = static_cast<uchar>(roundToByte(sum));
+    }
+}
+
+template <int K>
+void convolveRowIntegerScalar(const QRgb *const *rows, int begin, int width,
+                              const IntegerKernel &kernel, QRgb *out) {
+    for (int x = begin; x < width; ++x) {
+        int sumR = 0, sumG = 0, sumB = 0;
+        CONVOLUTION_UNROLL
+        for (int ky = 0; ky < K; ++ky) {
+            const QRgb *src = rows[ky] + x;
+            CONVOLUTION_UNROLL
+            for (int kx = 0; kx < K; ++kx) {
+                QRgb pixel = src[kx];
+                int weight = kernel.weights[ky * K + kx];
+                sumR += qRed(pixel) * weight;
+                sumG += qGreen(pixel) * weight;
+                sumB += qBlue(pixel) * weight;
+            }
+        }
+        out[x] = qRgb(integerToByte(sumR, kernel.shift), integerToByte(sumG, kernel.shift),
+                      integerToByte(sumB, kernel.shift));
+    }
+}
+
+template <int K>
+void convolveRowIntegerScalar(const uchar *const *rows, int begin, int width,
+                              const IntegerKernel &kernel, uchar *out) {
+    for (int x = begin; x < width; ++x) {
+        int sum = 0;
+        CONVOLUTION_UNROLL
+        for (int ky = 0; ky < K; ++ky) {
+            const uchar *src = rows[ky] + x;
+            CONVOLUTION_UNROLL
+            for (int kx = 0; kx < K; ++kx) {
+                sum += src[kx] * kernel.weights[ky * K + kx];
+            }
+        }
+        out[x] = static_cast<uchar>(integerToByte(sum, kernel.shift));
+    }
+}
+
+#ifdef CONVOLUTION_X86_SIMD
+
+__attribute__((target("sse4.1")))
+inline void loadPixelSse(QRgb pixel, __m128d &bg, __m128d &ra) {
+    __m128i channels = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(static_cast<int>(pixel)));
+    bg = _mm_cvtepi32_pd(channels);
+    ra = _mm_cvtepi32_pd(_mm_unpackhi_epi64(channels, channels));
+}
+
+// Два пикселя за итерацию, как в общем варианте, но каждый из K + 1
+// пикселей окна строки ядра переводится в double один раз, а не K раз
+template <int K>
+__attribute__((target("sse4.1")))
+void convolveRowFixedSse41(const QRgb *const *rows, int width, const double *kernel, QRgb *out) {
+    __m128d taps[K * K];
+    for (int i = 0; i < K * K; ++i) taps[i] = _mm_set1_pd(kernel[i]);
+    int x = 0;
+    for (; x + 2 <= width; x += 2) {
+        __m128d bg0 = _mm_setzero_pd(), ra0 = _mm_setzero_pd();
+        __m128d bg1 = _mm_setzero_pd(), ra1 = _mm_setzero_pd();
+        CONVOLUTION_UNROLL
+        for (int ky = 0; ky < K; ++ky) {
+            const QRgb *src = rows[ky] + x;
+            __m128d bg[K + 1], ra[K + 1];
+            CONVOLUTION_UNROLL
+            for (int i = 0; i < K + 1; ++i) loadPixelSse(src[i], bg[i], ra[i]);
+            CONVOLUTION_UNROLL
+            for (int kx = 0; kx < K; ++kx) {
+                __m128d kernelValue = taps[ky * K + kx];
+                bg0 = _mm_add_pd(bg0, _mm_mul_pd(bg[kx], kernelValue));
+                ra0 = _mm_add_pd(ra0, _mm_mul_pd(ra[kx], kernelValue));
+                bg1 = _mm_add_pd(bg1, _mm_mul_pd(bg[kx + 1], kernelValue));
+                ra1 = _mm_add_pd(ra1, _mm_mul_pd(ra[kx + 1], kernelValue));
+            }
+        }
+        out[x] = packPixelSse(bg0, ra0);
+        out[x + 1] = packPixelSse(bg1, ra1);
+    }
+    convolveRowFixedScalar<K>(rows, x, width, kernel, out);
+}
+
+template <int K>
+__attribute__((target("sse4.1")))
+void convolveRowFixedGraySse41(const uchar *const *rows, int width, const double *kernel, uchar *out) {
+    __m128d taps[K * K];
+    for (int i = 0; i < K * K; ++i) taps[i] = _mm_set1_pd(kernel[i]);
+    int x = 0;
+    for (; x + 4 <= width; x += 4) {
+        __m128d sumLow = _mm_setzero_pd(), sumHigh = _mm_setzero_pd();
+        CONVOLUTION_UNROLL
+        for (int ky = 0; ky < K; ++ky) {
+            const uchar *src = rows[ky] + x;
+            CONVOLUTION_UNROLL
+            for (int kx = 0; kx < K; ++kx) {
+                __m128d low, high;
+                loadGraySse(src + kx, low, high);
+                sumLow = _mm_add_pd(sumLow, _mm_mul_pd(low, taps[ky * K + kx]));
+                sumHigh = _mm_add_pd(sumHigh, _mm_mul_pd(high, taps[ky * K + kx]));
+            }
+        }
+        storeGraySse(sumLow, sumHigh, out + x);
+    }
+    convolveRowFixedGrayScalar<K>(rows, x, width, kernel, out);
+}
+
+// Четыре пикселя за итерацию; K + 3 пикселя окна переводятся в double
+// один раз на строку ядра
+template <int K>
+__attribute__((target("avx2")))
+void convolveRowFixedAvx2(const QRgb *const *rows, int width, const double *kernel, QRgb *out) {
+    __m256d taps[K * K];
+    for (int i = 0; i < K * K; ++i) taps[i] = _mm256_set1_pd(kernel[i]);
+    int x = 0;
+    for (; x + 4 <= width; x += 4) {
+        __m256d sum0 = _mm256_setzero_pd(), sum1 = _mm256_setzero_pd();
+        __m256d sum2 = _mm256_setzero_pd(), sum3 = _mm256_setzero_pd();
+        CONVOLUTION_UNROLL
+        for (int ky = 0; ky < K; ++ky) {
+            const QRgb *src = rows[ky] + x;
+            __m256d pixels[K + 3];
+            CONVOLUTION_UNROLL
+            for (int i = 0; i < K + 3; ++i) pixels[i] = loadPixelAvx(src[i]);
+            CONVOLUTION_UNROLL
+            for (int kx = 0; kx < K; ++kx) {
+                __m256d kernelValue = taps[ky * K + kx];
+                sum0 = _mm256_add_pd(sum0, _mm256_mul_pd(pixels[kx], kernelValue));
+                sum1 = _mm256_add_pd(sum1, _mm256_mul_pd(pixels[kx + 1], kernelValue));
+                sum2 = _mm256_add_pd(sum2, _mm256_mul_pd(pixels[kx + 2], kernelValue));
+                sum3 = _mm256_add_pd(sum3, _mm256_mul_pd(pixels[kx + 3], kernelValue));
+            }
+        }
+        out[x] = packPixelAvx(sum0);
+        out[x + 1] = packPixelAvx(sum1);
+        out[x + 2] = packPixelAvx(sum2);
+        out[x + 3] = packPixelAvx(sum3);
+    }
+    convolveRowFixedScalar<K>(rows, x, width, kernel, out);
+}
+
+template <int K>
+__attribute__((target("avx2")))
+void convolveRowFixedGrayAvx2(const uchar *const *rows, int width, const double *kernel, uchar *out) {
+    __m256d taps[K * K];
+    for (int i = 0; i < K * K; ++i) taps[i] = _mm256_set1_pd(kernel[i]);
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        __m256d sumLow = _mm256_setzero_pd(), sumHigh = _mm256_setzero_pd();
+        CONVOLUTION_UNROLL
+        for (int ky = 0; ky < K; ++ky) {
+            const uchar *src = rows[ky] + x;
+            CONVOLUTION_UNROLL
+            for (int kx = 0; kx < K; ++kx) {
+                __m256d low, high;
+                loadGrayAvx(src + kx, low, high);
+                sumLow = _mm256_add_pd(sumLow, _mm256_mul_pd(low, taps[ky * K + kx]));
+                sumHigh = _mm256_add_pd(sumHigh, _mm256_mul_pd(high, taps[ky * K + kx]));
+            }
+        }
+        storeGrayAvx(sumLow, sumHigh, out + x);
+    }
+    convolveRowFixedGrayScalar<K>(rows, x, width, kernel, out);
+}
+
+// Целочисленные варианты работают с байтами строки одинаково для обоих
+// форматов: 16 байт - четыре пикселя RGB32 или 16 пикселей Grayscale8,
+// каждый канал в своей 16-битной дорожке. Переполнения нет, пока
+// kernel.limit <= INT16_SUM_LIMIT
+
+template <typename Pixel>
+inline bool needsOpaqueAlpha() { return sizeof(Pixel) == sizeof(QRgb); }
+
+__attribute__((target("sse4.1")))
+inline __m128i integerToBytesSse(__m128i sum, int shift) {
+    const __m128i zero = _mm_setzero_si128();
+    sum = _mm_max_epi16(sum, zero);
+    // (sum + 1) >> 1 без переполнения
+    return shift ? _mm_avg_epu16(sum, zero) : sum;
+}
+
+template <int K, typename Pixel>
+__attribute__((target("sse4.1")))
+void convolveRowInt16Sse41(const Pixel *const *rows, int width, const IntegerKernel &kernel, Pixel *out) {
+    const int step = 16 / sizeof(Pixel);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alpha = needsOpaqueAlpha<Pixel>() ? _mm_set1_epi32(static_cast<int>(0xff000000u)) : zero;
+    __m128i taps[K * K];
+    for (int i = 0; i < K * K; ++i) taps[i] = _mm_set1_epi16(static_cast<short>(kernel.weights[i]));
+    int x = 0;
+    for (; x + step <= width; x += step) {
+        __m128i sumLow = zero, sumHigh = zero;
+        CONVOLUTION_UNROLL
+        for (int ky = 0; ky < K; ++ky) {
+            const Pixel *src = rows[ky] + x;
+            CONVOLUTION_UNROLL
+            for (int kx = 0; kx < K; ++kx) {
+                __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + kx));
+                __m128i tap = taps[ky * K + kx];
+                sumLow = _mm_add_epi16(sumLow, _mm_mullo_epi16(_mm_cvtepu8_epi16(bytes), tap));
+                sumHigh = _mm_add_epi16(sumHigh, _mm_mullo_epi16(_mm_unpackhi_epi8(bytes, zero), tap));
+            }
+        }
+        __m128i result = _mm_packus_epi16(integerToBytesSse(sumLow, kernel.shift),
+                                          integerToBytesSse(sumHigh, kernel.shift));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + x), _mm_or_si128(result, alpha));
+    }
+    convolveRowIntegerScalar<K>(rows, x, width, kernel, out);
+}
+
+__attribute__((target("avx2")))
+inline __m256i integerToBytesAvx(__m256i sum, int shift) {
+    const __m256i zero = _mm256_setzero_si256();
+    sum = _mm256_max_epi16(sum, zero);
+    return shift ? _mm256_avg_epu16(sum, zero) : sum;
+}
+
+template <int K, typename Pixel>
+__attribute__((target("avx2")))
+void convolveRowInt16Avx2(const Pixel *const *rows, int width, const IntegerKernel &kernel, Pixel *out) {
+    const int step = 32 / sizeof(Pixel);
+    const __m256i alpha = needsOpaqueAlpha<Pixel>() ? _mm256_set1_epi32(static_cast<int>(0xff000000u))
+                                                    : _mm256_setzero_si256();
+    __m256i taps[K * K];
+    for (int i = 0; i < K * K; ++i) taps[i] = _mm256_set1_epi16(static_cast<short>(kernel.weights[i]));
+    int x = 0;
+    for (; x + step <= width; x += step) {
+        __m256i sumLow = _mm256_setzero_si256(), sumHigh = _mm256_setzero_si256();
+        CONVOLUTION_UNROLL
+        for (int ky = 0; ky < K; ++ky) {
+            const Pixel *src = rows[ky] + x;
+            CONVOLUTION_UNROLL
+            for (int kx = 0; kx < K; ++kx) {
+                const __m128i *bytes = reinterpret_cast<const __m128i *>(src + kx);
+                __m256i tap = taps[ky * K + kx];
+                sumLow = _mm256_add_epi16(sumLow, _mm256_mullo_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128(bytes)), tap));
+                sumHigh = _mm256_add_epi16(sumHigh, _mm256_mullo_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128(bytes + 1)), tap));
+            }
+        }
+        // packus упаковывает 128-битные половины по отдельности: возвращаем
+        // восьмёрки байт на свои места
+        __m256i result = _mm256_packus_epi16(integerToBytesAvx(sumLow, kernel.shift),
+                                             integerToBytesAvx(sumHigh, kernel.shift));
+        result = _mm256_permute4x64_epi64(result, _MM_SHUFFLE(3, 1, 2, 0));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + x), _mm256_or_si256(result, alpha));
+    }
+    convolveRowIntegerScalar<K>(rows, x, width, kernel, out);
+}
+
+#endif // CONVOLUTION_X86_SIMD
+
+// Целочисленный проход, если ядро допускает его на уровне level: векторным
+// нужны 16-битные суммы, скалярный копит в int. Разбор ядра - не больше
+// 49 сравнений на строку
+template <int K, typename Pixel>
+bool convolveRowInteger(const Pixel *const *rows, int width, const double *kernel,
+                        SimdLevel level, Pixel *out) {
+    IntegerKernel integer;
+    if (!toIntegerKernel(kernel, K * K, integer)) return false;
+    switch (level) {
+#ifdef CONVOLUTION_X86_SIMD
+    case SimdLevel::AVX2:
+        if (integer.limit > INT16_SUM_LIMIT) return false;
+        convolveRowInt16Avx2<K>(rows, width, integer, out);
+        return true;
+    case SimdLevel::SSE41:
+        if (integer.limit > INT16_SUM_LIMIT) return false;
+        convolveRowInt16Sse41<K>(rows, width, integer, out);
+        return true;
+#endif
+    default:
+        convolveRowIntegerScalar<K>(rows, 0, width, integer, out);
+        return true;
+    }
+}
+
+template <int K>
+void convolveRowFixed(const QRgb *const *rows, int width, const double *kernel, QRgb *out) {
+    const SimdLevel level = activeSimdLevel();
+    if (convolveRowInteger<K>(rows, width, kernel, level, out)) return;
+    switch (level) {
+#ifdef CONVOLUTION_X86_SIMD
+    case SimdLevel::AVX2:
+        convolveRowFixedAvx2<K>(rows, width, kernel, out);
+        return;
+    case SimdLevel::SSE41:
+        convolveRowFixedSse41<K>(rows, width, kernel, out);
+        return;
+#endif
+    default:
+        convolveRowFixedScalar<K>(rows, 0, width, kernel, out);
+        return;
+    }
+}
+
+template <int K>
+void convolveRowFixed(const uchar *const *rows, int width, const double *kernel, uchar *out) {
+    const SimdLevel level = activeSimdLevel();
+    if (convolveRowInteger<K>(rows, width, kernel, level, out)) return;
+    switch (level) {
+#ifdef CONVOLUTION_X86_SIMD
+    case SimdLevel::AVX2:
+        convolveRowFixedGrayAvx2<K>(rows, width, kernel, out);
+        return;
+    case SimdLevel::SSE41:
+        convolveRowFixedGraySse41<K>(rows, width, kernel, out);
+        return;
+#endif
+    default:
+        convolveRowFixedGrayScalar<K>(rows, 0, width, kernel, out);
+        return;
+    }
+}
+
+template <typename Pixel>
+bool convolveRowFixedSize(const Pixel *const *rows, int width,
+                          const double *kernel, int kWidth, int kHeight, Pixel *out) {
+    if (kWidth != kHeight) return false;
+    switch (kWidth) {
+    case 3: convolveRowFixed<3>(rows, width, kernel, out); return true;
+    case 5: convolveRowFixed<5>(rows, width, kernel, out); return true;
+    case 7: convolveRowFixed<7>(rows, width, kernel, out); return true;
+    default: return false;
+    }
+}
+
+} // namespace
+
+bool prefersIntegerConvolution(const double *kernel, int kWidth, int kHeight) {
+    if (kWidth != kHeight || (kWidth != 3 && kWidth != 5 && kWidth != 7)) return false;
+    IntegerKernel integer;
+    if (!toIntegerKernel(kernel, kWidth * kHeight, integer)) return false;
+    if (activeSimdLevel() == SimdLevel::Scalar) return kWidth == 3;
+    return integer.limit <= INT16_SUM_LIMIT;
+}
+
+void convolveRow(const uchar *const *rows, int width,
+                 const double *kernel, int kWidth, int kHeight, uchar *out) {
+    if (convolveRowFixedSize(rows, width, kernel, kWidth, kHeight, out)) return;
+    switch (activeSimdLevel()) {
+#ifdef CONVOLUTION_X86_SIMD
+    case SimdLevel::AVX2:
+        convolveRowGrayAvx2(rows, width, kernel, kWidth, kHeight, out);
+        return;
+    case SimdLevel::SSE41:
+        convolveRowGraySse41(rows, width, kernel, kWidth, kHeight, out);
+        return;
+#endif
+    default:
+        convolveRowGrayScalar(rows, 0, width, kernel, kWidth, kHeight, out);
+        return;
+    }
+}
+
+void convolveRowToDouble(const uchar *paddedRow, int width,
+                         const double *kernel, int kWidth, double *out) {
+    switch (activeSimdLevel()) {
+#ifdef CONVOLUTION_X86_SIMD
+    case SimdLevel::AVX2:
+        convolveRowToDoubleGrayAvx2(paddedRow, width, kernel, kWidth, out);
+        return;
+    case SimdLevel::SSE41:
+        convolveRowToDoubleGraySse41(paddedRow, width, kernel, kWidth, out);
+        return;
+#endif
+    default:
+        convolveRowToDoubleGrayScalar(paddedRow, 0, width, kernel, kWidth, out);
+        return;
+    }
+}
+
+void convolveColumnsFromDouble(const double *const *rows, int width,
+                               const double *kernel, int kHeight, uchar *out) {
+    switch (activeSimdLevel()) {
+#ifdef CONVOLUTION_X86_SIMD
+    case SimdLevel::AVX2:
+        convolveColumnsFromDoubleGrayAvx2(rows, width, kernel, kHeight, out);
+        return;
+    case SimdLevel::SSE41:
+        convolveColumnsFromDoubleGraySse41(rows, width, kernel, kHeight, out);
+        return;
+#endif
+    default:
+        convolveColumnsFromDoubleGrayScalar(rows, 0, width, kernel, kHeight, out);
+        return;
+    }
+}
+
+void padRow(const uchar *src, int width, int left, int right, uchar *dst, const ImageBorder &border) {
+    padRowWithBorder(src, width, left, right, dst, border);
+}
+
+bool prepareConvolutionImage(QImage &image) {
+    if (image.format() == QImage::Format_Grayscale8) return true;
+    if (image.format() != QImage::Format_RGB32 &&
+        image.format() != QImage::Format_ARGB32) {
+        image = image.convertToFormat(QImage::Format_RGB32);
+    }
+    return false;
+}
@@ -0,0 +1,118 @@
+#ifndef CONVOLUTION_H
+#define CONVOLUTION_H
+
+#include <QImage>
+#include <QRgb>
+#include "filter2d.h"
+
+// Построчное ядро свёртки для 32-битных пикселей (RGB32/ARGB32).
+// Все варианты накапливают каналы в double в том же порядке обхода ядра,
+// что и исходный скалярный цикл, и округляют так же, как std::round,
+// поэтому результат не зависит от выбранного набора инструкций.
+//
+// Ядра 3x3, 5x5 и 7x7 convolveRow считает вариантами с размером, заданным
+// при компиляции. Если их коэффициенты кратны 0.5 (повышение резкости,
+// Лаплас), суммы копятся в целых (int16 в векторных вариантах, int в
+// скалярном): для таких ядер это точный расчёт, результат тот же.
+//
+// Целевая пропускная способность на одно ядро процессора (AVX2, RGB32):
+//   filter2D, ядро 3x3               - не менее 50 МП/с
+//   filter2D, целочисленное ядро 3x3   - не менее 150 МП/с
+//   gaussianBlur, size 9 (два прохода) - не менее 20 МП/с
+// Скалярный вариант примерно в 3-4 раза медленнее.
+
+enum class SimdLevel {
+    Scalar,
+    SSE41,
+    AVX2
+};
+
+// Лучший уровень, поддерживаемый процессором
+SimdLevel supportedSimdLevel();
+
+// Уровень, используемый convolveRow (по умолчанию - лучший поддерживаемый)
+SimdLevel activeSimdLevel();
+void setSimdLevel(SimdLevel level);
+const char *simdLevelName(SimdLevel level);
+
+// Одна выходная строка свёртки. rows[ky] указывает на строку источника,
+// дополненную слева на kWidth / 2 пикселей: выходной пиксель x читает
+// rows[ky][x .. x + kWidth - 1]. Альфа результата всегда 255.
+void convolveRow(const QRgb *const *rows, int width,
+                 const double *kernel, int kWidth, int kHeight, QRgb *out);
+
+// Проходы разделимой свёртки. Промежуточный результат хранится без
+// округления и ограничения: четыре double на пиксель в порядке B, G, R, A.
+// paddedRow дополнена слева на kWidth / 2 пикселей, как и в convolveRow.
+void convolveRowToDouble(const QRgb *paddedRow, int width,
+                         const double *kernel, int kWidth, double *out);
+// rows[ky] - промежуточные строки; результат округляется в QRgb с альфой 255
+void convolveColumnsFromDouble(const double *const *rows, int width,
+                               const double *kernel, int kHeight, QRgb *out);
+
+// Копирует строку, дополняя её left пикселями слева и right справа по border
+void padRow(const QRgb *src, int width, int left, int right, QRgb *dst,
+            const ImageBorder &border = ImageBorder());
+
+// Те же функции для Grayscale8: один канал, в промежуточных строках один
+// double на пиксель. Суммы накапливаются в том же порядке, что и для
+// каждого канала RGB32, поэтому серое изображение в обоих форматах даёт
+// одинаковый результат. Векторные варианты берут в регистр соседние
+// пиксели (четыре для SSE4.1, восемь для AVX2).
+void convolveRow(const uchar *const *rows, int width,
+                 const double *kernel, int kWidth, int kHeight, uchar *out);
+void convolveRowToDouble(const uchar *paddedRow, int width,
+                         const double *kernel, int kWidth, double *out);
+void convolveColumnsFromDouble(const double *const *rows, int width,
+                               const double *kernel, int kHeight, uchar *out);
+void padRow(const uchar *src, int width, int left, int right, uchar *dst,
+            const ImageBorder &border = ImageBorder());
+
+// Номер пикселя источника для позиции position строки или столбца длиной
+// size; внутри [0, size) - сама позиция. -1 - пиксель постоянного цвета
+inline int borderIndex(int position, int size, BorderMode mode) {
+    if (position >= 0 && position < size) return position;
+    switch (mode) {
+    case BorderMode::Replicate:
+        return position < 0 ? 0 : size - 1;
+    case BorderMode::Reflect: {
+        // Период 2 * size: край повторяется
+        int period = 2 * size;
+        int p = ((position % period) + period) % period;
+        return p < size ? p : period - 1 - p;
+    }
+    case BorderMode::Reflect101: {
+        if (size == 1) return 0;
+        int period = 2 * size - 2;
+        int p = ((position % period) + period) % period;
+        return p < size ? p : period - p;
+    }
+    case BorderMode::Wrap:
+        return ((position % size) + size) % size;
+    case BorderMode::Constant:
+        break;
+    }
+    return -1;
+}
+
+// Пиксель постоянного края в формате строки
+template <typename Pixel> Pixel constantBorderPixel(const ImageBorder &border);
+template <> inline QRgb constantBorderPixel<QRgb>(const ImageBorder &border) {
+    return border.value;
+}
+template <> inline uchar constantBorderPixel<uchar>(const ImageBorder &border) {
+    return static_cast<uchar>(qGray(border.value));
+}
+
+// Выгоднее ли целочисленный проход convolveRow двух одномерных проходов
+// для разделимого ядра kWidth x kHeight. Замеры на 2000x1500, один поток:
+// Собель 3x3 в AVX2 - 15 мс против 35 (RGB32), 2.6 против 6.7 (Grayscale8);
+// box 7x7 в AVX2 - 33 против 67. Скалярный int выигрывает только у 3x3,
+// а суммы шире int16 векторные варианты считают в double прямо по 2-D ядру
+bool prefersIntegerConvolution(const double *kernel, int kWidth, int kHeight);
+
+// Приводит изображение к формату построчных ядер: Grayscale8 остаётся как
+// есть (возвращает true), остальные форматы - к RGB32/ARGB32
+bool prepareConvolutionImage(QImage &image);
+
+#endif // CONVOLUTION_H
@@ -0,0 +1,230 @@
+#include "filter2d.h"
+#include "convolution.h"
+#include "parallel.h"
+#include "tracing.h"
+#include <QRgb>
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <utility>
+#include <vector>
+
+// ============ СВЁРТКА ЧЕРЕЗ БПФ ============
+
+namespace {
+
+typedef std::complex<double> Complex;
+
+// Умножение без проверок на NaN/бесконечность из operator* (__muldc3)
+inline Complex multiply(const Complex &a, const Complex &b) {
+    return Complex(a.real() * b.real() - a.imag() * b.imag(),
+                   a.real() * b.imag() + a.imag() * b.real());
+}
+
+// Итеративное БПФ по основанию 2 для фиксированного размера n (степень двойки).
+// Таблицы перестановки и поворотных множителей считаются один раз.
+class Fft {
+public:
+    explicit Fft(int n) : n(n), bitReverse(n), twiddles(n / 2) {
+        int bits = 0;
+        while ((1 << bits) < n) ++bits;
+        for (int i = 0; i < n; ++i) {
+            int reversed = 0;
+            for (int b = 0; b < bits; ++b) {
+                if (i & (1 << b)) reversed |= 1 << (bits - 1 - b);
+            }
+            bitReverse[i] = reversed;
+        }
+        const double pi = std::acos(-1.0);
+        for (int i = 0; i < n / 2; ++i) {
+            twiddles[i] = std::polar(1.0, -2.0 * pi * i / n);
+        }
+    }
+
+    // Обратное преобразование без деления на n
+    void transform(Complex *data, bool inverse) const {
+        for (int i = 0; i < n; ++i) {
+            if (i < bitReverse[i]) std::swap(data[i], data[bitReverse[i]]);
+        }
+        for (int length = 2; length <= n; length <<= 1) {
+            int half = length / 2;
+            int step = n / length;
+            for (int start = 0; start < n; start += length) {
+                for (int k = 0; k < half; ++k) {
+                    Complex w = inverse ? std::conj(twiddles[k * step]) : twiddles[k * step];
+                    Complex even = data[start + k];
+                    Complex odd = multiply(data[start + k + half], w);
+                    data[start + k] = even + odd;
+                    data[start + k + half] = even - odd;
+                }
+            }
+        }
+    }
+
+    // Двумерное преобразование блока n x n: строки, затем столбцы через буфер
+    void transform2D(Complex *data, bool inverse, std::vector<Complex> &column) const {
+        for (int row = 0; row < n; ++row) {
+            transform(data + static_cast<size_t>(row) * n, inverse);
+        }
+        column.resize(n);
+        for (int col = 0; col < n; ++col) {
+            for (int row = 0; row < n; ++row) column[row] = data[static_cast<size_t>(row) * n + col];
+            transform(column.data(), inverse);
+            for (int row = 0; row < n; ++row) data[static_cast<size_t>(row) * n + col] = column[row];
+        }
+    }
+
+private:
+    int n;
+    std::vector<int> bitReverse;
+    std::vector<Complex> twiddles;
+};
+
+inline int roundToByte(double value) {
+    return std::max(0, std::min(255, static_cast<int>(std::round(value))));
+}
+
+int nextPowerOfTwo(int value) {
+    int result = 1;
+    while (result < value) result <<= 1;
+    return result;
+}
+
+struct FftTile {
+    int x, y;
+};
+
+} // namespace
+
+void fftFilter2D(QImage &image, const double *kernel, size_t kWidth, size_t kHeight, const ImageBorder &border) {
+    TRACE_SCOPE("fftFilter2D");
+    if (image.isNull() || kernel == nullptr || kWidth == 0 || kHeight == 0) {
+        return;
+    }
+
+    bool gray = prepareConvolutionImage(image);
+
+    int width = image.width();
+    int height = image.height();
+    int kW = static_cast<int>(kWidth);
+    int kH = static_cast<int>(kHeight);
+    int kCenterX = kW / 2;
+    int kCenterY = kH / 2;
+
+    // Размер блока БПФ: полезная часть блока (n - k + 1) не меньше трёх ядер
+    int kMax = std::max(kW, kH);
+    int n = std::max(64, nextPowerOfTwo(4 * kMax));
+    int tileWidth = n - kW + 1;
+    int tileHeight = n - kH + 1;
+    Fft fft(n);
+
+    // Спектр ядра. Свёртка в filter2D - это корреляция, поэтому далее
+    // используется сопряжённый спектр: IFFT(conj(K) * X)
+    std::vector<Complex> kernelSpectrum(static_cast<size_t>(n) * n);
+    for (int ky = 0; ky < kH; ++ky) {
+        for (int kx = 0; kx < kW; ++kx) {
+            kernelSpectrum[static_cast<size_t>(ky) * n + kx] = Complex(kernel[ky * kW + kx], 0.0);
+        }
+    }
+    {
+        std::vector<Complex> column;
+        fft.transform2D(kernelSpectrum.data(), false, column);
+    }
+    const double scale = 1.0 / (static_cast<double>(n) * n);
+    for (Complex &value : kernelSpectrum) value = std::conj(value) * scale;
+
+    std::vector<FftTile> tiles;
+    for (int ty = 0; ty < height; ty += tileHeight) {
+        for (int tx = 0; tx < width; tx += tileWidth) {
+            tiles.push_back(FftTile{tx, ty});
+        }
+    }
+
+    const QImage source = image;
+    const uchar grayConstant = constantBorderPixel<uchar>(border);
+    QImage result(width, height, image.format());
+    uchar *bits = result.bits();
+    int bytesPerLine = result.bytesPerLine();
+
+    // Overlap-save: блок n x n читается с ореолом (края продолжаются по border),
+    // из циклической корреляции берётся только неискажённая часть.
+    // Каналы R и G упакованы в одно комплексное БПФ (ядро вещественное),
+    // B - во второе, поэтому на блок уходят два прямых и два обратных БПФ.
+    // Для Grayscale8 в одно БПФ упакованы два соседних по горизонтали блока.
+    std::vector<std::pair<int, int>> jobs;
+    for (size_t t = 0; t < tiles.size(); ++t) {
+        bool paired = gray && t + 1 < tiles.size() && tiles[t + 1].y == tiles[t].y;
+        jobs.push_back(std::make_pair(static_cast<int>(t), paired ? static_cast<int>(t + 1) : -1));
+        if (paired) ++t;
+    }
+
+    // Единица диапазона - блок целиком: отмена проверяется перед каждым блоком
+    parallelForRows(static_cast<int>(jobs.size()), [&](int begin, int end) {
+        std::vector<Complex> first(static_cast<size_t>(n) * n);
+        std::vector<Complex> second(gray ? 0 : static_cast<size_t>(n) * n);
+        std::vector<Complex> column;
+
+        for (int job = begin; job < end; ++job) {
+            const FftTile &tile = tiles[jobs[job].first];
+            // Пара для серого: следующий блок той же полосы, если он есть
+            const FftTile *pair = jobs[job].second >= 0 ? &tiles[jobs[job].second] : nullptr;
+
+            for (int i = 0; i < n; ++i) {
+                int pixelY = borderIndex(tile.y - kCenterY + i, height, border.mode);
+                Complex *a = &first[static_cast<size_t>(i) * n];
+                if (gray) {
+                    const uchar *src = pixelY < 0 ? nullptr : source.constScanLine(pixelY);
+                    auto sample = [&](int x) {
+                        int pixelX = borderIndex(x, width, border.mode);
+                        return src && pixelX >= 0 ? src[pixelX] : grayConstant;
+                    };
+                    for (int j = 0; j < n; ++j) {
+                        a[j] = Complex(sample(tile.x - kCenterX + j), pair ? sample(pair->x - kCenterX + j) : 0);
+                    }
+                    continue;
+                }
+                const QRgb *src = pixelY < 0 ? nullptr : reinterpret_cast<const QRgb *>(source.constScanLine(pixelY));
+                Complex *b = &second[static_cast<size_t>(i) * n];
+                for (int j = 0; j < n; ++j) {
+                    int pixelX = borderIndex(tile.x - kCenterX + j, width, border.mode);
+                    QRgb pixel = src && pixelX >= 0 ? src[pixelX] : border.value;
+                    a[j] = Complex(qRed(pixel), qGreen(pixel));
+                    b[j] = Complex(qBlue(pixel), 0.0);
+                }
+            }
+
+            fft.transform2D(first.data(), false, column);
+            for (size_t i = 0; i < kernelSpectrum.size(); ++i) {
+                first[i] = multiply(first[i], kernelSpectrum[i]);
+            }
+            fft.transform2D(first.data(), true, column);
+            if (!gray) {
+                fft.transform2D(second.data(), false, column);
+                for (size_t i = 0; i < kernelSpectrum.size(); ++i) {
+                    second[i] = multiply(second[i], kernelSpectrum[i]);
+                }
+                fft.transform2D(second.data(), true, column);
+            }
+
+            int rows = std::min(tileHeight, height - tile.y);
+            int cols = std::min(tileWidth, width - tile.x);
+            int pairCols = pair ? std::min(tileWidth, width - pair->x) : 0;
+            for (int i = 0; i < rows; ++i) {
+                uchar *line = bits + static_cast<size_t>(tile.y + i) * bytesPerLine;
+                const Complex *a = &first[static_cast<size_t>(i) * n];
+                if (gray) {
+                    for (int j = 0; j < cols; ++j) line[tile.x + j] = roundToByte(a[j].real());
+                    for (int j = 0; j < pairCols; ++j) line[pair->x + j] = roundToByte(a[j].imag());
+                    continue;
+                }
+                QRgb *out = reinterpret_cast<QRgb *>(line) + tile.x;
+                const Complex *b = &second[static_cast<size_t>(i) * n];
+                for (int j = 0; j < cols; ++j) {
+                    out[j] = qRgb(roundToByte(a[j].real()), roundToByte(a[j].imag()), roundToByte(b[j].real()));
+                }
+            }
+        }
+    }, 1, 1);
+
+    image = result;
+}
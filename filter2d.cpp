@@ -1,54 +1,277 @@
 #include "filter2d.h"
+#include "convolution.h"
+#include "parallel.h"
+#include "tracing.h"
 #include <QRgb>
 #include <cmath>
 #include <algorithm>
 #include <vector>
 #include <QtConcurrent/QtConcurrent>
 
-void filter2D(QImage &image, double *kernel, size_t kWidth, size_t kHeight) {
-    if (image.isNull() || kernel == nullptr || kWidth == 0 || kHeight == 0) {
-        return;
+// ============ СВЁРТКА ============
+
+bool separateKernel(const double *kernel, size_t kWidth, size_t kHeight,
+                    std::vector<double> &column, std::vector<double> &row, double tolerance) {
+    if (kernel == nullptr || kWidth == 0 || kHeight == 0) return false;
+
+    // Опорный элемент - максимальный по модулю: столбец и строка через него
+    size_t pivot = 0;
+    for (size_t i = 1; i < kWidth * kHeight; ++i) {
+        if (std::fabs(kernel[i]) > std::fabs(kernel[pivot])) pivot = i;
+    }
+    double pivotValue = kernel[pivot];
+    if (pivotValue == 0.0) return false;
+
+    size_t pivotY = pivot / kWidth;
+    size_t pivotX = pivot % kWidth;
+
+    column.resize(kHeight);
+    row.resize(kWidth);
+    for (size_t ky = 0; ky < kHeight; ++ky) column[ky] = kernel[ky * kWidth + pivotX];
+    for (size_t kx = 0; kx < kWidth; ++kx) row[kx] = kernel[pivotY * kWidth + kx] / pivotValue;
+
+    // Ядро разделимо, если его ранг 1: k[y][x] == column[y] * row[x]
+    double maxError = tolerance * std::fabs(pivotValue);
+    for (size_t ky = 0; ky < kHeight; ++ky) {
+        for (size_t kx = 0; kx < kWidth; ++kx) {
+            if (std::fabs(kernel[ky * kWidth + kx] - column[ky] * row[kx]) > maxError) {
+                return false;
+            }
+        }
     }
+    return true;
+}
 
-    if (image.format() != QImage::Format_RGB32 &&
-        image.format() != QImage::Format_ARGB32) {
-        image = image.convertToFormat(QImage::Format_RGB32);
+namespace {
+
+// Промежуточная строка разделимой свёртки: четыре double на пиксель RGB32
+// и один на пиксель Grayscale8
+template <typename Pixel> struct PixelTraits;
+template <> struct PixelTraits<QRgb> { static const int doublesPerPixel = 4; };
+template <> struct PixelTraits<uchar> { static const int doublesPerPixel = 1; };
+
+// Указатели на строки окна ядра высотой kH для выходной строки y. Внутри
+// изображения строки идут подряд; только у верхнего и нижнего края номера
+// пересчитываются по режиму края, а за краем Constant берётся constantRow
+template <typename Pixel>
+void windowRows(const Pixel *base, size_t stride, int height, int y, int kH, int kCenter,
+                BorderMode mode, const Pixel *constantRow, const Pixel **rows) {
+    int first = y - kCenter;
+    if (first >= 0 && first + kH <= height) {
+        for (int k = 0; k < kH; ++k) rows[k] = base + static_cast<size_t>(first + k) * stride;
+        return;
     }
+    for (int k = 0; k < kH; ++k) {
+        int pixelY = borderIndex(first + k, height, mode);
+        rows[k] = pixelY < 0 ? constantRow : base + static_cast<size_t>(pixelY) * stride;
+    }
+}
+
+// Копия изображения, дополненная со всех сторон на pad пикселей по border
+template <typename Pixel>
+QImage padImage(const QImage &image, int pad, const ImageBorder &border) {
+    int width = image.width();
+    int height = image.height();
+    QImage padded(width + 2 * pad, height + 2 * pad, image.format());
+    uchar *bits = padded.bits();
+    int bytesPerLine = padded.bytesPerLine();
+    const Pixel constant = constantBorderPixel<Pixel>(border);
+
+    parallelForRows(padded.height(), [&](int yBegin, int yEnd) {
+        for (int y = yBegin; y < yEnd; ++y) {
+            Pixel *dst = reinterpret_cast<Pixel *>(bits + static_cast<size_t>(y) * bytesPerLine);
+            int pixelY = borderIndex(y - pad, height, border.mode);
+            if (pixelY < 0) {
+                std::fill(dst, dst + padded.width(), constant);
+            } else {
+                padRow(reinterpret_cast<const Pixel *>(image.constScanLine(pixelY)), width, pad, pad, dst, border);
+            }
+        }
+    });
+    return padded;
+}
+
+template <typename Pixel>
+void sepFilter2DImpl(QImage &image, const double *kernelX, int kW, const double *kernelY, int kH,
+                     const ImageBorder &border) {
+    const int doubles = PixelTraits<Pixel>::doublesPerPixel;
+    const Pixel constant = constantBorderPixel<Pixel>(border);
+    int width = image.width();
+    int height = image.height();
+    int kCenterX = kW / 2;
+    int kCenterY = kH / 2;
+
+    // Результат пишется в отдельное изображение: полосы читают чужие строки
+    const QImage source = image;
+    QImage result(width, height, image.format());
+    uchar *bits = result.bits();
+    int bytesPerLine = result.bytesPerLine();
+
+    // Каждая полоса держит кольцевой буфер из kH горизонтально свёрнутых
+    // строк без округления; строки ореола на границах полос считаются повторно.
+    // Полоса не дробится под отменой (каждый кусок заново считал бы kH - 1
+    // строк ореола), флаг проверяется внутри каждые CANCEL_CHECK_ROWS строк
+    parallelForRows(height, [&](int yBegin, int yEnd) {
+        std::vector<Pixel> paddedRow(width + kW - 1);
+        std::vector<double> ring(static_cast<size_t>(kH) * width * doubles);
+        std::vector<const double *> rows(kH);
+        int nextRow = yBegin - kCenterY;
+
+        for (int y = yBegin; y < yEnd; ++y) {
+            if ((y - yBegin) % CANCEL_CHECK_ROWS == 0 && isCancelled()) return;
+            int lastRow = y + kH - 1 - kCenterY;
+            for (; nextRow <= lastRow; ++nextRow) {
+                int pixelY = borderIndex(nextRow, height, border.mode);
+                if (pixelY < 0) {
+                    std::fill(paddedRow.begin(), paddedRow.end(), constant);
+                } else {
+                    padRow(reinterpret_cast<const Pixel *>(source.constScanLine(pixelY)), width,
+                           kCenterX, kW - 1 - kCenterX, paddedRow.data(), border);
+                }
+                int slot = ((nextRow % kH) + kH) % kH;
+                convolveRowToDouble(paddedRow.data(), width, kernelX, kW,
+                                    &ring[static_cast<size_t>(slot) * width * doubles]);
+            }
+            for (int ky = 0; ky < kH; ++ky) {
+                int virtualRow = y + ky - kCenterY;
+                int slot = ((virtualRow % kH) + kH) % kH;
+                rows[ky] = &ring[static_cast<size_t>(slot) * width * doubles];
+            }
+            Pixel *out = reinterpret_cast<Pixel *>(bits + static_cast<size_t>(y) * bytesPerLine);
+            convolveColumnsFromDouble(rows.data(), width, kernelY, kH, out);
+        }
+    }, MIN_BAND_ROWS, height);
 
+    image = result;
+}
+
+template <typename Pixel>
+void directFilter2D(QImage &image, const double *kernel, int kW, int kH, const ImageBorder &border) {
     int width = image.width();
     int height = image.height();
-    QImage original = image.copy();
+    int kCenterX = kW / 2;
+    int kCenterY = kH / 2;
+
+    // Копия источника с дополненными по горизонтали краями; по вертикали
+    // края обрабатываются выбором указателей на строки, поэтому проход по
+    // ядру не проверяет границ ни для одного пикселя
+    int paddedWidth = width + kW - 1;
+    std::vector<Pixel> padded(static_cast<size_t>(paddedWidth) * height);
+    std::vector<Pixel> constantRow(border.mode == BorderMode::Constant ? paddedWidth : 0,
+                                   constantBorderPixel<Pixel>(border));
+
+    uchar *bits = image.bits();
+    int bytesPerLine = image.bytesPerLine();
+
+    parallelForRows(height, [&](int yBegin, int yEnd) {
+        for (int y = yBegin; y < yEnd; ++y) {
+            padRow(reinterpret_cast<const Pixel *>(bits + static_cast<size_t>(y) * bytesPerLine), width,
+                   kCenterX, kW - 1 - kCenterX, &padded[static_cast<size_t>(y) * paddedWidth], border);
+        }
+    });
+
+    parallelForRows(height, [&](int yBegin, int yEnd) {
+        std::vector<const Pixel *> rows(kH);
+        for (int y = yBegin; y < yEnd; ++y) {
+            windowRows<Pixel>(padded.data(), paddedWidth, height, y, kH, kCenterY, border.mode,
+                              constantRow.data(), rows.data());
+            Pixel *out = reinterpret_cast<Pixel *>(bits + static_cast<size_t>(y) * bytesPerLine);
+            convolveRow(rows.data(), width, kernel, kW, kH, out);
+        }
+    });
+}
 
-    int kCenterX = static_cast<int>(kWidth) / 2;
-    int kCenterY = static_cast<int>(kHeight) / 2;
+template <typename Pixel>
+void exactGaussianBlur(QImage &image, const double *kernel, int kSize, const ImageBorder &border) {
+    int width = image.width();
+    int height = image.height();
+    int kCenter = kSize / 2;
+
+    uchar *bits = image.bits();
+    int bytesPerLine = image.bytesPerLine();
+    std::vector<Pixel> temp(static_cast<size_t>(width) * height);
+
+    // Горизонтальный проход: строка дополняется краями в буфер полосы
+    parallelForRows(height, [&](int yBegin, int yEnd) {
+        std::vector<Pixel> paddedRow(width + kSize - 1);
+        const Pixel *rows[1] = {paddedRow.data()};
+        for (int y = yBegin; y < yEnd; ++y) {
+            padRow(reinterpret_cast<const Pixel *>(bits + static_cast<size_t>(y) * bytesPerLine), width,
+                   kCenter, kSize - 1 - kCenter, paddedRow.data(), border);
+            convolveRow(rows, width, kernel, kSize, 1, &temp[static_cast<size_t>(y) * width]);
+        }
+    });
+
+    // Строка за краем Constant после горизонтального прохода
+    std::vector<Pixel> constantRow;
+    if (border.mode == BorderMode::Constant) {
+        std::vector<Pixel> paddedRow(width + kSize - 1, constantBorderPixel<Pixel>(border));
+        const Pixel *rows[1] = {paddedRow.data()};
+        constantRow.resize(width);
+        convolveRow(rows, width, kernel, kSize, 1, constantRow.data());
+    }
 
-    for (int y = 0; y < height; ++y) {
-        for (int x = 0; x < width; ++x) {
-            double sumR = 0.0, sumG = 0.0, sumB = 0.0;
+    // Вертикальный проход: ядро kSize x 1 по строкам промежуточного буфера
+    parallelForRows(height, [&](int yBegin, int yEnd) {
+        std::vector<const Pixel *> rows(kSize);
+        for (int y = yBegin; y < yEnd; ++y) {
+            windowRows<Pixel>(temp.data(), width, height, y, kSize, kCenter, border.mode,
+                              constantRow.data(), rows.data());
+            Pixel *out = reinterpret_cast<Pixel *>(bits + static_cast<size_t>(y) * bytesPerLine);
+            convolveRow(rows.data(), width, kernel, 1, kSize, out);
+        }
+    });
+}
 
-            for (size_t ky = 0; ky < kHeight; ++ky) {
-                for (size_t kx = 0; kx < kWidth; ++kx) {
-                    int pixelX = x + static_cast<int>(kx) - kCenterX;
-                    int pixelY = y + static_cast<int>(ky) - kCenterY;
+} // namespace
 
-                    pixelX = std::max(0, std::min(width - 1, pixelX));
-                    pixelY = std::max(0, std::min(height - 1, pixelY));
+void sepFilter2D(QImage &image, const double *kernelX, size_t kWidth,
+                 const double *kernelY, size_t kHeight, const ImageBorder &border) {
+    TRACE_SCOPE("sepFilter2D");
+    if (image.isNull() || kernelX == nullptr || kernelY == nullptr || kWidth == 0 || kHeight == 0) {
+        return;
+    }
 
-                    QRgb pixel = original.pixel(pixelX, pixelY);
-                    double kernelValue = kernel[ky * kWidth + kx];
+    int kW = static_cast<int>(kWidth);
+    int kH = static_cast<int>(kHeight);
+    if (prepareConvolutionImage(image)) {
+        sepFilter2DImpl<uchar>(image, kernelX, kW, kernelY, kH, border);
+    } else {
+        sepFilter2DImpl<QRgb>(image, kernelX, kW, kernelY, kH, border);
+    }
+}
 
-                    sumR += qRed(pixel) * kernelValue;
-                    sumG += qGreen(pixel) * kernelValue;
-                    sumB += qBlue(pixel) * kernelValue;
-                }
-            }
+void filter2D(QImage &image, double *kernel, size_t kWidth, size_t kHeight, const ImageBorder &border) {
+    TRACE_SCOPE("filter2D");
+    if (image.isNull() || kernel == nullptr || kWidth == 0 || kHeight == 0) {
+        return;
+    }
 
-            int r = std::max(0, std::min(255, static_cast<int>(std::round(sumR))));
-            int g = std::max(0, std::min(255, static_cast<int>(std::round(sumG))));
-            int b = std::max(0, std::min(255, static_cast<int>(std::round(sumB))));
+    // Ядро ранга 1 раскладывается на два одномерных прохода: O(kW + kH) на пиксель.
+    // Кроме ядер 3x3..7x7 с коэффициентами, кратными 0.5 (Собель, box): их
+    // целочисленный проход быстрее даже по полному ядру
+    std::vector<double> column, row;
+    if (kWidth > 1 && kHeight > 1 &&
+        !prefersIntegerConvolution(kernel, static_cast<int>(kWidth), static_cast<int>(kHeight)) &&
+        separateKernel(kernel, kWidth, kHeight, column, row)) {
+        sepFilter2D(image, row.data(), kWidth, column.data(), kHeight, border);
+        return;
+    }
 
-            image.setPixel(x, y, qRgb(r, g, b));
-        }
+    // Для больших неразделимых ядер БПФ дешевле прямой свёртки. Ядра 1xN и Nx1
+    // уже одномерны: прямой проход стоит O(N) на пиксель, а квадратный блок БПФ
+    // под наибольшую сторону ядра вырос бы до 4N x 4N
+    if (kWidth > 1 && kHeight > 1 && kWidth * kHeight > FFT_MIN_KERNEL_AREA) {
+        fftFilter2D(image, kernel, kWidth, kHeight, border);
+        return;
+    }
+
+    int kW = static_cast<int>(kWidth);
+    int kH = static_cast<int>(kHeight);
+    if (prepareConvolutionImage(image)) {
+        directFilter2D<uchar>(image, kernel, kW, kH, border);
+    } else {
+        directFilter2D<QRgb>(image, kernel, kW, kH, border);
     }
 }
 
@@ -72,63 +295,226 @@ double* createGaussianKernel1D(size_t size, double sigma) {
     return kernel;
 }
 
-void gaussianBlur(QImage &image, size_t size, double sigma) {
+bool usesRecursiveGaussian(size_t size, double sigma, GaussianMode mode) {
+    if (sigma < RECURSIVE_GAUSSIAN_MIN_SIGMA) return false;
+    if (mode == GaussianMode::Fast) return true;
+    if (mode != GaussianMode::Auto || size <= RECURSIVE_GAUSSIAN_MIN_SIZE) return false;
+    const double fullSize = 2.0 * std::ceil(3.0 * sigma) + 1.0;
+    return static_cast<double>(size) >= fullSize;
+}
+
+void gaussianBlur(QImage &image, size_t size, double sigma, GaussianMode mode, const ImageBorder &border) {
+    TRACE_SCOPE("gaussianBlur");
     if (image.isNull() || size == 0) return;
-    if (image.format() != QImage::Format_RGB32 &&
-        image.format() != QImage::Format_ARGB32) {
-        image = image.convertToFormat(QImage::Format_RGB32);
+
+    if (usesRecursiveGaussian(size, sigma, mode)) {
+        recursiveGaussianBlur(image, sigma, border);
+        return;
     }
 
-    int width = image.width();
-    int height = image.height();
     double* kernel = createGaussianKernel1D(size, sigma);
-    int kCenter = static_cast<int>(size) / 2;
+    int kSize = static_cast<int>(size);
+    if (prepareConvolutionImage(image)) {
+        exactGaussianBlur<uchar>(image, kernel, kSize, border);
+    } else {
+        exactGaussianBlur<QRgb>(image, kernel, kSize, border);
+    }
+    delete[] kernel;
+}
 
-    QImage tempImage(image.size(), image.format());
+// ============ РЕКУРСИВНЫЙ ГАУСС (YOUNG - VAN VLIET) ============
+
+namespace {
+
+struct RecursiveGaussianCoefficients {
+    float B;
+    float b1, b2, b3;   // уже поделены на b0
+    float M[3][3];      // начальные условия обратного прохода (Triggs - Sdika)
+};
+
+// I.T. Young, L.J. van Vliet, "Recursive implementation of the Gaussian
+// filter", Signal Processing 44 (1995)
+RecursiveGaussianCoefficients recursiveGaussianCoefficients(double sigma) {
+    double q = (sigma >= 2.5) ? 0.98711 * sigma - 0.96330
+                              : 3.97156 - 4.14554 * std::sqrt(1.0 - 0.26891 * sigma);
+    double q2 = q * q;
+    double q3 = q2 * q;
+
+    double b0 = 1.57825 + 2.44413 * q + 1.4281 * q2 + 0.422205 * q3;
+    double b1 = 2.44413 * q + 2.85619 * q2 + 1.26661 * q3;
+    double b2 = -(1.4281 * q2 + 1.26661 * q3);
+    double b3 = 0.422205 * q3;
+
+    RecursiveGaussianCoefficients c;
+    c.B = static_cast<float>(1.0 - (b1 + b2 + b3) / b0);
+    c.b1 = static_cast<float>(b1 / b0);
+    c.b2 = static_cast<float>(b2 / b0);
+    c.b3 = static_cast<float>(b3 / b0);
+
+    // B. Triggs, M. Sdika, "Boundary conditions for Young - van Vliet recursive
+    // filtering", IEEE TSP 54 (2006): состояние обратного прохода на правом
+    // краю для сигнала, продолжающегося крайним значением. Матрица статьи
+    // выведена для фильтра без усиления B, поэтому домножается на B.
+    double a1 = b1 / b0, a2 = b2 / b0, a3 = b3 / b0;
+    double gain = 1.0 - (a1 + a2 + a3);
+    double norm = gain / ((1.0 + a1 - a2 + a3) * (1.0 - a1 - a2 - a3) * (1.0 + a2 + (a1 - a3) * a3));
+    double M[3][3] = {
+        {-a3 * a1 + 1.0 - a3 * a3 - a2, (a3 + a1) * (a2 + a3 * a1), a3 * (a1 + a3 * a2)},
+        {a1 + a3 * a2, -(a2 - 1.0) * (a2 + a3 * a1), -(a3 * a1 + a3 * a3 + a2 - 1.0) * a3},
+        {a3 * a1 + a2 + a1 * a1 - a2 * a2,
+         a1 * a2 + a3 * a2 * a2 - a1 * a3 * a3 - a3 * a3 * a3 - a3 * a2 + a3,
+         a3 * (a1 + a3 * a2)}
+    };
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            c.M[i][j] = static_cast<float>(M[i][j] * norm);
+        }
+    }
+    return c;
+}
 
-    for (int y = 0; y < height; ++y) {
-        for (int x = 0; x < width; ++x) {
-            double sumR = 0.0, sumG = 0.0, sumB = 0.0;
-            for (size_t k = 0; k < size; ++k) {
-                int pixelX = x + static_cast<int>(k) - kCenter;
-                pixelX = std::max(0, std::min(width - 1, pixelX));
+// Начальные значения обратного прохода y[n-1], y[n], y[n+1] по трём последним
+// выходам прямого прохода и крайнему входному значению edge
+inline void backwardInitialState(const RecursiveGaussianCoefficients &c, float edge,
+                                 float w0, float w1, float w2, float out[3]) {
+    float u0 = w0 - edge, u1 = w1 - edge, u2 = w2 - edge;
+    for (int i = 0; i < 3; ++i) {
+        out[i] = c.M[i][0] * u0 + c.M[i][1] * u1 + c.M[i][2] * u2 + edge;
+    }
+}
 
-                QRgb pixel = image.pixel(pixelX, y);
-                double kernelValue = kernel[k];
+// Прямой и обратный проходы по count элементам с шагом stride.
+// За краем считается, что сигнал продолжается крайним значением.
+void recursiveFilterLine(float *data, int count, int stride, const RecursiveGaussianCoefficients &c) {
+    float edge = data[(count - 1) * stride];
+    float w1 = data[0], w2 = w1, w3 = w1;
+    for (int i = 0; i < count; ++i) {
+        float w = c.B * data[i * stride] + c.b1 * w1 + c.b2 * w2 + c.b3 * w3;
+        data[i * stride] = w;
+        w3 = w2; w2 = w1; w1 = w;
+    }
 
-                sumR += qRed(pixel) * kernelValue;
-                sumG += qGreen(pixel) * kernelValue;
-                sumB += qBlue(pixel) * kernelValue;
-            }
-            int r = std::max(0, std::min(255, static_cast<int>(std::round(sumR))));
-            int g = std::max(0, std::min(255, static_cast<int>(std::round(sumG))));
-            int b = std::max(0, std::min(255, static_cast<int>(std::round(sumB))));
-            tempImage.setPixel(x, y, qRgb(r, g, b));
-        }
+    float state[3];
+    backwardInitialState(c, edge, w1, w2, w3, state);
+    data[(count - 1) * stride] = state[0];
+    float y1 = state[0], y2 = state[1], y3 = state[2];
+    for (int i = count - 2; i >= 0; --i) {
+        float y = c.B * data[i * stride] + c.b1 * y1 + c.b2 * y2 + c.b3 * y3;
+        data[i * stride] = y;
+        y3 = y2; y2 = y1; y1 = y;
     }
+}
 
-    for (int y = 0; y < height; ++y) {
-        for (int x = 0; x < width; ++x) {
-            double sumR = 0.0, sumG = 0.0, sumB = 0.0;
-            for (size_t k = 0; k < size; ++k) {
-                int pixelY = y + static_cast<int>(k) - kCenter;
-                pixelY = std::max(0, std::min(height - 1, pixelY));
+inline uchar floatToByte(float value) {
+    return static_cast<uchar>(std::max(0, std::min(255, static_cast<int>(std::lround(value)))));
+}
+
+} // namespace
 
-                QRgb pixel = tempImage.pixel(x, pixelY);
-                double kernelValue = kernel[k];
+void recursiveGaussianBlur(QImage &image, double sigma, const ImageBorder &border) {
+    TRACE_SCOPE("recursiveGaussianBlur");
+    if (image.isNull() || sigma < RECURSIVE_GAUSSIAN_MIN_SIGMA) return;
+    bool gray = prepareConvolutionImage(image);
 
-                sumR += qRed(pixel) * kernelValue;
-                sumG += qGreen(pixel) * kernelValue;
-                sumB += qBlue(pixel) * kernelValue;
+    int width = image.width();
+    int height = image.height();
+
+    // Начальные условия Триггса - Сдики соответствуют повторению края;
+    // другие режимы - через дополненную копию
+    if (border.mode != BorderMode::Replicate) {
+        int pad = static_cast<int>(std::ceil(RECURSIVE_GAUSSIAN_BORDER_SIGMAS * sigma));
+        QImage padded = gray ? padImage<uchar>(image, pad, border) : padImage<QRgb>(image, pad, border);
+        recursiveGaussianBlur(padded, sigma);
+        image = padded.copy(pad, pad, width, height);
+        return;
+    }
+    RecursiveGaussianCoefficients c = recursiveGaussianCoefficients(sigma);
+
+    uchar *bits = image.bits();
+    int bytesPerLine = image.bytesPerLine();
+
+    // Промежуточный буфер: три канала float на пиксель (R, G, B),
+    // для Grayscale8 - один
+    int channels = gray ? 1 : 3;
+    int rowLength = width * channels;
+    std::vector<float> buffer(static_cast<size_t>(rowLength) * height);
+
+    // Горизонтальный проход: строки независимы
+    parallelForRows(height, [&](int yBegin, int yEnd) {
+        for (int y = yBegin; y < yEnd; ++y) {
+            const uchar *line = bits + static_cast<size_t>(y) * bytesPerLine;
+            float *row = &buffer[static_cast<size_t>(y) * rowLength];
+            if (gray) {
+                std::copy(line, line + width, row);
+            } else {
+                const QRgb *src = reinterpret_cast<const QRgb *>(line);
+                for (int x = 0; x < width; ++x) {
+                    row[3 * x] = qRed(src[x]);
+                    row[3 * x + 1] = qGreen(src[x]);
+                    row[3 * x + 2] = qBlue(src[x]);
+                }
+            }
+            for (int channel = 0; channel < channels; ++channel) {
+                recursiveFilterLine(row + channel, width, channels, c);
+            }
+        }
+    });
+
+    // Вертикальный проход: независимы столбцы, но обход идёт строками,
+    // чтобы внутренний цикл шёл по памяти подряд
+    parallelForRows(rowLength, [&](int begin, int end) {
+        int span = end - begin;
+        std::vector<float> w1(span), w2(span), w3(span);
+
+        const float *lastInput = &buffer[static_cast<size_t>(height - 1) * rowLength + begin];
+        std::vector<float> edge(lastInput, lastInput + span);
+
+        const float *first = &buffer[begin];
+        std::copy(first, first + span, w1.begin());
+        w2 = w1;
+        w3 = w1;
+        for (int y = 0; y < height; ++y) {
+            float *row = &buffer[static_cast<size_t>(y) * rowLength + begin];
+            for (int i = 0; i < span; ++i) {
+                float w = c.B * row[i] + c.b1 * w1[i] + c.b2 * w2[i] + c.b3 * w3[i];
+                row[i] = w;
+                w3[i] = w2[i]; w2[i] = w1[i]; w1[i] = w;
             }
-            int r = std::max(0, std::min(255, static_cast<int>(std::round(sumR))));
-            int g = std::max(0, std::min(255, static_cast<int>(std::round(sumG))));
-            int b = std::max(0, std::min(255, static_cast<int>(std::round(sumB))));
-            image.setPixel(x, y, qRgb(r, g, b));
         }
-    }
 
-    delete[] kernel;
+        float *last = &buffer[static_cast<size_t>(height - 1) * rowLength + begin];
+        for (int i = 0; i < span; ++i) {
+            float state[3];
+            backwardInitialState(c, edge[i], w1[i], w2[i], w3[i], state);
+            last[i] = state[0];
+            w1[i] = state[0];
+            w2[i] = state[1];
+            w3[i] = state[2];
+        }
+        for (int y = height - 2; y >= 0; --y) {
+            float *row = &buffer[static_cast<size_t>(y) * rowLength + begin];
+            for (int i = 0; i < span; ++i) {
+                float w = c.B * row[i] + c.b1 * w1[i] + c.b2 * w2[i] + c.b3 * w3[i];
+                row[i] = w;
+                w3[i] = w2[i]; w2[i] = w1[i]; w1[i] = w;
+            }
+        }
+    });
+
+    parallelForRows(height, [&](int yBegin, int yEnd) {
+        for (int y = yBegin; y < yEnd; ++y) {
+            const float *row = &buffer[static_cast<size_t>(y) * rowLength];
+            uchar *line = bits + static_cast<size_t>(y) * bytesPerLine;
+            if (gray) {
+                for (int x = 0; x < width; ++x) line[x] = floatToByte(row[x]);
+                continue;
+            }
+            QRgb *out = reinterpret_cast<QRgb *>(line);
+            for (int x = 0; x < width; ++x) {
+                out[x] = qRgb(floatToByte(row[3 * x]), floatToByte(row[3 * x + 1]), floatToByte(row[3 * x + 2]));
+            }
+        }
+    });
 }
 
 double* createGaussianKernel(size_t size, double sigma) {
@@ -170,87 +556,29 @@ double* createSobelXKernel() {
     return kernel;
 }
 
-// ============ ПРЕОБРАЗОВАНИЕ В ГРАДАЦИИ СЕРОГО ============
-
-void toGrayscaleBT601(QImage &image) {
-    if (image.isNull()) return;
-
-    for (int y = 0; y < image.height(); ++y) {
-        for (int x = 0; x < image.width(); ++x) {
-            QRgb pixel = image.pixel(x, y);
-            int r = qRed(pixel);
-            int g = qGreen(pixel);
-            int b = qBlue(pixel);
-
-            // BT.601: Y = 0.299*R + 0.587*G + 0.114*B
-            int gray = static_cast<int>(0.299 * r + 0.587 * g + 0.114 * b);
-            gray = std::max(0, std::min(255, gray));
-
-            image.setPixel(x, y, qRgb(gray, gray, gray));
-        }
-    }
-}
-
-void toGrayscaleBT709(QImage &image) {
-    if (image.isNull()) return;
-
-    for (int y = 0; y < image.height(); ++y) {
-        for (int x = 0; x < image.width(); ++x) {
-            QRgb pixel = image.pixel(x, y);
-            int r = qRed(pixel);
-            int g = qGreen(pixel);
-            int b = qBlue(pixel);
-
-            // BT.709: Y = 0.2126*R + 0.7152*G + 0.0722*B
-            int gray = static_cast<int>(0.2126 * r + 0.7152 * g + 0.0722 * b);
-            gray = std::max(0, std::min(255, gray));
-
-            image.setPixel(x, y, qRgb(gray, gray, gray));
-        }
-    }
-}
-
-bool isGrayscale(const QImage &image) {
-    for (int y = 0; y < image.height(); ++y) {
-        for (int x = 0; x < image.width(); ++x) {
-            QRgb pixel = image.pixel(x, y);
-            if (qRed(pixel) != qGreen(pixel) || qGreen(pixel) != qBlue(pixel)) {
-                return false;
-            }
-        }
-    }
-    return true;
-}
+// ============ АЛГОРИТМ ОЦУ (OTSU) ============
 
-void convertToGrayscale(QImage &image) {
-    if (!isGrayscale(image)) {
-        toGrayscaleBT709(image); // По умолчанию используем BT.709
-    }
+int calculateOtsuThreshold(const QImage &image) {
+    return calculateOtsuThreshold(computeGrayHistogram(image));
 }
 
-// ============ АЛГОРИТМ ОЦУ (OTSU) ============
+namespace {
 
-int calculateOtsuThreshold(const QImage &image) {
-    // Гистограмма
-    int histogram[256] = {0};
-    int totalPixels = image.width() * image.height();
-
-    for (int y = 0; y < image.height(); ++y) {
-        for (int x = 0; x < image.width(); ++x) {
-            int gray = qGray(image.pixel(x, y));
-            histogram[gray]++;
-        }
+int twoClassOtsuThreshold(const GrayHistogram &histogram) {
+    double totalPixels = 0;
+    for (int i = 0; i < 256; ++i) {
+        totalPixels += histogram[i];
     }
 
     // Метод Оцу - максимизация межклассовой дисперсии
     double sum = 0;
     for (int i = 0; i < 256; ++i) {
-        sum += i * histogram[i];
+        sum += static_cast<double>(i) * histogram[i];
     }
 
     double sumB = 0;
-    int wB = 0;
-    int wF = 0;
+    double wB = 0;
+    double wF = 0;
     double maxVariance = 0;
     int threshold = 0;
 
@@ -261,7 +589,7 @@ int calculateOtsuThreshold(const QImage &image) {
         wF = totalPixels - wB;
         if (wF == 0) break;
 
-        sumB += t * histogram[t];
+        sumB += static_cast<double>(t) * histogram[t];
 
         double mB = sumB / wB;
         double mF = (sum - sumB) / wF;
@@ -277,44 +605,144 @@ int calculateOtsuThreshold(const QImage &image) {
     return threshold;
 }
 
+// Кумулятивные моменты гистограммы: P[i] - число пикселей уровней [0, i),
+// S[i] - сумма их яркостей. Вклад класса [a, b] в межклассовую дисперсию
+// (с точностью до константы) равен S^2 / P и считается за O(1)
+class OtsuMomentTable {
+public:
+    explicit OtsuMomentTable(const GrayHistogram &histogram) {
+        P[0] = 0.0;
+        S[0] = 0.0;
+        for (int i = 0; i < 256; ++i) {
+            P[i + 1] = P[i] + histogram[i];
+            S[i + 1] = S[i] + static_cast<double>(i) * histogram[i];
+        }
+    }
+
+    double classScore(int first, int last) const {
+        double weight = P[last + 1] - P[first];
+        if (weight <= 0.0) return 0.0;
+        double moment = S[last + 1] - S[first];
+        return moment * moment / weight;
+    }
+
+private:
+    double P[257];
+    double S[257];
+};
+
+} // namespace
+
+int calculateOtsuThreshold(const GrayHistogram &histogram) {
+    return calculateOtsuThresholds(histogram, 1).front();
+}
+
+std::vector<int> calculateOtsuThresholds(const GrayHistogram &histogram, int thresholdCount) {
+    TRACE_SCOPE("otsu threshold search");
+    thresholdCount = std::max(1, std::min(MULTI_OTSU_MAX_THRESHOLDS, thresholdCount));
+    if (thresholdCount == 1) {
+        return std::vector<int>(1, twoClassOtsuThreshold(histogram));
+    }
+
+    // Динамическое программирование по моментам вместо перебора всех
+    // сочетаний порогов: best[k][t] - лучшая сумма для уровней [0, t],
+    // разбитых на k + 1 класс, choice[k][t] - верхняя граница класса k - 1.
+    // Стоимость O(thresholdCount * 256^2)
+    OtsuMomentTable moments(histogram);
+    const int classes = thresholdCount + 1;
+    std::vector<std::vector<double>> best(classes, std::vector<double>(256, -1.0));
+    std::vector<std::vector<int>> choice(classes, std::vector<int>(256, 0));
+
+    for (int t = 0; t < 256; ++t) {
+        best[0][t] = moments.classScore(0, t);
+    }
+    for (int k = 1; k < classes; ++k) {
+        for (int t = k; t < 256; ++t) {
+            for (int s = k - 1; s < t; ++s) {
+                double score = best[k - 1][s] + moments.classScore(s + 1, t);
+                if (score > best[k][t]) {
+                    best[k][t] = score;
+                    choice[k][t] = s;
+                }
+            }
+        }
+    }
+
+    // Пороги - верхние границы классов, как у calculateOtsuThreshold
+    std::vector<int> thresholds(thresholdCount);
+    int last = 255;
+    for (int k = classes - 1; k > 0; --k) {
+        last = choice[k][last];
+        thresholds[k - 1] = last;
+    }
+    return thresholds;
+}
+
 void binarizeOtsu(QImage &image, std::function<void(int)> progressCallback) {
+    TRACE_SCOPE("binarizeOtsu");
     convertToGrayscale(image);
 
     if (progressCallback) progressCallback(30);
 
-    int threshold = calculateOtsuThreshold(image);
+    int threshold = calculateOtsuThreshold(computeGrayHistogram(image));
 
     if (progressCallback) progressCallback(70);
 
-    for (int y = 0; y < image.height(); ++y) {
-        for (int x = 0; x < image.width(); ++x) {
-            int gray = qGray(image.pixel(x, y));
-            int binary = (gray >= threshold) ? 255 : 0;
-            image.setPixel(x, y, qRgb(binary, binary, binary));
-        }
-    }
+    applyThreshold(image, threshold);
 
     if (progressCallback) progressCallback(100);
 }
 
+// ============ МНОГОУРОВНЕВЫЙ ОЦУ (MULTI-OTSU) ============
+
+void binarizeMultiOtsu(QImage &image, int thresholdCount, std::function<void(int)> progressCallback) {
+    TRACE_SCOPE("binarizeMultiOtsu");
+    convertToGrayscale(image);
+
+    if (progressCallback) progressCallback(30);
+
+    std::vector<int> thresholds = calculateOtsuThresholds(computeGrayHistogram(image), thresholdCount);
+
+    if (progressCallback) progressCallback(70);
+
+    uchar lut[256];
+    buildPosterizeLut(thresholds, lut);
+    applyGrayLut(image, lut);
+
+    if (progressCallback) progressCallback(100);
+}
+
+void buildPosterizeLut(const std::vector<int> &thresholds, uchar lut[256]) {
+    // Класс пикселя - число порогов, которые он достигает (gray >= t, как
+    // в binarizeOtsu); классы равномерно распределены по диапазону 0..255
+    int classes = static_cast<int>(thresholds.size()) + 1;
+    for (int gray = 0; gray < 256; ++gray) {
+        int level = 0;
+        for (int threshold : thresholds) {
+            if (gray >= threshold) level++;
+        }
+        lut[gray] = classes > 1 ? static_cast<uchar>((255 * level + (classes - 1) / 2) / (classes - 1)) : 0;
+    }
+}
+
 // ============ АЛГОРИТМ ХУАНГА (HUANG) ============
 
 int calculateHuangThreshold(const QImage &image) {
-    // Гистограмма
-    int histogram[256] = {0};
-    int totalPixels = image.width() * image.height();
-
-    for (int y = 0; y < image.height(); ++y) {
-        for (int x = 0; x < image.width(); ++x) {
-            int gray = qGray(image.pixel(x, y));
-            histogram[gray]++;
-        }
+    return calculateHuangThreshold(computeGrayHistogram(image));
+}
+
+int calculateHuangThreshold(const GrayHistogram &histogram) {
+    TRACE_SCOPE("huang threshold search");
+    double totalPixels = 0;
+    for (int i = 0; i < 256; ++i) {
+        totalPixels += histogram[i];
     }
+    if (totalPixels == 0) return 0;
 
     // Нормализованная гистограмма (вероятности)
     double prob[256];
     for (int i = 0; i < 256; ++i) {
-        prob[i] = static_cast<double>(histogram[i]) / totalPixels;
+        prob[i] = histogram[i] / totalPixels;
     }
 
     // Метод Хуанга - использует энтропию
@@ -356,142 +784,81 @@ int calculateHuangThreshold(const QImage &image) {
 }
 
 void binarizeHuang(QImage &image, std::function<void(int)> progressCallback) {
+    TRACE_SCOPE("binarizeHuang");
     convertToGrayscale(image);
 
     if (progressCallback) progressCallback(30);
 
-    int threshold = calculateHuangThreshold(image);
+    int threshold = calculateHuangThreshold(computeGrayHistogram(image));
 
     if (progressCallback) progressCallback(70);
 
-    for (int y = 0; y < image.height(); ++y) {
-        for (int x = 0; x < image.width(); ++x) {
-            int gray = qGray(image.pixel(x, y));
-            int binary = (gray >= threshold) ? 255 : 0;
-            image.setPixel(x, y, qRgb(binary, binary, binary));
-        }
-    }
+    applyThreshold(image, threshold);
 
     if (progressCallback) progressCallback(100);
 }
 
-// ============ АЛГОРИТМ НИБЛАКА (NIBLACK) ============
-
-void binarizeNiblack(QImage &image, int windowSize, double k, std::function<void(int)> progressCallback) {
-    convertToGrayscale(image);
-
-    int width = image.width();
-    int height = image.height();
-    int halfWindow = windowSize / 2;
-
-    QImage result = image.copy();
-
-    for (int y = 0; y < height; ++y) {
-        if (progressCallback && y % 10 == 0) {
-            progressCallback(static_cast<int>(100.0 * y / height));
-        }
-
-        for (int x = 0; x < width; ++x) {
-            // Вычисляем среднее и стандартное отклонение в окне
-            double sum = 0;
-            double sumSq = 0;
-            int count = 0;
-
-            for (int wy = std::max(0, y - halfWindow); wy <= std::min(height - 1, y + halfWindow); ++wy) {
-                for (int wx = std::max(0, x - halfWindow); wx <= std::min(width - 1, x + halfWindow); ++wx) {
-                    int gray = qGray(image.pixel(wx, wy));
-                    sum += gray;
-                    sumSq += gray * gray;
-                    count++;
-                }
-            }
-
-            double mean = sum / count;
-            double variance = (sumSq / count) - (mean * mean);
-            double stdDev = std::sqrt(std::max(0.0, variance));
-
-            // Порог Ниблака: T = mean + k * stdDev
-            double threshold = mean + k * stdDev;
-
-            int gray = qGray(image.pixel(x, y));
-            int binary = (gray >= threshold) ? 255 : 0;
-            result.setPixel(x, y, qRgb(binary, binary, binary));
-        }
-    }
-
-    image = result;
-    if (progressCallback) progressCallback(100);
-}
-
 // ============ АЛГОРИТМ ISODATA ============
 
-void binarizeISODATA(QImage &image, std::function<void(int)> progressCallback) {
-    convertToGrayscale(image);
-
-    if (progressCallback) progressCallback(10);
-
+int calculateISODATAThreshold(const GrayHistogram &histogram) {
+    TRACE_SCOPE("isodata threshold search");
     // Начальный порог - среднее значение яркости
-    long long sum = 0;
-    int totalPixels = image.width() * image.height();
-
-    for (int y = 0; y < image.height(); ++y) {
-        for (int x = 0; x < image.width(); ++x) {
-            sum += qGray(image.pixel(x, y));
-        }
+    quint64 sum = 0;
+    quint64 totalPixels = 0;
+    for (int i = 0; i < 256; ++i) {
+        sum += i * histogram[i];
+        totalPixels += histogram[i];
     }
+    if (totalPixels == 0) return 0;
 
-    int threshold = sum / totalPixels;
+    int threshold = static_cast<int>(sum / totalPixels);
     int oldThreshold;
     int iteration = 0;
     const int maxIterations = 100;
 
-    if (progressCallback) progressCallback(30);
-
-    // Итеративное уточнение порога
+    // Итеративное уточнение порога; суммы классов берутся из гистограммы
     do {
         oldThreshold = threshold;
 
-        // Вычисляем средние значения для двух классов
-        long long sum0 = 0, sum1 = 0;
-        int count0 = 0, count1 = 0;
-
-        for (int y = 0; y < image.height(); ++y) {
-            for (int x = 0; x < image.width(); ++x) {
-                int gray = qGray(image.pixel(x, y));
-                if (gray < threshold) {
-                    sum0 += gray;
-                    count0++;
-                } else {
-                    sum1 += gray;
-                    count1++;
-                }
+        quint64 sum0 = 0, sum1 = 0;
+        quint64 count0 = 0, count1 = 0;
+        for (int i = 0; i < 256; ++i) {
+            if (i < threshold) {
+                sum0 += i * histogram[i];
+                count0 += histogram[i];
+            } else {
+                sum1 += i * histogram[i];
+                count1 += histogram[i];
             }
         }
 
-        int mean0 = (count0 > 0) ? sum0 / count0 : 0;
-        int mean1 = (count1 > 0) ? sum1 / count1 : 255;
+        int mean0 = (count0 > 0) ? static_cast<int>(sum0 / count0) : 0;
+        int mean1 = (count1 > 0) ? static_cast<int>(sum1 / count1) : 255;
 
         // Новый порог - среднее между средними классов
         threshold = (mean0 + mean1) / 2;
 
         iteration++;
+    } while (std::abs(threshold - oldThreshold) > 1 && iteration < maxIterations);
 
-        if (progressCallback && iteration % 5 == 0) {
-            progressCallback(30 + static_cast<int>(40.0 * iteration / maxIterations));
-        }
+    return threshold;
+}
 
-    } while (std::abs(threshold - oldThreshold) > 1 && iteration < maxIterations);
+void binarizeISODATA(QImage &image, std::function<void(int)> progressCallback) {
+    TRACE_SCOPE("binarizeISODATA");
+    convertToGrayscale(image);
+
+    if (progressCallback) progressCallback(10);
+
+    GrayHistogram histogram = computeGrayHistogram(image);
+
+    if (progressCallback) progressCallback(50);
+
+    int threshold = calculateISODATAThreshold(histogram);
 
     if (progressCallback) progressCallback(80);
 
-    // Применяем найденный порог
-    for (int y = 0; y < image.height(); ++y) {
-        for (int x = 0; x < image.width(); ++x) {
-            int gray = qGray(image.pixel(x, y));
-            int binary = (gray >= threshold) ? 255 : 0;
-            image.setPixel(x, y, qRgb(binary, binary, binary));
-        }
-    }
+    applyThreshold(image, threshold);
 
     if (progressCallback) progressCallback(100);
 }
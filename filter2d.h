@@ -2,12 +2,80 @@
 #define FILTER2D_H
 
 #include <QImage>
+#include <array>
 #include <cstddef>
 #include <functional>
+#include <vector>
 
-// Основные фильтры
-void filter2D(QImage &image, double *kernel, size_t kWidth, size_t kHeight);
-void gaussianBlur(QImage &image, size_t size, double sigma);
+// Число потоков для свёртки (0 - все ядра, 1 - последовательный проход)
+void setFilterThreadCount(int threads);
+int filterThreadCount();
+
+// Режим размытия по Гауссу: точная свёртка с ядром size или рекурсивный
+// IIR-фильтр Янга - ван Влита, стоимость которого не зависит от sigma
+enum class GaussianMode {
+    Auto,   // IIR при size > RECURSIVE_GAUSSIAN_MIN_SIZE, если ядро покрывает ±3 sigma
+    Exact,
+    Fast
+};
+
+const size_t RECURSIVE_GAUSSIAN_MIN_SIZE = 31;
+const double RECURSIVE_GAUSSIAN_MIN_SIGMA = 0.5;
+// Дополнение краёв для рекурсивного Гаусса: дальше отклик меньше 1e-4
+const double RECURSIVE_GAUSSIAN_BORDER_SIGMAS = 4.0;
+
+// Неразделимые двумерные ядра площадью больше этой сворачиваются через БПФ
+// (на одном ядре БПФ обгоняет прямую свёртку начиная примерно с 15x15)
+const size_t FFT_MIN_KERNEL_AREA = 225;
+
+// Динамический диапазон стандартного отклонения R в формуле Сауволы
+const double SAUVOLA_DYNAMIC_RANGE = 128.0;
+
+// Весовые коэффициенты яркости
+enum class LumaStandard {
+    BT601,
+    BT709,
+    BT2020
+};
+
+// Наибольшее число порогов многоуровневого Оцу
+const int MULTI_OTSU_MAX_THRESHOLDS = 4;
+
+// Продолжение изображения за краем при свёртке; для строки abcd слева:
+enum class BorderMode {
+    Replicate,   // aaa|abcd - повторение крайнего пикселя
+    Reflect,     // cba|abcd - зеркало с повтором края (symmetric в MATLAB, reflect в SciPy)
+    Reflect101,  // dcb|abcd - зеркало без повтора края (BORDER_DEFAULT в OpenCV)
+    Wrap,        // bcd|abcd - периодическое продолжение
+    Constant     // vvv|abcd - постоянный цвет v
+};
+
+// Режим края и цвет для BorderMode::Constant (для Grayscale8 - qGray(value))
+struct ImageBorder {
+    BorderMode mode;
+    QRgb value;
+    ImageBorder(BorderMode mode = BorderMode::Replicate, QRgb value = qRgb(0, 0, 0))
+        : mode(mode), value(value) {}
+};
+
+// Основные фильтры. Все свёртки продолжают изображение за краем по border
+void filter2D(QImage &image, double *kernel, size_t kWidth, size_t kHeight,
+              const ImageBorder &border = ImageBorder());
+void gaussianBlur(QImage &image, size_t size, double sigma, GaussianMode mode = GaussianMode::Auto,
+                  const ImageBorder &border = ImageBorder());
+// Выполнит ли gaussianBlur рекурсивный фильтр. Auto выбирает IIR, только когда
+// усечение ядра size пренебрежимо (size >= 2*ceil(3*sigma)+1): иначе IIR дал бы
+// заметно более широкое размытие, чем точная свёртка с тем же size
+bool usesRecursiveGaussian(size_t size, double sigma, GaussianMode mode);
+// Рекурсивный Гаусс без усечения ядра (sigma >= RECURSIVE_GAUSSIAN_MIN_SIGMA).
+// Кроме Replicate, края дополняются на RECURSIVE_GAUSSIAN_BORDER_SIGMAS сигм
+void recursiveGaussianBlur(QImage &image, double sigma, const ImageBorder &border = ImageBorder());
+// Разделимая свёртка: строка kernelX (kWidth), затем столбец kernelY (kHeight)
+void sepFilter2D(QImage &image, const double *kernelX, size_t kWidth,
+                 const double *kernelY, size_t kHeight, const ImageBorder &border = ImageBorder());
+// Свёртка через БПФ блоками с перекрытием (overlap-save), результат как у filter2D
+void fftFilter2D(QImage &image, const double *kernel, size_t kWidth, size_t kHeight,
+                 const ImageBorder &border = ImageBorder());
 
 // Создание ядер
 double* createGaussianKernel1D(size_t size, double sigma);
@@ -15,20 +83,78 @@ double* createGaussianKernel(size_t size, double sigma);
 double* createSharpenKernel();
 double* createSobelXKernel();
 
-// Преобразование в градации серого
+// Преобразование в градации серого (результат - Grayscale8).
+// Полутоновые результаты всех функций ниже тоже Grayscale8, и все функции
+// этого файла принимают Grayscale8 напрямую, без перевода в RGB32.
+// Яркость считается в фиксированной точке и расходится с прежней формулой
+// static_cast<int>(kr*R + kg*G + kb*B) в double на ±1 уровень у 0.18% троек
+// RGB для BT.601 и у 0.11% для BT.709 (в обе стороны). Прежняя формула сама
+// непоследовательна: ошибки double переводили серые 1, 2, 4, ... в 0, 1, 3;
+// фиксированная точка оставляет серый пиксель неизменным
 void toGrayscaleBT601(QImage &image);
 void toGrayscaleBT709(QImage &image);
+void toGrayscaleBT2020(QImage &image);
+// Один проход по строкам; возвращает true, если изображение уже было серым
+bool toGrayscale(QImage &image, LumaStandard standard);
 
 // Бинаризация
 void binarizeOtsu(QImage &image, std::function<void(int)> progressCallback = nullptr);
 void binarizeHuang(QImage &image, std::function<void(int)> progressCallback = nullptr);
 void binarizeNiblack(QImage &image, int windowSize, double k, std::function<void(int)> progressCallback = nullptr);
+void binarizeSauvola(QImage &image, int windowSize, double k, std::function<void(int)> progressCallback = nullptr);
+void binarizeWolf(QImage &image, int windowSize, double k, std::function<void(int)> progressCallback = nullptr);
+// Пиксели окна с контрастом (max - min) ниже contrastThreshold относятся
+// к фону или объекту целиком
+void binarizeBernsen(QImage &image, int windowSize, int contrastThreshold,
+                     std::function<void(int)> progressCallback = nullptr);
 void binarizeISODATA(QImage &image, std::function<void(int)> progressCallback = nullptr);
+// Постеризация на thresholdCount + 1 уровней серого по порогам многоуровневого Оцу
+void binarizeMultiOtsu(QImage &image, int thresholdCount, std::function<void(int)> progressCallback = nullptr);
+
+// Глобальные величины метода Вольфа - Жолиона: минимальная яркость M и
+// наибольшее стандартное отклонение R по окнам. Позволяют считать порог
+// по частям изображения (потоковая обработка полосами)
+struct WolfStatistics {
+    int minGray = 255;
+    double maxStdDev = 0.0;
+};
+// Статистика по строкам [rowBegin, rowEnd); окна берут и строки вне диапазона.
+// Изображение переводится в Grayscale8
+WolfStatistics calculateWolfStatistics(QImage &image, int windowSize, int rowBegin, int rowEnd);
+void mergeWolfStatistics(WolfStatistics &total, const WolfStatistics &part);
+void binarizeWolf(QImage &image, int windowSize, double k, const WolfStatistics &statistics,
+                  std::function<void(int)> progressCallback = nullptr);
 
 // Вспомогательные функции
 bool isGrayscale(const QImage &image);
-void convertToGrayscale(QImage &image);
+// Переводит в Grayscale8 по BT.709; true, если изображение уже было серым
+bool convertToGrayscale(QImage &image);
 int calculateOtsuThreshold(const QImage &image);
 int calculateHuangThreshold(const QImage &image);
 
+// Гистограмма яркости qGray: один параллельный проход по изображению.
+// Глобальные пороги считаются только по ней, за O(256)
+typedef std::array<quint64, 256> GrayHistogram;
+GrayHistogram computeGrayHistogram(const QImage &image);
+// toGrayscale с гистограммой результата, собранной в том же проходе
+bool toGrayscale(QImage &image, LumaStandard standard, GrayHistogram &histogram);
+int calculateOtsuThreshold(const GrayHistogram &histogram);
+int calculateHuangThreshold(const GrayHistogram &histogram);
+int calculateISODATAThreshold(const GrayHistogram &histogram);
+// Пороги многоуровневого Оцу по возрастанию (1..MULTI_OTSU_MAX_THRESHOLDS);
+// при одном пороге совпадает с calculateOtsuThreshold
+std::vector<int> calculateOtsuThresholds(const GrayHistogram &histogram, int thresholdCount);
+// Заменяет каждый пиксель серым уровнем lut[qGray(pixel)] за один проход;
+// результат всегда Grayscale8
+void applyGrayLut(QImage &image, const uchar lut[256]);
+// Бинаризация по порогу: gray >= threshold - белый
+void applyThreshold(QImage &image, int threshold);
+// Таблица постеризации: уровень - число достигнутых порогов (gray >= t),
+// уровни равномерно распределены по 0..255. Один порог - бинаризация
+void buildPosterizeLut(const std::vector<int> &thresholds, uchar lut[256]);
+// Раскладывает ядро ранга 1 на столбец и строку (kernel ~ column * row^T)
+bool separateKernel(const double *kernel, size_t kWidth, size_t kHeight,
+                    std::vector<double> &column, std::vector<double> &row,
+                    double tolerance = 1e-6);
+
 #endif // FILTER2D_H
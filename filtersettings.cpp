@@ -0,0 +1,197 @@
+#include "filtersettings.h"
+#include "filter2d.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+struct FilterName {
+    FilterType type;
+    const char *name;
+};
+
+const FilterName FILTER_NAMES[] = {
+    {FilterType::GaussianBlur,    "gaussian"},
+    {FilterType::Sharpen,         "sharpen"},
+    {FilterType::Sobel,           "sobel"},
+    {FilterType::GrayscaleBT601,  "bt601"},
+    {FilterType::GrayscaleBT709,  "bt709"},
+    {FilterType::BinarizeOtsu,    "otsu"},
+    {FilterType::BinarizeHuang,   "huang"},
+    {FilterType::BinarizeNiblack, "niblack"},
+    {FilterType::BinarizeISODATA, "isodata"},
+    {FilterType::BinarizeSauvola, "sauvola"},
+    {FilterType::BinarizeWolf,    "wolf"},
+    {FilterType::BinarizeBernsen, "bernsen"},
+    {FilterType::BinarizeMultiOtsu, "multiotsu"},
+    {FilterType::GrayscaleBT2020, "bt2020"},
+};
+
+struct BorderName {
+    BorderMode mode;
+    const char *name;
+};
+
+const BorderName BORDER_NAMES[] = {
+    {BorderMode::Replicate,  "replicate"},
+    {BorderMode::Reflect,    "reflect"},
+    {BorderMode::Reflect101, "reflect101"},
+    {BorderMode::Wrap,       "wrap"},
+    {BorderMode::Constant,   "constant"},
+};
+
+void applyKernel3x3(QImage &image, const std::vector<double> &values, double *(*createDefault)(),
+                    BorderMode border) {
+    double *kernel = createDefault();
+    if (values.size() == 9) {
+        std::copy(values.begin(), values.end(), kernel);
+    }
+    filter2D(image, kernel, 3, 3, border);
+    delete[] kernel;
+}
+
+int scaledOddSize(int size, double scale, int minimum) {
+    int scaled = static_cast<int>(std::lround(size * scale));
+    return std::max(minimum, scaled) | 1;
+}
+
+} // namespace
+
+QString filterTypeName(FilterType type) {
+    for (const FilterName &entry : FILTER_NAMES) {
+        if (entry.type == type) return QString::fromLatin1(entry.name);
+    }
+    return QString();
+}
+
+bool filterTypeFromName(const QString &name, FilterType *type) {
+    for (const FilterName &entry : FILTER_NAMES) {
+        if (name.compare(QLatin1String(entry.name), Qt::CaseInsensitive) == 0) {
+            *type = entry.type;
+            return true;
+        }
+    }
+    return false;
+}
+
+QStringList filterTypeNames() {
+    QStringList names;
+    for (const FilterName &entry : FILTER_NAMES) {
+        names << QString::fromLatin1(entry.name);
+    }
+    return names;
+}
+
+QString borderModeName(BorderMode mode) {
+    for (const BorderName &entry : BORDER_NAMES) {
+        if (entry.mode == mode) return QString::fromLatin1(entry.name);
+    }
+    return QString();
+}
+
+bool borderModeFromName(const QString &name, BorderMode *mode) {
+    for (const BorderName &entry : BORDER_NAMES) {
+        if (name.compare(QLatin1String(entry.name), Qt::CaseInsensitive) == 0) {
+            *mode = entry.mode;
+            return true;
+        }
+    }
+    return false;
+}
+
+QStringList borderModeNames() {
+    QStringList names;
+    for (const BorderName &entry : BORDER_NAMES) {
+        names << QString::fromLatin1(entry.name);
+    }
+    return names;
+}
+
+bool isConvolutionFilter(FilterType type) {
+    return type == FilterType::GaussianBlur || type == FilterType::Sharpen || type == FilterType::Sobel;
+}
+
+bool isGlobalThreshold(FilterType type) {
+    return type == FilterType::BinarizeOtsu || type == FilterType::BinarizeHuang ||
+           type == FilterType::BinarizeISODATA || type == FilterType::BinarizeMultiOtsu;
+}
+
+void globalThresholdLut(const FilterSettings &settings, const GrayHistogram &histogram, uchar lut[256]) {
+    std::vector<int> thresholds;
+    switch (settings.type) {
+    case FilterType::BinarizeHuang:
+        thresholds.push_back(calculateHuangThreshold(histogram));
+        break;
+    case FilterType::BinarizeISODATA:
+        thresholds.push_back(calculateISODATAThreshold(histogram));
+        break;
+    case FilterType::BinarizeMultiOtsu:
+        thresholds = calculateOtsuThresholds(histogram, settings.otsuThresholds);
+        break;
+    default:
+        thresholds.push_back(calculateOtsuThreshold(histogram));
+        break;
+    }
+    buildPosterizeLut(thresholds, lut);
+}
+
+FilterSettings scaleFilterSettings(const FilterSettings &settings, double scale) {
+    FilterSettings scaled = settings;
+    if (scale >= 1.0) return scaled;
+
+    scaled.gaussSize = scaledOddSize(settings.gaussSize, scale, 1);
+    scaled.gaussSigma = std::max(0.1, settings.gaussSigma * scale);
+    scaled.niblackWindow = scaledOddSize(settings.niblackWindow, scale, 3);
+    scaled.sauvolaWindow = scaledOddSize(settings.sauvolaWindow, scale, 3);
+    scaled.wolfWindow = scaledOddSize(settings.wolfWindow, scale, 3);
+    scaled.bernsenWindow = scaledOddSize(settings.bernsenWindow, scale, 3);
+    return scaled;
+}
+
+void applyFilterSettings(QImage &image, const FilterSettings &settings,
+                         std::function<void(int)> progressCallback) {
+    switch (settings.type) {
+    case FilterType::GaussianBlur:
+        gaussianBlur(image, settings.gaussSize, settings.gaussSigma, settings.gaussMode, settings.border);
+        break;
+    case FilterType::Sharpen:
+        applyKernel3x3(image, settings.kernel, createSharpenKernel, settings.border);
+        break;
+    case FilterType::Sobel:
+        applyKernel3x3(image, settings.kernel, createSobelXKernel, settings.border);
+        break;
+    case FilterType::GrayscaleBT601:
+        toGrayscaleBT601(image);
+        break;
+    case FilterType::GrayscaleBT709:
+        toGrayscaleBT709(image);
+        break;
+    case FilterType::GrayscaleBT2020:
+        toGrayscaleBT2020(image);
+        break;
+    case FilterType::BinarizeOtsu:
+        binarizeOtsu(image, progressCallback);
+        break;
+    case FilterType::BinarizeHuang:
+        binarizeHuang(image, progressCallback);
+        break;
+    case FilterType::BinarizeNiblack:
+        binarizeNiblack(image, settings.niblackWindow, settings.niblackK, progressCallback);
+        break;
+    case FilterType::BinarizeISODATA:
+        binarizeISODATA(image, progressCallback);
+        break;
+    case FilterType::BinarizeSauvola:
+        binarizeSauvola(image, settings.sauvolaWindow, settings.sauvolaK, progressCallback);
+        break;
+    case FilterType::BinarizeWolf:
+        binarizeWolf(image, settings.wolfWindow, settings.wolfK, progressCallback);
+        break;
+    case FilterType::BinarizeBernsen:
+        binarizeBernsen(image, settings.bernsenWindow, settings.bernsenContrast, progressCallback);
+        break;
+    case FilterType::BinarizeMultiOtsu:
+        binarizeMultiOtsu(image, settings.otsuThresholds, progressCallback);
+        break;
+    }
+}
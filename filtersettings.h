@@ -0,0 +1,90 @@
+#ifndef FILTERSETTINGS_H
+#define FILTERSETTINGS_H
+
+#include <QImage>
+#include <QString>
+#include <QStringList>
+#include <functional>
+#include <vector>
+#include "filter2d.h"
+
+// Значения сохраняются в данных пунктов filterCombo; новые добавляются в конец
+enum class FilterType {
+    GaussianBlur,
+    Sharpen,
+    Sobel,
+    GrayscaleBT601,
+    GrayscaleBT709,
+    BinarizeOtsu,
+    BinarizeHuang,
+    BinarizeNiblack,
+    BinarizeISODATA,
+    BinarizeSauvola,
+    BinarizeWolf,
+    BinarizeBernsen,
+    BinarizeMultiOtsu,
+    GrayscaleBT2020
+};
+
+// Параметры одной операции; общие для GUI и пакетного режима
+struct FilterSettings {
+    FilterType type = FilterType::GaussianBlur;
+
+    // Продолжение за краем для Гаусса, резкости и Собеля (Constant - чёрный)
+    BorderMode border = BorderMode::Replicate;
+
+    // Гаусс
+    int gaussSize = 9;
+    double gaussSigma = 4.0;
+    GaussianMode gaussMode = GaussianMode::Auto;
+
+    // Ядро 3x3 для резкости и выделения краёв (пустое - ядро по умолчанию)
+    std::vector<double> kernel;
+
+    // Ниблак
+    int niblackWindow = 15;
+    double niblackK = -0.2;
+
+    // Саувола
+    int sauvolaWindow = 15;
+    double sauvolaK = 0.5;
+
+    // Вольф - Жолион
+    int wolfWindow = 15;
+    double wolfK = 0.5;
+
+    // Бернсен
+    int bernsenWindow = 31;
+    int bernsenContrast = 15;
+
+    // Многоуровневый Оцу
+    int otsuThresholds = 2;
+};
+
+// Короткие имена для командной строки: gaussian, sharpen, sobel, ...
+QString filterTypeName(FilterType type);
+bool filterTypeFromName(const QString &name, FilterType *type);
+QStringList filterTypeNames();
+// Режимы края: replicate, reflect, reflect101, wrap, constant
+QString borderModeName(BorderMode mode);
+bool borderModeFromName(const QString &name, BorderMode *mode);
+QStringList borderModeNames();
+
+// Гаусс, резкость и Собель: результат у краёв зависит от settings.border
+bool isConvolutionFilter(FilterType type);
+
+// Оцу, Хуанг, ISODATA и многоуровневый Оцу: порог по гистограмме всего изображения
+bool isGlobalThreshold(FilterType type);
+// Таблица яркостей глобального порога для заданной гистограммы
+void globalThresholdLut(const FilterSettings &settings, const GrayHistogram &histogram, uchar lut[256]);
+
+// Параметры для копии изображения, уменьшенной в scale раз (предпросмотр):
+// ядро Гаусса, сигма и окна локальных методов уменьшаются пропорционально,
+// размеры остаются нечётными; ядра 3x3 и пороги не меняются
+FilterSettings scaleFilterSettings(const FilterSettings &settings, double scale);
+
+// Применяет операцию к изображению (вызывается из рабочих потоков)
+void applyFilterSettings(QImage &image, const FilterSettings &settings,
+                         std::function<void(int)> progressCallback = nullptr);
+
+#endif // FILTERSETTINGS_H
@@ -0,0 +1,282 @@
+#include "filter2d.h"
+#include "convolution.h"
+#include "parallel.h"
+#include "tracing.h"
+#include <QMutex>
+#include <QMutexLocker>
+#include <QRgb>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define GRAYSCALE_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+// ============ ПРЕОБРАЗОВАНИЕ В ГРАДАЦИИ СЕРОГО ============
+//
+// Яркость считается в фиксированной точке: веса умножены на 2^15 и
+// округлены так, что их сумма ровно 32768, Y = (wr*R + wg*G + wb*B) >> 15.
+// Поэтому серый пиксель (R = G = B) переходит сам в себя, и проверка
+// "изображение уже серое" делается в том же проходе, что и пересчёт.
+// Прежнее усечение суммы в double не повторяется ни одним целочисленным
+// набором весов и сдвигом (ошибки double сдвигают даже серые: 1 -> 0, 2 -> 1):
+// 30653 из 2^24 троек для BT.601 и 18972 для BT.709 отличаются на ±1.
+// Скалярный вариант берёт произведения из трёх таблиц по 256 значений,
+// векторные - pmaddwd по пикселям BGRA.
+//
+// Целевая пропускная способность на одно ядро (ARGB32 на входе):
+// не менее 1 ГБ/с (250 МП/с) с AVX2.
+
+namespace {
+
+const int LUMA_SHIFT = 15;
+
+struct LumaWeights {
+    int r, g, b;
+};
+
+LumaWeights lumaWeights(LumaStandard standard) {
+    // Вес зелёного - остаток до единицы: 0.587, 0.7152, 0.6780.
+    // Ему же достаётся ошибка округления как самому большому весу
+    double kr, kb;
+    switch (standard) {
+    case LumaStandard::BT601:  kr = 0.299;  kb = 0.114;  break;
+    case LumaStandard::BT2020: kr = 0.2627; kb = 0.0593; break;
+    case LumaStandard::BT709:
+    default:                   kr = 0.2126; kb = 0.0722; break;
+    }
+    LumaWeights weights;
+    weights.r = static_cast<int>(std::lround(kr * (1 << LUMA_SHIFT)));
+    weights.b = static_cast<int>(std::lround(kb * (1 << LUMA_SHIFT)));
+    weights.g = (1 << LUMA_SHIFT) - weights.r - weights.b;
+    return weights;
+}
+
+// Таблицы произведений для скалярного прохода
+struct LumaTables {
+    explicit LumaTables(const LumaWeights &weights) {
+        for (int v = 0; v < 256; ++v) {
+            r[v] = weights.r * v;
+            g[v] = weights.g * v;
+            b[v] = weights.b * v;
+        }
+    }
+    int r[256], g[256], b[256];
+};
+
+// Возвращает true, если все пиксели строки серые
+bool lumaRowScalar(const QRgb *src, int begin, int width, const LumaTables &tables, uchar *dst) {
+    QRgb difference = 0;
+    for (int x = begin; x < width; ++x) {
+        QRgb pixel = src[x];
+        difference |= (pixel ^ (pixel >> 8)) & 0xffffu;
+        dst[x] = static_cast<uchar>((tables.r[qRed(pixel)] + tables.g[qGreen(pixel)] +
+                                     tables.b[qBlue(pixel)]) >> LUMA_SHIFT);
+    }
+    return difference == 0;
+}
+
+#ifdef GRAYSCALE_X86_SIMD
+
+// Пиксель в памяти - B, G, R, A. После расширения до 16 бит pmaddwd с
+// весами (wb, wg, wr, 0) даёт пары wb*B + wg*G и wr*R, которые
+// складываются горизонтально; суммы не превышают 255 * 32768 < 2^31.
+
+__attribute__((target("sse4.1")))
+bool lumaRowSse41(const QRgb *src, int width, const LumaTables &tables,
+                  const LumaWeights &weights, uchar *dst) {
+    const __m128i coefficients = _mm_setr_epi16(
+        static_cast<short>(weights.b), static_cast<short>(weights.g), static_cast<short>(weights.r), 0,
+        static_cast<short>(weights.b), static_cast<short>(weights.g), static_cast<short>(weights.r), 0);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i colorMask = _mm_set1_epi32(0xffff);
+    __m128i difference = _mm_setzero_si128();
+
+    int x = 0;
+    // Восемь пикселей за итерацию
+    for (; x + 8 <= width; x += 8) {
+        __m128i first = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + x));
+        __m128i second = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + x + 4));
+
+        difference = _mm_or_si128(difference,
+            _mm_and_si128(_mm_xor_si128(first, _mm_srli_epi32(first, 8)), colorMask));
+        difference = _mm_or_si128(difference,
+            _mm_and_si128(_mm_xor_si128(second, _mm_srli_epi32(second, 8)), colorMask));
+
+        __m128i sum0 = _mm_hadd_epi32(_mm_madd_epi16(_mm_unpacklo_epi8(first, zero), coefficients),
+                                      _mm_madd_epi16(_mm_unpackhi_epi8(first, zero), coefficients));
+        __m128i sum1 = _mm_hadd_epi32(_mm_madd_epi16(_mm_unpacklo_epi8(second, zero), coefficients),
+                                      _mm_madd_epi16(_mm_unpackhi_epi8(second, zero), coefficients));
+        __m128i luma = _mm_packus_epi32(_mm_srli_epi32(sum0, LUMA_SHIFT), _mm_srli_epi32(sum1, LUMA_SHIFT));
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(dst + x), _mm_packus_epi16(luma, luma));
+    }
+
+    bool gray = _mm_testz_si128(difference, difference) != 0;
+    return lumaRowScalar(src, x, width, tables, dst) && gray;
+}
+
+__attribute__((target("avx2")))
+bool lumaRowAvx2(const QRgb *src, int width, const LumaTables &tables,
+                 const LumaWeights &weights, uchar *dst) {
+    const __m256i coefficients = _mm256_setr_epi16(
+        static_cast<short>(weights.b), static_cast<short>(weights.g), static_cast<short>(weights.r), 0,
+        static_cast<short>(weights.b), static_cast<short>(weights.g), static_cast<short>(weights.r), 0,
+        static_cast<short>(weights.b), static_cast<short>(weights.g), static_cast<short>(weights.r), 0,
+        static_cast<short>(weights.b), static_cast<short>(weights.g), static_cast<short>(weights.r), 0);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i colorMask = _mm256_set1_epi32(0xffff);
+    // Перестановка после упаковок, которые работают по 128-битным половинам
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    __m256i difference = _mm256_setzero_si256();
+
+    int x = 0;
+    // Шестнадцать пикселей за итерацию
+    for (; x + 16 <= width; x += 16) {
+        __m256i first = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + x));
+        __m256i second = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + x + 8));
+
+        difference = _mm256_or_si256(difference,
+            _mm256_and_si256(_mm256_xor_si256(first, _mm256_srli_epi32(first, 8)), colorMask));
+        difference = _mm256_or_si256(difference,
+            _mm256_and_si256(_mm256_xor_si256(second, _mm256_srli_epi32(second, 8)), colorMask));
+
+        // Внутри каждой половины: пиксели 0..3 и 4..7 в исходном порядке
+        __m256i sum0 = _mm256_hadd_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi8(first, zero), coefficients),
+                                         _mm256_madd_epi16(_mm256_unpackhi_epi8(first, zero), coefficients));
+        __m256i sum1 = _mm256_hadd_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi8(second, zero), coefficients),
+                                         _mm256_madd_epi16(_mm256_unpackhi_epi8(second, zero), coefficients));
+        __m256i luma = _mm256_packus_epi32(_mm256_srli_epi32(sum0, LUMA_SHIFT), _mm256_srli_epi32(sum1, LUMA_SHIFT));
+        luma = _mm256_packus_epi16(luma, luma);
+        luma = _mm256_permutevar8x32_epi32(luma, order);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + x), _mm256_castsi256_si128(luma));
+    }
+
+    bool gray = _mm256_testz_si256(difference, difference) != 0;
+    return lumaRowScalar(src, x, width, tables, dst) && gray;
+}
+
+#endif // GRAYSCALE_X86_SIMD
+
+bool lumaRow(const QRgb *src, int width, const LumaTables &tables,
+             const LumaWeights &weights, uchar *dst) {
+    switch (activeSimdLevel()) {
+#ifdef GRAYSCALE_X86_SIMD
+    case SimdLevel::AVX2:
+        return lumaRowAvx2(src, width, tables, weights, dst);
+    case SimdLevel::SSE41:
+        return lumaRowSse41(src, width, tables, weights, dst);
+#endif
+    default:
+        Q_UNUSED(weights);
+        return lumaRowScalar(src, 0, width, tables, dst);
+    }
+}
+
+// Общий проход; histogram (если задана) копится по готовым строкам,
+// пока они ещё в кэше
+bool lumaPass(QImage &image, LumaStandard standard, GrayHistogram *histogram) {
+    TRACE_SCOPE("toGrayscale");
+    if (histogram) histogram->fill(0);
+    if (image.isNull()) return false;
+
+    // Яркость серого пикселя равна ему самому
+    if (image.format() == QImage::Format_Grayscale8) {
+        if (histogram) *histogram = computeGrayHistogram(image);
+        return true;
+    }
+
+    if (image.format() != QImage::Format_RGB32 &&
+        image.format() != QImage::Format_ARGB32) {
+        image = image.convertToFormat(QImage::Format_RGB32);
+    }
+
+    int width = image.width();
+    LumaWeights weights = lumaWeights(standard);
+    LumaTables tables(weights);
+
+    QImage result(width, image.height(), QImage::Format_Grayscale8);
+    uchar *bits = result.bits();
+    int bytesPerLine = result.bytesPerLine();
+    std::atomic<bool> gray(true);
+    QMutex mutex;
+
+    parallelForRows(image.height(), [&](int yBegin, int yEnd) {
+        bool bandGray = true;
+        quint64 local[256] = {0};
+        for (int y = yBegin; y < yEnd; ++y) {
+            const QRgb *src = reinterpret_cast<const QRgb *>(image.constScanLine(y));
+            uchar *dst = bits + static_cast<size_t>(y) * bytesPerLine;
+            bandGray = lumaRow(src, width, tables, weights, dst) && bandGray;
+            if (histogram) {
+                for (int x = 0; x < width; ++x) local[dst[x]]++;
+            }
+        }
+        if (!bandGray) gray.store(false);
+        if (histogram) {
+            QMutexLocker locker(&mutex);
+            for (int i = 0; i < 256; ++i) (*histogram)[i] += local[i];
+        }
+    });
+
+    image = result;
+    return gray.load();
+}
+
+} // namespace
+
+bool toGrayscale(QImage &image, LumaStandard standard) {
+    return lumaPass(image, standard, nullptr);
+}
+
+bool toGrayscale(QImage &image, LumaStandard standard, GrayHistogram &histogram) {
+    return lumaPass(image, standard, &histogram);
+}
+
+void toGrayscaleBT601(QImage &image) {
+    toGrayscale(image, LumaStandard::BT601);
+}
+
+void toGrayscaleBT709(QImage &image) {
+    toGrayscale(image, LumaStandard::BT709);
+}
+
+void toGrayscaleBT2020(QImage &image) {
+    toGrayscale(image, LumaStandard::BT2020);
+}
+
+bool isGrayscale(const QImage &image) {
+    if (image.format() == QImage::Format_Grayscale8) {
+        return true;
+    }
+
+    if (image.format() == QImage::Format_RGB32 ||
+        image.format() == QImage::Format_ARGB32) {
+        for (int y = 0; y < image.height(); ++y) {
+            const QRgb *row = reinterpret_cast<const QRgb *>(image.constScanLine(y));
+            QRgb difference = 0;
+            for (int x = 0; x < image.width(); ++x) {
+                difference |= (row[x] ^ (row[x] >> 8)) & 0xffffu;
+            }
+            if (difference != 0) return false;
+        }
+        return true;
+    }
+
+    for (int y = 0; y < image.height(); ++y) {
+        for (int x = 0; x < image.width(); ++x) {
+            QRgb pixel = image.pixel(x, y);
+            if (qRed(pixel) != qGreen(pixel) || qGreen(pixel) != qBlue(pixel)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool convertToGrayscale(QImage &image) {
+    // Для серого изображения BT.709 даёт те же значения, поэтому
+    // отдельная проверка перед пересчётом не нужна
+    return toGrayscale(image, LumaStandard::BT709); // По умолчанию используем BT.709
+}
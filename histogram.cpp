@@ -0,0 +1,88 @@
+#include "filter2d.h"
+#include "parallel.h"
+#include "tracing.h"
+#include <QMutex>
+#include <QMutexLocker>
+#include <QRgb>
+
+// ============ ГИСТОГРАММА ЯРКОСТИ ============
+
+GrayHistogram computeGrayHistogram(const QImage &image) {
+    TRACE_SCOPE("computeGrayHistogram");
+    GrayHistogram histogram;
+    histogram.fill(0);
+    if (image.isNull()) return histogram;
+
+    int width = image.width();
+    QImage::Format format = image.format();
+    bool direct32 = format == QImage::Format_RGB32 || format == QImage::Format_ARGB32;
+    bool direct8 = format == QImage::Format_Grayscale8;
+    QMutex mutex;
+
+    // Каждая полоса копит свою гистограмму и один раз добавляет её к общей
+    parallelForRows(image.height(), [&](int yBegin, int yEnd) {
+        quint64 local[256] = {0};
+        for (int y = yBegin; y < yEnd; ++y) {
+            if (direct32) {
+                const QRgb *row = reinterpret_cast<const QRgb *>(image.constScanLine(y));
+                for (int x = 0; x < width; ++x) local[qGray(row[x])]++;
+            } else if (direct8) {
+                const uchar *row = image.constScanLine(y);
+                for (int x = 0; x < width; ++x) local[row[x]]++;
+            } else {
+                for (int x = 0; x < width; ++x) local[qGray(image.pixel(x, y))]++;
+            }
+        }
+
+        QMutexLocker locker(&mutex);
+        for (int i = 0; i < 256; ++i) histogram[i] += local[i];
+    });
+
+    return histogram;
+}
+
+void applyGrayLut(QImage &image, const uchar lut[256]) {
+    TRACE_SCOPE("applyGrayLut");
+    if (image.isNull()) return;
+
+    int width = image.width();
+
+    // Grayscale8 пересчитывается на месте, остальные форматы
+    // сворачиваются в новое изображение Grayscale8 по qGray
+    if (image.format() == QImage::Format_Grayscale8) {
+        uchar *bits = image.bits();
+        int bytesPerLine = image.bytesPerLine();
+        parallelForRows(image.height(), [&](int yBegin, int yEnd) {
+            for (int y = yBegin; y < yEnd; ++y) {
+                uchar *row = bits + static_cast<size_t>(y) * bytesPerLine;
+                for (int x = 0; x < width; ++x) row[x] = lut[row[x]];
+            }
+        });
+        return;
+    }
+
+    QImage result(width, image.height(), QImage::Format_Grayscale8);
+    uchar *bits = result.bits();
+    int bytesPerLine = result.bytesPerLine();
+    bool direct32 = image.format() == QImage::Format_RGB32 || image.format() == QImage::Format_ARGB32;
+
+    parallelForRows(image.height(), [&](int yBegin, int yEnd) {
+        for (int y = yBegin; y < yEnd; ++y) {
+            uchar *dst = bits + static_cast<size_t>(y) * bytesPerLine;
+            if (direct32) {
+                const QRgb *src = reinterpret_cast<const QRgb *>(image.constScanLine(y));
+                for (int x = 0; x < width; ++x) dst[x] = lut[qGray(src[x])];
+            } else {
+                for (int x = 0; x < width; ++x) dst[x] = lut[qGray(image.pixel(x, y))];
+            }
+        }
+    });
+
+    image = result;
+}
+
+void applyThreshold(QImage &image, int threshold) {
+    uchar lut[256];
+    for (int i = 0; i < 256; ++i) lut[i] = (i >= threshold) ? 255 : 0;
+    applyGrayLut(image, lut);
+}
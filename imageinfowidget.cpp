@@ -1,7 +1,188 @@
 #include "imageinfowidget.h"
+#include "parallel.h"
+#include "tracing.h"
 #include <QFormLayout>
-#include <QSet>
+#include <QFutureWatcher>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QPainter>
+#include <QPainterPath>
 #include <QRgb>
+#include <QtAlgorithms>
+#include <QtConcurrent/QtConcurrent>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+namespace {
+
+// Битовая карта по всем 24-битным цветам: 2^24 бит = 2 МБ
+const int COLOR_BITSET_WORDS = (1 << 24) / 64;
+
+// Частичные суммы полосы строк
+struct BandStatistics {
+    GrayHistogram red, green, blue;
+    quint64 brightness = 0;
+
+    BandStatistics() {
+        red.fill(0);
+        green.fill(0);
+        blue.fill(0);
+    }
+
+    inline void add(int r, int g, int b) {
+        ++red[r];
+        ++green[g];
+        ++blue[b];
+        brightness += static_cast<quint64>((r + g + b) / 3);
+    }
+};
+
+// Бит уже стоит у большинства пикселей: атомарная запись только для нового цвета
+inline void markColor(std::atomic<quint64> *bits, int r, int g, int b) {
+    quint32 color = (static_cast<quint32>(r) << 16) | (static_cast<quint32>(g) << 8) | static_cast<quint32>(b);
+    quint64 mask = 1ULL << (color & 63);
+    std::atomic<quint64> &word = bits[color >> 6];
+    if (!(word.load(std::memory_order_relaxed) & mask)) word.fetch_or(mask, std::memory_order_relaxed);
+}
+
+int histogramMean(const GrayHistogram &histogram, qint64 count) {
+    quint64 sum = 0;
+    for (int i = 0; i < 256; ++i) sum += histogram[i] * static_cast<quint64>(i);
+    return count > 0 ? static_cast<int>(sum / static_cast<quint64>(count)) : 0;
+}
+
+} // namespace
+
+ImageStatistics computeImageStatistics(const QImage &source) {
+    TRACE_SCOPE("computeImageStatistics");
+    ImageStatistics statistics;
+    statistics.red.fill(0);
+    statistics.green.fill(0);
+    statistics.blue.fill(0);
+    if (source.isNull()) return statistics;
+
+    // Grayscale8, RGB888 (отображённый PPM) и 32-битные читаются напрямую
+    QImage image = source;
+    const QImage::Format format = image.format();
+    if (format != QImage::Format_RGB32 && format != QImage::Format_ARGB32 &&
+        format != QImage::Format_RGB888 && format != QImage::Format_Grayscale8) {
+        image = image.convertToFormat(image.hasAlphaChannel() ? QImage::Format_ARGB32 : QImage::Format_RGB32);
+    }
+    const bool gray = image.format() == QImage::Format_Grayscale8;
+    const bool packed = image.format() == QImage::Format_RGB888;
+    const int width = image.width();
+
+    // У полутонового цвета различает сама гистограмма
+    std::unique_ptr<std::atomic<quint64>[]> bits;
+    if (!gray) {
+        bits.reset(new std::atomic<quint64>[COLOR_BITSET_WORDS]);
+        for (int i = 0; i < COLOR_BITSET_WORDS; ++i) bits[i].store(0, std::memory_order_relaxed);
+    }
+
+    QMutex mutex;
+    quint64 brightness = 0;
+    parallelForRows(image.height(), [&](int yBegin, int yEnd) {
+        BandStatistics band;
+        for (int y = yBegin; y < yEnd; ++y) {
+            const uchar *line = image.constScanLine(y);
+            if (gray) {
+                for (int x = 0; x < width; ++x) band.add(line[x], line[x], line[x]);
+            } else if (packed) {
+                for (int x = 0; x < width; ++x) {
+                    const uchar *pixel = line + 3 * x;
+                    band.add(pixel[0], pixel[1], pixel[2]);
+                    markColor(bits.get(), pixel[0], pixel[1], pixel[2]);
+                }
+            } else {
+                const QRgb *pixels = reinterpret_cast<const QRgb *>(line);
+                for (int x = 0; x < width; ++x) {
+                    int r = qRed(pixels[x]), g = qGreen(pixels[x]), b = qBlue(pixels[x]);
+                    band.add(r, g, b);
+                    markColor(bits.get(), r, g, b);
+                }
+            }
+        }
+
+        QMutexLocker locker(&mutex);
+        for (int i = 0; i < 256; ++i) {
+            statistics.red[i] += band.red[i];
+            statistics.green[i] += band.green[i];
+            statistics.blue[i] += band.blue[i];
+        }
+        brightness += band.brightness;
+    });
+
+    const qint64 count = static_cast<qint64>(width) * image.height();
+    statistics.pixelCount = count;
+    statistics.avgRed = histogramMean(statistics.red, count);
+    statistics.avgGreen = histogramMean(statistics.green, count);
+    statistics.avgBlue = histogramMean(statistics.blue, count);
+    statistics.avgBrightness = count > 0 ? static_cast<int>(brightness / static_cast<quint64>(count)) : 0;
+
+    if (gray) {
+        statistics.uniqueColors = std::count_if(statistics.red.begin(), statistics.red.end(),
+                                                [](quint64 value) { return value > 0; });
+    } else {
+        for (int i = 0; i < COLOR_BITSET_WORDS; ++i) {
+            statistics.uniqueColors += qPopulationCount(bits[i].load(std::memory_order_relaxed));
+        }
+    }
+    return statistics;
+}
+
+// ============ ГИСТОГРАММА КАНАЛОВ ============
+
+ChannelHistogramWidget::ChannelHistogramWidget(QWidget *parent) : QWidget(parent) {
+    setMinimumHeight(90);
+}
+
+void ChannelHistogramWidget::setHistograms(const GrayHistogram &red, const GrayHistogram &green,
+                                           const GrayHistogram &blue) {
+    channels[0] = red;
+    channels[1] = green;
+    channels[2] = blue;
+    empty = false;
+    update();
+}
+
+void ChannelHistogramWidget::clear() {
+    empty = true;
+    update();
+}
+
+void ChannelHistogramWidget::paintEvent(QPaintEvent *) {
+    QPainter painter(this);
+    painter.fillRect(rect(), QColor("#1a1a1a"));
+    if (empty) return;
+
+    quint64 maximum = 1;
+    for (const GrayHistogram &channel : channels) {
+        maximum = std::max(maximum, *std::max_element(channel.begin(), channel.end()));
+    }
+
+    // Каналы полупрозрачные: у полутонового изображения сливаются в серый
+    const QColor colors[3] = {QColor(230, 60, 60, 110), QColor(60, 200, 60, 110), QColor(70, 110, 240, 110)};
+    const double w = width();
+    const double h = height();
+    painter.setRenderHint(QPainter::Antialiasing);
+    painter.setPen(Qt::NoPen);
+    for (int c = 0; c < 3; ++c) {
+        QPainterPath path;
+        path.moveTo(0, h);
+        for (int i = 0; i < 256; ++i) {
+            double x = w * (i + 0.5) / 256.0;
+            double y = h - h * static_cast<double>(channels[c][i]) / static_cast<double>(maximum);
+            path.lineTo(x, y);
+        }
+        path.lineTo(w, h);
+        path.closeSubpath();
+        painter.setBrush(colors[c]);
+        painter.drawPath(path);
+    }
+}
+
+// ============ ИНФОРМАЦИЯ ОБ ИЗОБРАЖЕНИИ ============
 
 ImageInfoWidget::ImageInfoWidget(QWidget *parent)
     : QWidget(parent) {
@@ -9,6 +190,7 @@ ImageInfoWidget::ImageInfoWidget(QWidget *parent)
 }
 
 ImageInfoWidget::~ImageInfoWidget() {
+    if (statisticsToken) statisticsToken->cancel();
 }
 
 void ImageInfoWidget::setupUI() {
@@ -40,8 +222,14 @@ void ImageInfoWidget::setupUI() {
     colorLayout->addRow("Средний цвет:", avgColorLabel);
     colorLayout->addRow("Средняя яркость:", brightnessLabel);
 
+    histogramGroup = new QGroupBox("Гистограмма каналов", this);
+    QVBoxLayout *histogramLayout = new QVBoxLayout(histogramGroup);
+    histogramWidget = new ChannelHistogramWidget(this);
+    histogramLayout->addWidget(histogramWidget);
+
     mainLayout->addWidget(basicInfoGroup);
     mainLayout->addWidget(colorInfoGroup);
+    mainLayout->addWidget(histogramGroup);
     mainLayout->addStretch();
 
     setLayout(mainLayout);
@@ -56,6 +244,8 @@ void ImageInfoWidget::setImage(const QImage &image) {
 }
 
 void ImageInfoWidget::clear() {
+    if (statisticsToken) statisticsToken->cancel();
+    statisticsToken.reset();
     widthLabel->setText("—");
     heightLabel->setText("—");
     formatLabel->setText("—");
@@ -64,9 +254,11 @@ void ImageInfoWidget::clear() {
     colorCountLabel->setText("—");
     avgColorLabel->setText("—");
     brightnessLabel->setText("—");
+    histogramWidget->clear();
 }
 
 void ImageInfoWidget::updateInfo(const QImage &image) {
+    TRACE_SCOPE("updateInfo");
     widthLabel->setText(QString::number(image.width()) + " px");
     heightLabel->setText(QString::number(image.height()) + " px");
 
@@ -85,50 +277,40 @@ void ImageInfoWidget::updateInfo(const QImage &image) {
     qint64 bytes = static_cast<qint64>(image.sizeInBytes());
     sizeLabel->setText(formatSize(bytes));
 
-    if (image.width() * image.height() < 1000000) {
-        QSet<QRgb> uniqueColors;
-        qint64 sumR = 0, sumG = 0, sumB = 0;
-        qint64 sumBrightness = 0;
-        int pixelCount = 0;
-
-        for (int y = 0; y < image.height(); ++y) {
-            for (int x = 0; x < image.width(); ++x) {
-                QRgb pixel = image.pixel(x, y);
-                uniqueColors.insert(pixel);
-
-                int r = qRed(pixel);
-                int g = qGreen(pixel);
-                int b = qBlue(pixel);
-
-                sumR += r;
-                sumG += g;
-                sumB += b;
-                sumBrightness += (r + g + b) / 3;
-                pixelCount++;
-            }
-        }
+    // Прежний расчёт больше не нужен: его потоки освобождаются сразу
+    if (statisticsToken) statisticsToken->cancel();
+    std::shared_ptr<CancellationToken> token = std::make_shared<CancellationToken>();
+    statisticsToken = token;
 
-        colorCountLabel->setText(QString::number(uniqueColors.size()));
+    colorCountLabel->setText("вычисляется…");
+    avgColorLabel->setText("—");
+    avgColorLabel->setStyleSheet(QString());
+    brightnessLabel->setText("—");
+    histogramWidget->clear();
 
-        if (pixelCount > 0) {
-            int avgR = static_cast<int>(sumR / pixelCount);
-            int avgG = static_cast<int>(sumG / pixelCount);
-            int avgB = static_cast<int>(sumB / pixelCount);
+    QFutureWatcher<ImageStatistics> *watcher = new QFutureWatcher<ImageStatistics>(this);
+    connect(watcher, &QFutureWatcher<ImageStatistics>::finished, this, [this, watcher, token]() {
+        if (token == statisticsToken && !token->isCancelled()) showStatistics(watcher->result());
+        watcher->deleteLater();
+    });
+    watcher->setFuture(QtConcurrent::run([image, token]() {
+        CancellationScope scope(token.get());
+        return computeImageStatistics(image);
+    }));
+}
 
-            QString colorText = QString("RGB(%1, %2, %3)").arg(avgR).arg(avgG).arg(avgB);
-            QString colorStyle = QString("QLabel { background-color: rgb(%1, %2, %3); padding: 3px; }")
-                                     .arg(avgR).arg(avgG).arg(avgB);
-            avgColorLabel->setText(colorText);
-            avgColorLabel->setStyleSheet(colorStyle);
+void ImageInfoWidget::showStatistics(const ImageStatistics &statistics) {
+    colorCountLabel->setText(QString::number(statistics.uniqueColors));
+    histogramWidget->setHistograms(statistics.red, statistics.green, statistics.blue);
+    if (statistics.pixelCount == 0) return;
 
-            int avgBright = static_cast<int>(sumBrightness / pixelCount);
-            brightnessLabel->setText(QString::number(avgBright) + " / 255");
-        }
-    } else {
-        colorCountLabel->setText("(слишком большое изображение)");
-        avgColorLabel->setText("—");
-        brightnessLabel->setText("—");
-    }
+    QString colorText = QString("RGB(%1, %2, %3)")
+                            .arg(statistics.avgRed).arg(statistics.avgGreen).arg(statistics.avgBlue);
+    QString colorStyle = QString("QLabel { background-color: rgb(%1, %2, %3); padding: 3px; }")
+                             .arg(statistics.avgRed).arg(statistics.avgGreen).arg(statistics.avgBlue);
+    avgColorLabel->setText(colorText);
+    avgColorLabel->setStyleSheet(colorStyle);
+    brightnessLabel->setText(QString::number(statistics.avgBrightness) + " / 255");
 }
 
 QString ImageInfoWidget::formatSize(qint64 bytes) {
@@ -6,6 +6,38 @@
 #include <QVBoxLayout>
 #include <QImage>
 #include <QGroupBox>
+#include <memory>
+#include "filter2d.h"
+#include "parallel.h"
+
+// Статистика за один параллельный проход по изображению любого размера.
+// Уникальные цвета считаются точно: битовая карта 2^24 бит (2 МБ) по
+// 24-битному RGB, альфа не учитывается.
+struct ImageStatistics {
+    qint64 pixelCount = 0;
+    qint64 uniqueColors = 0;
+    int avgRed = 0, avgGreen = 0, avgBlue = 0;
+    int avgBrightness = 0;  // среднее (r + g + b) / 3
+    GrayHistogram red, green, blue;
+};
+ImageStatistics computeImageStatistics(const QImage &image);
+
+// Гистограммы каналов R, G, B поверх друг друга
+class ChannelHistogramWidget : public QWidget {
+    Q_OBJECT
+
+public:
+    explicit ChannelHistogramWidget(QWidget *parent = nullptr);
+    void setHistograms(const GrayHistogram &red, const GrayHistogram &green, const GrayHistogram &blue);
+    void clear();
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+
+private:
+    GrayHistogram channels[3];
+    bool empty = true;
+};
 
 class ImageInfoWidget : public QWidget {
     Q_OBJECT
@@ -14,6 +46,8 @@ public:
     explicit ImageInfoWidget(QWidget *parent = nullptr);
     ~ImageInfoWidget();
 
+    // Размер и формат показываются сразу, статистика - по готовности
+    // в рабочем потоке; новое изображение отменяет расчёт для прежнего
     void setImage(const QImage &image);
 
     void clear();
@@ -21,11 +55,13 @@ public:
 private:
     void setupUI();
     void updateInfo(const QImage &image);
+    void showStatistics(const ImageStatistics &statistics);
     QString formatSize(qint64 bytes);
 
     QVBoxLayout *mainLayout;
     QGroupBox *basicInfoGroup;
     QGroupBox *colorInfoGroup;
+    QGroupBox *histogramGroup;
 
     QLabel *widthLabel;
     QLabel *heightLabel;
@@ -35,6 +71,9 @@ private:
     QLabel *colorCountLabel;
     QLabel *avgColorLabel;
     QLabel *brightnessLabel;
+    ChannelHistogramWidget *histogramWidget;
+
+    std::shared_ptr<CancellationToken> statisticsToken;  // расчёт в полёте
 };
 
 #endif
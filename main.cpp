@@ -1,7 +1,13 @@
 #include <QApplication>
 #include "mainwindow.h"
+#include "batchprocessor.h"
 
 int main(int argc, char *argv[]) {
+    // Пакетный режим не создаёт QApplication и виджеты
+    if (isBatchInvocation(argc, argv)) {
+        return batchMain(argc, argv);
+    }
+
     QApplication app(argc, argv);
 
     MainWindow window;
@@ -1,10 +1,15 @@
 #include "mainwindow.h"
 #include "filter2d.h"
+#include "streamprocessor.h"
+#include "tiledimage.h"
+#include "tracing.h"
 #include <QHBoxLayout>
 #include <QVBoxLayout>
 #include <QFormLayout>
 #include <QGridLayout>
+#include <QFile>
 #include <QFileDialog>
+#include <QInputDialog>
 #include <QMessageBox>
 #include <QScrollArea>
 #include <QStatusBar>
@@ -13,26 +18,66 @@
 #include <QFuture>
 #include <QFutureWatcher>
 #include <QFrame>
+#include <QPixmap>
+#include <QPainter>
+#include <QKeySequence>
+#include <QShortcut>
 
 const double MainWindow::SHARPEN_DEFAULTS[9] = {0.0, -1.5, 0.0, -1.5, 7.5, -1.5, 0.0, -1.5, 0.0};
 const double MainWindow::SOBEL_DEFAULTS[9] = {-2.0, 0.0, 2.0, -4.0, 0.0, 4.0, -2.0, 0.0, 2.0};
 
+// Полос при постепенном выводе результата
+const int PROGRESSIVE_STRIPS = 32;
+// Стадий в сводке трассировки в строке состояния
+const int TRACE_SUMMARY_STAGES = 5;
+
 MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent) {
+    traceFile = traceFileFromEnvironment();
     setupUI();
     createTestImage();
+    schedulePreview();
+    if (tracingEnabled()) {
+        QShortcut *traceShortcut = new QShortcut(QKeySequence("Ctrl+Shift+T"), this);
+        connect(traceShortcut, &QShortcut::activated, this, &MainWindow::saveTrace);
+    }
+}
+
+// Журнал трассы (до MAX_TRACE_EVENTS интервалов, десятки мегабайт) пишется
+// при выходе и по запросу, а не после каждой операции в потоке GUI
+MainWindow::~MainWindow() {
+    if (!tracingEnabled()) return;
+    QString error;
+    if (!writeChromeTrace(traceFile, &error)) qWarning() << error;
+}
+
+void MainWindow::saveTrace() {
+    if (!tracingEnabled()) return;
+    QString error;
+    if (writeChromeTrace(traceFile, &error)) {
+        statusBar()->showMessage("Трасса записана: " + traceFile, 3000);
+    } else {
+        QMessageBox::warning(this, "Ошибка", error);
+    }
 }
 
 void MainWindow::loadImage() {
     QString fileName = QFileDialog::getOpenFileName(this,
                                                     "Открыть изображение", "",
-                                                    "Images (*.png *.jpg *.jpeg *.bmp)");
+                                                    "Images (*.png *.jpg *.jpeg *.bmp *.pgm *.ppm *.ift)");
     if (!fileName.isEmpty()) {
-        if (originalImage.load(fileName)) {
+        QString error;
+        if (loadImageFile(fileName, &originalImage, &error)) {
+            // PGM/PPM приходит поверх отображения файла: отвязываемся от него,
+            // чтобы сохранение по тому же пути не меняло данные под изображением
+            originalImage = originalImage.copy();
             processedImage = originalImage;
+            history.clear();
+            recordHistory("Открытие");
             updateDisplay();
+            schedulePreview();
             statusBar()->showMessage("Изображение загружено", 3000);
         } else {
-            QMessageBox::warning(this, "Ошибка", "Не удалось загрузить изображение.");
+            QMessageBox::warning(this, "Ошибка", "Не удалось загрузить изображение: " + error);
         }
     }
 }
@@ -43,14 +88,85 @@ void MainWindow::saveImage() {
         return;
     }
     QString fileName = QFileDialog::getSaveFileName(this, "Сохранить изображение", "",
-                                                    "PNG (*.png);;JPEG (*.jpg);;BMP (*.bmp)");
-    if (!fileName.isEmpty()) {
-        if (processedImage.save(fileName)) {
-            statusBar()->showMessage("Изображение сохранено", 3000);
+                                                    "PNG (*.png);;JPEG (*.jpg);;BMP (*.bmp);;"
+                                                    "PGM/PPM (*.pgm *.ppm);;Тайлы ImageFilter (*.ift)");
+    if (fileName.isEmpty()) return;
+
+    // На экране предпросмотр: сохраняется его результат в полном разрешении
+    if (previewShown) {
+        processFullResolution([this, fileName]() { writeImage(fileName); });
+    } else {
+        writeImage(fileName);
+    }
+}
+
+void MainWindow::writeImage(const QString &fileName) {
+    QString error;
+    if (saveImageFile(processedImage, fileName, TiledImageOptions(), &error)) {
+        statusBar()->showMessage("Изображение сохранено", 3000);
+    } else {
+        QMessageBox::warning(this, "Ошибка", "Не удалось сохранить изображение: " + error);
+    }
+}
+
+// Файл обрабатывается полосами с диска на диск, не попадая в окно просмотра
+void MainWindow::processLargeFile() {
+    QString inputName = QFileDialog::getOpenFileName(this, "Большой файл", "",
+                                                     "Images (*.pgm *.ppm *.ift *.png *.jpg *.jpeg *.bmp)");
+    if (inputName.isEmpty()) return;
+    QString outputName = QFileDialog::getSaveFileName(this, "Сохранить результат", "",
+                                                      "PGM/PPM (*.pnm *.pgm *.ppm);;Тайлы ImageFilter (*.ift)");
+    if (outputName.isEmpty()) return;
+    if (!isStreamOutputFileName(outputName)) outputName += ".pnm";
+
+    bool ok = false;
+    int memoryMb = QInputDialog::getInt(this, "Потоковая обработка", "Бюджет памяти, МБ:",
+                                        DEFAULT_STREAM_MEMORY_MB, 1, 1 << 20, 64, &ok);
+    if (!ok) return;
+
+    setControlsEnabled(false);
+    progressBar->setValue(0);
+    progressBar->setVisible(true);
+    statusBar()->showMessage("Обработка полосами...");
+
+    FilterSettings settings = currentFilterSettings();
+    std::shared_ptr<CancellationToken> token = std::make_shared<CancellationToken>();
+    processingToken = token;
+    cancelBtn->setVisible(true);
+
+    QFutureWatcher<QString> *watcher = new QFutureWatcher<QString>(this);
+    connect(watcher, &QFutureWatcher<QString>::finished, this, [this, watcher, outputName, token]() {
+        QString error = watcher->result();
+        progressBar->setVisible(false);
+        cancelBtn->setVisible(false);
+        setControlsEnabled(true);
+        if (error.isEmpty()) {
+            statusBar()->showMessage("Сохранено: " + outputName, 5000);
+        } else if (token->isCancelled()) {
+            // Недописанный файл не оставляем
+            QFile::remove(outputName);
+            statusBar()->showMessage("Обработка отменена", 3000);
         } else {
-            QMessageBox::warning(this, "Ошибка", "Не удалось сохранить изображение.");
+            statusBar()->clearMessage();
+            QMessageBox::warning(this, "Ошибка", "Потоковая обработка: " + error);
         }
-    }
+        watcher->deleteLater();
+    });
+
+    QFuture<QString> future = QtConcurrent::run([this, inputName, outputName, settings, memoryMb, token]() {
+        CancellationScope scope(token.get());
+        auto callback = [this](int progress) {
+            QMetaObject::invokeMethod(this, "updateProgress", Qt::QueuedConnection, Q_ARG(int, progress));
+        };
+        QString error;
+        if (!processStream(inputName, outputName, settings, static_cast<qint64>(memoryMb) << 20,
+                           &error, callback)) {
+            return error.isEmpty() ? QString("неизвестная ошибка") : error;
+        }
+        return QString();
+    });
+
+    watcher->setFuture(future);
 }
 
 void MainWindow::updateProgress(int value) {
@@ -62,158 +178,328 @@ void MainWindow::applyFilter() {
         QMessageBox::warning(this, "Предупреждение", "Сначала загрузите изображение!");
         return;
     }
+    processFullResolution();
+}
+
+void MainWindow::processFullResolution(std::function<void()> onFinished) {
+    const QString cacheKey = currentResultKey();
+    QImage cached;
+    if (resultCache.find(cacheKey, &cached)) {
+        processedImage = cached;
+        recordHistory(pipelineStageToString(currentStages().back()));
+        updateDisplay();
+        statusBar()->showMessage("Результат взят из кэша", 3000);
+        if (onFinished) onFinished();
+        return;
+    }
 
     setControlsEnabled(false);
     progressBar->setValue(0);
     progressBar->setVisible(true);
+    cancelBtn->setVisible(true);
     statusBar()->showMessage("Обработка изображения...");
 
     QImage imageToProcess = originalImage.copy();
-    int filterIndex = filterCombo->currentIndex();
-
+    FilterPipeline stages = currentStages();
+    std::shared_ptr<CancellationToken> token = std::make_shared<CancellationToken>();
+    processingToken = token;
+    // Предпросмотр не должен перерисовать результат поверх
+    previewQueued = false;
+    if (previewToken) previewToken->cancel();
+
+    // Готовые полосы рисуются поверх уменьшенного исходника
+    progressiveCanvas = originalImage.scaled(processedLabel->size(), Qt::KeepAspectRatio, Qt::SmoothTransformation)
+                            .convertToFormat(QImage::Format_RGB32);
+
+    const int traceMark = traceEventCount();
     QFutureWatcher<QImage> *watcher = new QFutureWatcher<QImage>(this);
-    connect(watcher, &QFutureWatcher<QImage>::finished, this, [this, watcher](){
-        processedImage = watcher->result();
-        updateDisplay();
+    connect(watcher, &QFutureWatcher<QImage>::finished, this, [this, watcher, onFinished, token, cacheKey, traceMark](){
         progressBar->setVisible(false);
-        statusBar()->showMessage("Обработка завершена", 3000);
+        cancelBtn->setVisible(false);
+        progressiveCanvas = QImage();
         setControlsEnabled(true);
         watcher->deleteLater();
+        if (token->isCancelled()) {
+            updateDisplay();
+            statusBar()->showMessage("Обработка отменена", 3000);
+            return;
+        }
+        processedImage = watcher->result();
+        resultCache.insert(cacheKey, processedImage);
+        recordHistory(pipelineStageToString(currentStages().back()));
+        updateDisplay();
+        showCompletionMessage("Обработка завершена", traceMark);
+        if (onFinished) onFinished();
     });
 
-    QFuture<QImage> future;
-
-    switch (filterIndex) {
-    case 0: {
-        int size = gaussSizeSpinBox->value();
-        double sigma = gaussSigmaSpinBox->value();
-        future = QtConcurrent::run([=](){
-            QImage resultImage = imageToProcess;
-            gaussianBlur(resultImage, size, sigma);
-            return resultImage;
-        });
-        break;
-    }
-    case 1: {
-        double* kernelValues = new double[9];
-        for(int i = 0; i < 9; ++i) kernelValues[i] = sharpenKernelInputs[i]->value();
-        future = QtConcurrent::run([=](){
-            QImage resultImage = imageToProcess;
-            filter2D(resultImage, kernelValues, 3, 3);
-            delete[] kernelValues;
-            return resultImage;
-        });
-        break;
-    }
-    case 2: {
-        double* kernelValues = new double[9];
-        for(int i = 0; i < 9; ++i) kernelValues[i] = sobelKernelInputs[i]->value();
-        future = QtConcurrent::run([=](){
-            QImage resultImage = imageToProcess;
-            filter2D(resultImage, kernelValues, 3, 3);
-            delete[] kernelValues;
-            return resultImage;
-        });
-        break;
-    }
-    case 3: {
-        future = QtConcurrent::run([=](){
-            QImage resultImage = imageToProcess;
-            toGrayscaleBT601(resultImage);
-            return resultImage;
-        });
-        break;
-    }
-    case 4: {
-        future = QtConcurrent::run([=](){
-            QImage resultImage = imageToProcess;
-            toGrayscaleBT709(resultImage);
-            return resultImage;
-        });
-        break;
-    }
-    case 5: {
-        future = QtConcurrent::run([this, imageToProcess]() mutable {
-            auto callback = [this](int progress) {
-                QMetaObject::invokeMethod(this, "updateProgress", Qt::QueuedConnection, Q_ARG(int, progress));
+    QFuture<QImage> future = QtConcurrent::run([this, imageToProcess, stages, token]() mutable {
+        TRACE_SCOPE("processFullResolution");
+        CancellationScope scope(token.get());
+        auto callback = [this](int progress) {
+            QMetaObject::invokeMethod(this, "updateProgress", Qt::QueuedConnection, Q_ARG(int, progress));
+        };
+        // Одна операция - полосами с выводом по мере готовности, если полосы
+        // не добавляют заметной работы
+        const int strips = stages.size() == 1
+                               ? progressiveStripCount(stages.front(), imageToProcess.height(), PROGRESSIVE_STRIPS)
+                               : 1;
+        if (strips > 1) {
+            auto onRows = [this](const QImage &rows, int y) {
+                QMetaObject::invokeMethod(this, "showFinishedRows", Qt::QueuedConnection,
+                                          Q_ARG(QImage, rows), Q_ARG(int, y));
             };
-            binarizeOtsu(imageToProcess, callback);
-            return imageToProcess;
-        });
-        break;
+            QString error;
+            QImage result = processImageInStrips(imageToProcess, stages.front(), strips,
+                                                 onRows, &error, callback);
+            if (!result.isNull() || token->isCancelled()) return result;
+        }
+        applyPipeline(imageToProcess, stages, callback);
+        return imageToProcess;
+    });
+
+    watcher->setFuture(future);
+}
+
+// При включённой трассировке к сообщению добавляются самые долгие стадии
+// с позиции журнала fromEvent
+void MainWindow::showCompletionMessage(const QString &message, int fromEvent) {
+    if (!tracingEnabled()) {
+        statusBar()->showMessage(message, 3000);
+        return;
     }
-    case 6: {
-        future = QtConcurrent::run([this, imageToProcess]() mutable {
-            auto callback = [this](int progress) {
-                QMetaObject::invokeMethod(this, "updateProgress", Qt::QueuedConnection, Q_ARG(int, progress));
-            };
-            binarizeHuang(imageToProcess, callback);
-            return imageToProcess;
-        });
-        break;
+    statusBar()->showMessage(message + " | " + traceSummary(fromEvent, TRACE_SUMMARY_STAGES).join(", "));
+}
+
+void MainWindow::showFinishedRows(const QImage &rows, int y) {
+    if (progressiveCanvas.isNull() || !processingToken || processingToken->isCancelled()) return;
+
+    const double scale = static_cast<double>(progressiveCanvas.height()) / std::max(1, originalImage.height());
+    QPainter painter(&progressiveCanvas);
+    painter.setRenderHint(QPainter::SmoothPixmapTransform);
+    painter.drawImage(QRectF(0, y * scale, progressiveCanvas.width(), rows.height() * scale), rows);
+    painter.end();
+    processedLabel->setPixmap(QPixmap::fromImage(progressiveCanvas));
+}
+
+// Рабочие потоки освобождаются после текущего куска строк (см. CANCEL_CHECK_ROWS)
+void MainWindow::cancelProcessing() {
+    if (processingToken) processingToken->cancel();
+    statusBar()->showMessage("Отмена...");
+}
+
+QString MainWindow::currentResultKey() {
+    if (originalHashKey != originalImage.cacheKey()) {
+        originalHash = imageContentHash(originalImage);
+        originalHashKey = originalImage.cacheKey();
     }
-    case 7: {
-        int windowSize = niblackWindowSpinBox->value();
-        double k = niblackKSpinBox->value();
-        future = QtConcurrent::run([this, imageToProcess, windowSize, k]() mutable {
-            auto callback = [this](int progress) {
-                QMetaObject::invokeMethod(this, "updateProgress", Qt::QueuedConnection, Q_ARG(int, progress));
-            };
-            binarizeNiblack(imageToProcess, windowSize, k, callback);
-            return imageToProcess;
-        });
-        break;
+    return resultCacheKey(originalHash, currentStages());
+}
+
+// Конвейер, а если он пуст - выбранный фильтр
+FilterPipeline MainWindow::currentStages() const {
+    if (!pipeline.empty()) return pipeline;
+    return FilterPipeline(1, currentFilterSettings());
+}
+
+void MainWindow::schedulePreview() {
+    if (previewCheck->isChecked()) previewTimer->start();
+}
+
+void MainWindow::runPreview() {
+    if (!previewCheck->isChecked() || originalImage.isNull()) return;
+    if (previewRunning) {
+        // Устаревший запуск прерывается, новый начнётся по его завершении
+        if (previewToken) previewToken->cancel();
+        previewQueued = true;
+        return;
     }
-    case 8: {
-        future = QtConcurrent::run([this, imageToProcess]() mutable {
-            auto callback = [this](int progress) {
-                QMetaObject::invokeMethod(this, "updateProgress", Qt::QueuedConnection, Q_ARG(int, progress));
-            };
-            binarizeISODATA(imageToProcess, callback);
-            return imageToProcess;
-        });
-        break;
+
+    // Уменьшенная копия пересчитывается только при смене изображения или размера окна
+    const QSize target = processedLabel->size();
+    if (previewSource.isNull() || previewSourceKey != originalImage.cacheKey() || previewSourceSize != target) {
+        previewSource = (originalImage.width() > target.width() || originalImage.height() > target.height())
+                            ? originalImage.scaled(target, Qt::KeepAspectRatio, Qt::SmoothTransformation)
+                            : originalImage;
+        previewSourceKey = originalImage.cacheKey();
+        previewSourceSize = target;
     }
-    default:
-        setControlsEnabled(true);
-        progressBar->setVisible(false);
-        return;
+
+    const double scale = static_cast<double>(previewSource.width()) / originalImage.width();
+    FilterPipeline stages = currentStages();
+    for (FilterSettings &stage : stages) stage = scaleFilterSettings(stage, scale);
+
+    previewRunning = true;
+    previewToken = std::make_shared<CancellationToken>();
+    std::shared_ptr<CancellationToken> token = previewToken;
+    const int generation = previewGeneration;
+    QFutureWatcher<QImage> *watcher = new QFutureWatcher<QImage>(this);
+    connect(watcher, &QFutureWatcher<QImage>::finished, this, [this, watcher, generation, token]() {
+        previewRunning = false;
+        if (!token->isCancelled() && generation == previewGeneration && previewCheck->isChecked()) {
+            processedLabel->setPixmap(QPixmap::fromImage(watcher->result()).scaled(
+                processedLabel->size(), Qt::KeepAspectRatio, Qt::SmoothTransformation));
+            previewShown = true;
+        }
+        watcher->deleteLater();
+        if (previewQueued) {
+            previewQueued = false;
+            runPreview();
+        }
+    });
+
+    QImage source = previewSource;
+    watcher->setFuture(QtConcurrent::run([source, stages, token]() mutable {
+        CancellationScope scope(token.get());
+        applyPipeline(source, stages);
+        return source;
+    }));
+}
+
+void MainWindow::onPreviewToggled(bool enabled) {
+    if (enabled) {
+        runPreview();
+    } else {
+        previewQueued = false;
+        if (previewToken) previewToken->cancel();
+        updateDisplay();
     }
+}
 
-    watcher->setFuture(future);
+FilterSettings MainWindow::currentFilterSettings() const {
+    FilterSettings settings;
+    settings.type = static_cast<FilterType>(filterCombo->currentData().toInt());
+    settings.gaussSize = gaussSizeSpinBox->value();
+    settings.gaussSigma = gaussSigmaSpinBox->value();
+    settings.gaussMode = static_cast<GaussianMode>(gaussModeCombo->currentData().toInt());
+    settings.border = static_cast<BorderMode>(borderCombo->currentData().toInt());
+
+    if (settings.type == FilterType::Sharpen || settings.type == FilterType::Sobel) {
+        QDoubleSpinBox *const *inputs = (settings.type == FilterType::Sharpen) ? sharpenKernelInputs : sobelKernelInputs;
+        for (int i = 0; i < 9; ++i) settings.kernel.push_back(inputs[i]->value());
+    }
+
+    settings.niblackWindow = niblackWindowSpinBox->value();
+    settings.niblackK = niblackKSpinBox->value();
+    settings.sauvolaWindow = sauvolaWindowSpinBox->value();
+    settings.sauvolaK = sauvolaKSpinBox->value();
+    settings.wolfWindow = wolfWindowSpinBox->value();
+    settings.wolfK = wolfKSpinBox->value();
+    settings.bernsenWindow = bernsenWindowSpinBox->value();
+    settings.bernsenContrast = bernsenContrastSpinBox->value();
+    settings.otsuThresholds = otsuThresholdsSpinBox->value();
+    return settings;
 }
 
 void MainWindow::resetImage() {
     if (!originalImage.isNull()) {
         processedImage = originalImage.copy();
+        recordHistory("Сброс");
         updateDisplay();
         resetFilterParameters();
+        schedulePreview();
         statusBar()->showMessage("ИЗОБРАЖЕНИЕ СБРОШЕНО", 2000);
     }
 }
 
+void MainWindow::undoStep() {
+    if (!history.canUndo()) return;
+    processedImage = history.undo();
+    updateDisplay();
+    updateHistoryControls();
+}
+
+void MainWindow::redoStep() {
+    if (!history.canRedo()) return;
+    processedImage = history.redo();
+    updateDisplay();
+    updateHistoryControls();
+}
+
+void MainWindow::recordHistory(const QString &label) {
+    history.push(processedImage, label);
+    updateHistoryControls();
+}
+
+void MainWindow::updateHistoryControls() {
+    bool enabled = loadBtn->isEnabled();
+    undoBtn->setEnabled(enabled && history.canUndo());
+    redoBtn->setEnabled(enabled && history.canRedo());
+    historyLabel->setText(QString("ШАГОВ: %1, ИСТОРИЯ: %2 МБ")
+                              .arg(history.stepCount())
+                              .arg(QString::number(history.memoryBytes() / 1048576.0, 'f', 1)));
+    historyLabel->setToolTip(history.currentLabel());
+}
+
 void MainWindow::onFilterChanged(int index) {
     parameterStack->setCurrentIndex(index);
+    borderWidget->setVisible(isConvolutionFilter(static_cast<FilterType>(filterCombo->itemData(index).toInt())));
+    schedulePreview();
+}
+
+void MainWindow::addPipelineStage() {
+    pipeline.push_back(currentFilterSettings());
+    updatePipelineView();
+}
+
+void MainWindow::removePipelineStage() {
+    int row = pipelineList->currentRow();
+    if (row < 0) row = pipelineList->count() - 1;
+    if (row < 0) return;
+    pipeline.erase(pipeline.begin() + row);
+    updatePipelineView();
+}
+
+void MainWindow::clearPipeline() {
+    pipeline.clear();
+    updatePipelineView();
+}
+
+void MainWindow::updatePipelineView() {
+    pipelineList->clear();
+    for (size_t i = 0; i < pipeline.size(); ++i) {
+        pipelineList->addItem(QString("%1. %2").arg(i + 1).arg(pipelineStageToString(pipeline[i])));
+    }
+    pipelineList->setVisible(!pipeline.empty());
+    applyBtn->setText(pipeline.empty() ? "ПРИМЕНИТЬ ФИЛЬТР" : "ПРИМЕНИТЬ КОНВЕЙЕР");
+    schedulePreview();
 }
 
 void MainWindow::setControlsEnabled(bool enabled) {
     loadBtn->setEnabled(enabled);
     saveBtn->setEnabled(enabled);
+    streamBtn->setEnabled(enabled);
     filterCombo->setEnabled(enabled);
     parameterStack->setEnabled(enabled);
+    borderWidget->setEnabled(enabled);
     applyBtn->setEnabled(enabled);
     resetBtn->setEnabled(enabled);
+    undoBtn->setEnabled(enabled && history.canUndo());
+    redoBtn->setEnabled(enabled && history.canRedo());
+    previewCheck->setEnabled(enabled);
+    addStageBtn->setEnabled(enabled);
+    removeStageBtn->setEnabled(enabled);
+    clearStagesBtn->setEnabled(enabled);
 }
 
 void MainWindow::resetFilterParameters() {
     gaussSizeSpinBox->setValue(9);
     gaussSigmaSpinBox->setValue(4.0);
+    gaussModeCombo->setCurrentIndex(0);
+    borderCombo->setCurrentIndex(0);
     for(int i = 0; i < 9; ++i) {
         sharpenKernelInputs[i]->setValue(SHARPEN_DEFAULTS[i]);
         sobelKernelInputs[i]->setValue(SOBEL_DEFAULTS[i]);
     }
-    niblackWindowSpinBox->setValue(15);
-    niblackKSpinBox->setValue(-0.2);
+    FilterSettings defaults;
+    niblackWindowSpinBox->setValue(defaults.niblackWindow);
+    niblackKSpinBox->setValue(defaults.niblackK);
+    sauvolaWindowSpinBox->setValue(defaults.sauvolaWindow);
+    sauvolaKSpinBox->setValue(defaults.sauvolaK);
+    wolfWindowSpinBox->setValue(defaults.wolfWindow);
+    wolfKSpinBox->setValue(defaults.wolfK);
+    bernsenWindowSpinBox->setValue(defaults.bernsenWindow);
+    bernsenContrastSpinBox->setValue(defaults.bernsenContrast);
+    otsuThresholdsSpinBox->setValue(defaults.otsuThresholds);
 }
 
 QWidget* MainWindow::createKernelEditor(QDoubleSpinBox* inputs[9], const double defaultValues[9]) {
@@ -249,22 +535,17 @@ QWidget* MainWindow::createKernelEditor(QDoubleSpinBox* inputs[9], const double
     return editorWidget;
 }
 
-QWidget* MainWindow::createNiblackParametersWidget() {
+// Страница параметров локальной бинаризации: размер окна и параметр метода
+QWidget* MainWindow::createLocalThresholdWidget(QSpinBox *&windowSpinBox, const QString &parameterName,
+                                                QAbstractSpinBox *parameterSpinBox) {
     QWidget *widget = new QWidget();
     QFormLayout *layout = new QFormLayout(widget);
     layout->setSpacing(14);
     layout->setContentsMargins(0, 10, 0, 10);
 
-    niblackWindowSpinBox = new QSpinBox();
-    niblackWindowSpinBox->setRange(3, 99);
-    niblackWindowSpinBox->setSingleStep(2);
-    niblackWindowSpinBox->setValue(15);
-
-    niblackKSpinBox = new QDoubleSpinBox();
-    niblackKSpinBox->setRange(-1.0, 1.0);
-    niblackKSpinBox->setDecimals(2);
-    niblackKSpinBox->setSingleStep(0.05);
-    niblackKSpinBox->setValue(-0.2);
+    windowSpinBox = new QSpinBox();
+    windowSpinBox->setRange(3, 99);
+    windowSpinBox->setSingleStep(2);
 
     QString spinBoxStyle =
         "QSpinBox, QDoubleSpinBox {"
@@ -280,16 +561,16 @@ QWidget* MainWindow::createNiblackParametersWidget() {
         "    background: #252525;"
         "}";
 
-    niblackWindowSpinBox->setStyleSheet(spinBoxStyle);
-    niblackKSpinBox->setStyleSheet(spinBoxStyle);
+    windowSpinBox->setStyleSheet(spinBoxStyle);
+    parameterSpinBox->setStyleSheet(spinBoxStyle);
 
     QLabel *windowLabel = new QLabel("РАЗМЕР ОКНА");
-    QLabel *kLabel = new QLabel("КОЭФФИЦИЕНТ k");
+    QLabel *parameterLabel = new QLabel(parameterName);
     windowLabel->setStyleSheet("color: #b0b0b0; font-size: 12px; font-family: 'Segoe UI', Arial;");
-    kLabel->setStyleSheet("color: #b0b0b0; font-size: 12px; font-family: 'Segoe UI', Arial;");
+    parameterLabel->setStyleSheet("color: #b0b0b0; font-size: 12px; font-family: 'Segoe UI', Arial;");
 
-    layout->addRow(windowLabel, niblackWindowSpinBox);
-    layout->addRow(kLabel, niblackKSpinBox);
+    layout->addRow(windowLabel, windowSpinBox);
+    layout->addRow(parameterLabel, parameterSpinBox);
 
     return widget;
 }
@@ -449,6 +730,12 @@ void MainWindow::setupUI() {
     saveBtn->setCursor(Qt::PointingHandCursor);
     connect(saveBtn, &QPushButton::clicked, this, &MainWindow::saveImage);
 
+    streamBtn = new QPushButton("БОЛЬШОЙ ФАЙЛ ПОЛОСАМИ");
+    streamBtn->setStyleSheet(buttonStyle);
+    streamBtn->setCursor(Qt::PointingHandCursor);
+    streamBtn->setToolTip("Применить текущий фильтр к файлу на диске, не загружая его целиком");
+    connect(streamBtn, &QPushButton::clicked, this, &MainWindow::processLargeFile);
+
     // Разделитель
     QFrame *separator1 = new QFrame();
     separator1->setFrameShape(QFrame::HLine);
@@ -500,15 +787,20 @@ void MainWindow::setupUI() {
         "    outline: none;"
         "}"
         );
-    filterCombo->addItem("Размытие по Гауссу");
-    filterCombo->addItem("Повышение резкости");
-    filterCombo->addItem("Выделение краёв");
-    filterCombo->addItem("Grayscale BT.601");
-    filterCombo->addItem("Grayscale BT.709");
-    filterCombo->addItem("Бинаризация: Otsu");
-    filterCombo->addItem("Бинаризация: Huang");
-    filterCombo->addItem("Бинаризация: Niblack");
-    filterCombo->addItem("Бинаризация: ISODATA");
+    filterCombo->addItem("Размытие по Гауссу", static_cast<int>(FilterType::GaussianBlur));
+    filterCombo->addItem("Повышение резкости", static_cast<int>(FilterType::Sharpen));
+    filterCombo->addItem("Выделение краёв", static_cast<int>(FilterType::Sobel));
+    filterCombo->addItem("Grayscale BT.601", static_cast<int>(FilterType::GrayscaleBT601));
+    filterCombo->addItem("Grayscale BT.709", static_cast<int>(FilterType::GrayscaleBT709));
+    filterCombo->addItem("Бинаризация: Otsu", static_cast<int>(FilterType::BinarizeOtsu));
+    filterCombo->addItem("Бинаризация: Huang", static_cast<int>(FilterType::BinarizeHuang));
+    filterCombo->addItem("Бинаризация: Niblack", static_cast<int>(FilterType::BinarizeNiblack));
+    filterCombo->addItem("Бинаризация: Sauvola", static_cast<int>(FilterType::BinarizeSauvola));
+    filterCombo->addItem("Бинаризация: Wolf-Jolion", static_cast<int>(FilterType::BinarizeWolf));
+    filterCombo->addItem("Бинаризация: Bernsen", static_cast<int>(FilterType::BinarizeBernsen));
+    filterCombo->addItem("Бинаризация: ISODATA", static_cast<int>(FilterType::BinarizeISODATA));
+    filterCombo->addItem("Постеризация: Multi-Otsu", static_cast<int>(FilterType::BinarizeMultiOtsu));
+    filterCombo->addItem("Grayscale BT.2020", static_cast<int>(FilterType::GrayscaleBT2020));
 
     // Параметры
     QLabel *paramsLabel = new QLabel("ПАРАМЕТРЫ");
@@ -534,8 +826,10 @@ void MainWindow::setupUI() {
 
     QLabel *sizeLabel = new QLabel("РАЗМЕР ЯДРА");
     QLabel *sigmaLabel = new QLabel("КОЭФФИЦИЕНТ");
+    QLabel *modeLabel = new QLabel("РЕЖИМ");
     sizeLabel->setStyleSheet("color: #909090; font-size: 12px; font-family: 'Segoe UI', Arial;");
     sigmaLabel->setStyleSheet("color: #909090; font-size: 12px; font-family: 'Segoe UI', Arial;");
+    modeLabel->setStyleSheet("color: #909090; font-size: 12px; font-family: 'Segoe UI', Arial;");
 
     gaussSizeSpinBox = new QSpinBox();
     gaussSizeSpinBox->setRange(3, 99);
@@ -563,10 +857,49 @@ void MainWindow::setupUI() {
     gaussSizeSpinBox->setStyleSheet(spinStyle);
     gaussSigmaSpinBox->setStyleSheet(spinStyle);
 
+    // Точный - свёртка с ядром, быстрый - рекурсивный фильтр, не зависящий от размера
+    gaussModeCombo = new QComboBox();
+    gaussModeCombo->addItem("Авто", static_cast<int>(GaussianMode::Auto));
+    gaussModeCombo->addItem("Точный", static_cast<int>(GaussianMode::Exact));
+    gaussModeCombo->addItem("Быстрый (IIR)", static_cast<int>(GaussianMode::Fast));
+    gaussModeCombo->setStyleSheet(
+        "QComboBox {"
+        "    background: #1a1a1a;"
+        "    color: #d0d0d0;"
+        "    border: 1px solid #303030;"
+        "    padding: 8px;"
+        "    font-family: 'Segoe UI', Arial;"
+        "    font-size: 12px;"
+        "}"
+        "QComboBox QAbstractItemView {"
+        "    background: #1a1a1a;"
+        "    color: #d0d0d0;"
+        "    selection-background-color: #2a2a2a;"
+        "}"
+        );
+
     gaussLayout->addRow(sizeLabel, gaussSizeSpinBox);
     gaussLayout->addRow(sigmaLabel, gaussSigmaSpinBox);
+    gaussLayout->addRow(modeLabel, gaussModeCombo);
     parameterStack->addWidget(gaussPage);
 
+    // Продолжение изображения за краем; постоянный цвет - чёрный
+    borderWidget = new QWidget();
+    borderWidget->setStyleSheet("background: transparent;");
+    QFormLayout *borderLayout = new QFormLayout(borderWidget);
+    borderLayout->setSpacing(12);
+    borderLayout->setContentsMargins(0, 0, 0, 10);
+    QLabel *borderLabel = new QLabel("КРАЯ");
+    borderLabel->setStyleSheet("color: #909090; font-size: 12px; font-family: 'Segoe UI', Arial;");
+    borderCombo = new QComboBox();
+    borderCombo->addItem("Повторение", static_cast<int>(BorderMode::Replicate));
+    borderCombo->addItem("Зеркало", static_cast<int>(BorderMode::Reflect));
+    borderCombo->addItem("Зеркало без края", static_cast<int>(BorderMode::Reflect101));
+    borderCombo->addItem("Период", static_cast<int>(BorderMode::Wrap));
+    borderCombo->addItem("Чёрный", static_cast<int>(BorderMode::Constant));
+    borderCombo->setStyleSheet(gaussModeCombo->styleSheet());
+    borderLayout->addRow(borderLabel, borderCombo);
+
     // 1-2: Ядра
     parameterStack->addWidget(createKernelEditor(sharpenKernelInputs, SHARPEN_DEFAULTS));
     parameterStack->addWidget(createKernelEditor(sobelKernelInputs, SOBEL_DEFAULTS));
@@ -592,9 +925,32 @@ void MainWindow::setupUI() {
     }
 
     // 7: Ниблак
-    parameterStack->addWidget(createNiblackParametersWidget());
-
-    // 8: ISODATA
+    niblackKSpinBox = new QDoubleSpinBox();
+    niblackKSpinBox->setRange(-1.0, 1.0);
+    niblackKSpinBox->setDecimals(2);
+    niblackKSpinBox->setSingleStep(0.05);
+    parameterStack->addWidget(createLocalThresholdWidget(niblackWindowSpinBox, "КОЭФФИЦИЕНТ k", niblackKSpinBox));
+
+    // 8: Саувола
+    sauvolaKSpinBox = new QDoubleSpinBox();
+    sauvolaKSpinBox->setRange(0.0, 1.0);
+    sauvolaKSpinBox->setDecimals(2);
+    sauvolaKSpinBox->setSingleStep(0.05);
+    parameterStack->addWidget(createLocalThresholdWidget(sauvolaWindowSpinBox, "КОЭФФИЦИЕНТ k", sauvolaKSpinBox));
+
+    // 9: Вольф - Жолион
+    wolfKSpinBox = new QDoubleSpinBox();
+    wolfKSpinBox->setRange(0.0, 1.0);
+    wolfKSpinBox->setDecimals(2);
+    wolfKSpinBox->setSingleStep(0.05);
+    parameterStack->addWidget(createLocalThresholdWidget(wolfWindowSpinBox, "КОЭФФИЦИЕНТ k", wolfKSpinBox));
+
+    // 10: Бернсен
+    bernsenContrastSpinBox = new QSpinBox();
+    bernsenContrastSpinBox->setRange(0, 255);
+    parameterStack->addWidget(createLocalThresholdWidget(bernsenWindowSpinBox, "МИН. КОНТРАСТ", bernsenContrastSpinBox));
+
+    // 11: ISODATA
     QLabel *isodataLabel = new QLabel("Iterative Thresholding\nISODATA Method");
     isodataLabel->setAlignment(Qt::AlignCenter);
     isodataLabel->setStyleSheet(
@@ -605,10 +961,128 @@ void MainWindow::setupUI() {
         );
     parameterStack->addWidget(isodataLabel);
 
+    // 12: Многоуровневый Оцу
+    QWidget *multiOtsuPage = new QWidget();
+    QFormLayout *multiOtsuLayout = new QFormLayout(multiOtsuPage);
+    multiOtsuLayout->setSpacing(14);
+    multiOtsuLayout->setContentsMargins(0, 10, 0, 10);
+
+    otsuThresholdsSpinBox = new QSpinBox();
+    otsuThresholdsSpinBox->setRange(2, MULTI_OTSU_MAX_THRESHOLDS);
+    otsuThresholdsSpinBox->setStyleSheet(spinStyle);
+
+    QLabel *thresholdsLabel = new QLabel("ЧИСЛО ПОРОГОВ");
+    thresholdsLabel->setStyleSheet("color: #b0b0b0; font-size: 12px; font-family: 'Segoe UI', Arial;");
+    multiOtsuLayout->addRow(thresholdsLabel, otsuThresholdsSpinBox);
+    parameterStack->addWidget(multiOtsuPage);
+
+    // 13: BT.2020
+    QLabel *bt2020Label = new QLabel("ITU-R BT.2020 — Сверхвысокое разрешение");
+    bt2020Label->setAlignment(Qt::AlignCenter);
+    bt2020Label->setWordWrap(true);
+    bt2020Label->setStyleSheet(
+        "color: #707070;"
+        "font-size: 12px;"
+        "font-family: 'Segoe UI', Arial;"
+        "padding: 24px 12px;"
+        );
+    parameterStack->addWidget(bt2020Label);
+
     resetFilterParameters();
     connect(filterCombo, QOverload<int>::of(&QComboBox::currentIndexChanged),
             this, &MainWindow::onFilterChanged);
 
+    // Предпросмотр: перезапуск после паузы в редактировании параметров
+    previewCheck = new QCheckBox("Предпросмотр");
+    previewCheck->setChecked(true);
+    previewCheck->setStyleSheet(
+        "QCheckBox {"
+        "    color: #a0a0a0;"
+        "    font-family: 'Segoe UI', Arial;"
+        "    font-size: 12px;"
+        "    margin-top: 8px;"
+        "}"
+        );
+    previewCheck->setCursor(Qt::PointingHandCursor);
+    connect(previewCheck, &QCheckBox::toggled, this, &MainWindow::onPreviewToggled);
+
+    previewTimer = new QTimer(this);
+    previewTimer->setSingleShot(true);
+    previewTimer->setInterval(150);
+    connect(previewTimer, &QTimer::timeout, this, &MainWindow::runPreview);
+
+    for (QSpinBox *spinBox : parameterStack->findChildren<QSpinBox *>()) {
+        connect(spinBox, QOverload<int>::of(&QSpinBox::valueChanged), this, &MainWindow::schedulePreview);
+    }
+    for (QDoubleSpinBox *spinBox : parameterStack->findChildren<QDoubleSpinBox *>()) {
+        connect(spinBox, QOverload<double>::of(&QDoubleSpinBox::valueChanged), this, &MainWindow::schedulePreview);
+    }
+    connect(gaussModeCombo, QOverload<int>::of(&QComboBox::currentIndexChanged),
+            this, &MainWindow::schedulePreview);
+    connect(borderCombo, QOverload<int>::of(&QComboBox::currentIndexChanged),
+            this, &MainWindow::schedulePreview);
+
+    // Конвейер
+    QLabel *pipelineLabel = new QLabel("КОНВЕЙЕР");
+    pipelineLabel->setStyleSheet(
+        "font-family: 'Segoe UI', Arial;"
+        "font-size: 10px;"
+        "font-weight: 600;"
+        "letter-spacing: 1px;"
+        "color: #606060;"
+        "margin-top: 12px;"
+        "margin-bottom: 8px;"
+        );
+
+    pipelineList = new QListWidget();
+    pipelineList->setMaximumHeight(110);
+    pipelineList->setStyleSheet(
+        "QListWidget {"
+        "    background: #1a1a1a;"
+        "    color: #c0c0c0;"
+        "    border: 1px solid #303030;"
+        "    font-family: 'Consolas', monospace;"
+        "    font-size: 11px;"
+        "}"
+        "QListWidget::item:selected {"
+        "    background: #2a2a2a;"
+        "    color: #ffffff;"
+        "}"
+        );
+
+    const QString stageButtonStyle =
+        "QPushButton {"
+        "    background: transparent;"
+        "    color: #808080;"
+        "    border: 1px solid #303030;"
+        "    padding: 6px 8px;"
+        "    font-family: 'Segoe UI', Arial;"
+        "    font-size: 11px;"
+        "    font-weight: 500;"
+        "}"
+        "QPushButton:hover {"
+        "    background: #1a1a1a;"
+        "    color: #a0a0a0;"
+        "    border: 1px solid #404040;"
+        "}"
+        "QPushButton:disabled {"
+        "    color: #404040;"
+        "    border: 1px solid #252525;"
+        "}";
+    addStageBtn = new QPushButton("ДОБАВИТЬ");
+    removeStageBtn = new QPushButton("УБРАТЬ");
+    clearStagesBtn = new QPushButton("ОЧИСТИТЬ");
+    QHBoxLayout *stageButtonsLayout = new QHBoxLayout();
+    stageButtonsLayout->setSpacing(6);
+    for (QPushButton *button : {addStageBtn, removeStageBtn, clearStagesBtn}) {
+        button->setStyleSheet(stageButtonStyle);
+        button->setCursor(Qt::PointingHandCursor);
+        stageButtonsLayout->addWidget(button);
+    }
+    connect(addStageBtn, &QPushButton::clicked, this, &MainWindow::addPipelineStage);
+    connect(removeStageBtn, &QPushButton::clicked, this, &MainWindow::removePipelineStage);
+    connect(clearStagesBtn, &QPushButton::clicked, this, &MainWindow::clearPipeline);
+
     // Разделитель
     QFrame *separator2 = new QFrame();
     separator2->setFrameShape(QFrame::HLine);
@@ -640,6 +1114,7 @@ void MainWindow::setupUI() {
         );
     applyBtn->setCursor(Qt::PointingHandCursor);
     connect(applyBtn, &QPushButton::clicked, this, &MainWindow::applyFilter);
+    updatePipelineView();
 
     resetBtn = new QPushButton("СБРОСИТЬ");
     resetBtn->setStyleSheet(
@@ -671,6 +1146,42 @@ void MainWindow::setupUI() {
     resetBtn->setCursor(Qt::PointingHandCursor);
     connect(resetBtn, &QPushButton::clicked, this, &MainWindow::resetImage);
 
+    // Отмена и повтор шагов (Ctrl+Z, Ctrl+Shift+Z)
+    const QString historyButtonStyle =
+        "QPushButton {"
+        "    background: transparent;"
+        "    color: #808080;"
+        "    border: 1px solid #303030;"
+        "    padding: 8px 8px;"
+        "    font-family: 'Segoe UI', Arial;"
+        "    font-size: 11px;"
+        "    font-weight: 500;"
+        "    margin-top: 8px;"
+        "}"
+        "QPushButton:hover {"
+        "    background: #1a1a1a;"
+        "    color: #a0a0a0;"
+        "    border: 1px solid #404040;"
+        "}"
+        "QPushButton:disabled {"
+        "    color: #404040;"
+        "    border: 1px solid #252525;"
+        "}";
+    undoBtn = new QPushButton("НАЗАД");
+    undoBtn->setShortcut(QKeySequence::Undo);
+    redoBtn = new QPushButton("ВПЕРЁД");
+    redoBtn->setShortcut(QKeySequence::Redo);
+    QHBoxLayout *historyButtonsLayout = new QHBoxLayout();
+    historyButtonsLayout->setSpacing(6);
+    for (QPushButton *button : {undoBtn, redoBtn}) {
+        button->setStyleSheet(historyButtonStyle);
+        button->setCursor(Qt::PointingHandCursor);
+        button->setEnabled(false);
+        historyButtonsLayout->addWidget(button);
+    }
+    connect(undoBtn, &QPushButton::clicked, this, &MainWindow::undoStep);
+    connect(redoBtn, &QPushButton::clicked, this, &MainWindow::redoStep);
+
     // Разделитель
     QFrame *separator3 = new QFrame();
     separator3->setFrameShape(QFrame::HLine);
@@ -718,14 +1229,22 @@ void MainWindow::setupUI() {
     controlLayout->addWidget(loadBtn);
     controlLayout->addSpacing(6);
     controlLayout->addWidget(saveBtn);
+    controlLayout->addSpacing(6);
+    controlLayout->addWidget(streamBtn);
     controlLayout->addWidget(separator1);
     controlLayout->addWidget(filterLabel);
     controlLayout->addWidget(filterCombo);
     controlLayout->addWidget(paramsLabel);
     controlLayout->addWidget(parameterStack);
+    controlLayout->addWidget(borderWidget);
+    controlLayout->addWidget(previewCheck);
+    controlLayout->addWidget(pipelineLabel);
+    controlLayout->addLayout(stageButtonsLayout);
+    controlLayout->addWidget(pipelineList);
     controlLayout->addWidget(separator2);
     controlLayout->addWidget(applyBtn);
     controlLayout->addWidget(resetBtn);
+    controlLayout->addLayout(historyButtonsLayout);
     controlLayout->addWidget(separator3);
     controlLayout->addWidget(infoTitle);
     controlLayout->addWidget(scrollArea, 1);
@@ -768,6 +1287,30 @@ void MainWindow::setupUI() {
         "}"
         );
     statusBar()->addPermanentWidget(progressBar);
+
+    cancelBtn = new QPushButton("ОТМЕНА");
+    cancelBtn->setVisible(false);
+    cancelBtn->setStyleSheet(
+        "QPushButton {"
+        "    background: transparent;"
+        "    color: #a0a0a0;"
+        "    border: 1px solid #303030;"
+        "    padding: 2px 10px;"
+        "    font-family: 'Segoe UI', Arial;"
+        "    font-size: 11px;"
+        "}"
+        "QPushButton:hover {"
+        "    background: #1a1a1a;"
+        "    border: 1px solid #404040;"
+        "}"
+        );
+    cancelBtn->setCursor(Qt::PointingHandCursor);
+    connect(cancelBtn, &QPushButton::clicked, this, &MainWindow::cancelProcessing);
+    statusBar()->addPermanentWidget(cancelBtn);
+
+    historyLabel = new QLabel();
+    historyLabel->setStyleSheet("color: #606060; font-family: 'Segoe UI', Arial; font-size: 11px; padding: 0 8px;");
+    statusBar()->addPermanentWidget(historyLabel);
     statusBar()->showMessage("ГОТОВО");
 }
 
@@ -788,13 +1331,22 @@ void MainWindow::createTestImage() {
         }
     }
     processedImage = originalImage.copy();
+    history.clear();
+    recordHistory("Открытие");
     updateDisplay();
 }
 
 void MainWindow::updateDisplay() {
-    originalLabel->setPixmap(QPixmap::fromImage(originalImage).scaled(
-        originalLabel->size(), Qt::KeepAspectRatio, Qt::SmoothTransformation));
-    processedLabel->setPixmap(QPixmap::fromImage(processedImage).scaled(
-        processedLabel->size(), Qt::KeepAspectRatio, Qt::SmoothTransformation));
+    TRACE_SCOPE("updateDisplay");
+    // Показан processedImage: запущенный предпросмотр уже неактуален
+    ++previewGeneration;
+    previewShown = false;
+    {
+        TRACE_SCOPE("QPixmap conversion");
+        originalLabel->setPixmap(QPixmap::fromImage(originalImage).scaled(
+            originalLabel->size(), Qt::KeepAspectRatio, Qt::SmoothTransformation));
+        processedLabel->setPixmap(QPixmap::fromImage(processedImage).scaled(
+            processedLabel->size(), Qt::KeepAspectRatio, Qt::SmoothTransformation));
+    }
     infoWidget->setImage(processedImage);
 }
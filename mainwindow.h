@@ -10,27 +10,59 @@
 #include <QStackedWidget>
 #include <QPushButton>
 #include <QProgressBar>
+#include <QListWidget>
+#include <QCheckBox>
+#include <QTimer>
+#include <memory>
 #include "imageinfowidget.h"
+#include "filtersettings.h"
+#include "pipeline.h"
+#include "parallel.h"
+#include "resultcache.h"
+#include "undohistory.h"
 
 class MainWindow : public QMainWindow {
     Q_OBJECT
 
 public:
     explicit MainWindow(QWidget *parent = nullptr);
+    ~MainWindow() override;
 
 private slots:
     void loadImage();
     void saveImage();
+    void processLargeFile();
     void applyFilter();
     void resetImage();
+    void undoStep();
+    void redoStep();
     void onFilterChanged(int index);
+    void addPipelineStage();
+    void removePipelineStage();
+    void clearPipeline();
+    void schedulePreview();
+    void runPreview();
+    void onPreviewToggled(bool enabled);
     void updateProgress(int value);
+    void showFinishedRows(const QImage &rows, int y);
+    void cancelProcessing();
+    void saveTrace();
 
 private:
     void setControlsEnabled(bool enabled);
     void resetFilterParameters();
+    void updatePipelineView();
+    FilterPipeline currentStages() const;
+    QString currentResultKey();
+    void recordHistory(const QString &label);
+    void updateHistoryControls();
+    void processFullResolution(std::function<void()> onFinished = nullptr);
+    void writeImage(const QString &fileName);
+    void showCompletionMessage(const QString &message, int fromEvent);
+    FilterSettings currentFilterSettings() const;
     QWidget* createKernelEditor(QDoubleSpinBox* inputs[9], const double defaultValues[9]);
-    QWidget* createNiblackParametersWidget();
+    QWidget* createLocalThresholdWidget(QSpinBox *&windowSpinBox, const QString &parameterName,
+                                        QAbstractSpinBox *parameterSpinBox);
     void setupUI();
     void createTestImage();
     void updateDisplay();
@@ -41,20 +73,69 @@ private:
     QImage originalImage, processedImage;
     QLabel *originalLabel, *processedLabel;
     ImageInfoWidget *infoWidget;
-    QPushButton *loadBtn, *saveBtn, *applyBtn, *resetBtn;
+    QPushButton *loadBtn, *saveBtn, *streamBtn, *applyBtn, *resetBtn;
     QComboBox *filterCombo;
     QStackedWidget *parameterStack;
     QSpinBox *gaussSizeSpinBox;
     QDoubleSpinBox *gaussSigmaSpinBox;
+    QComboBox *gaussModeCombo;
+    // Режим края свёрток: общий для Гаусса и ядер 3x3, виден только у них
+    QWidget *borderWidget;
+    QComboBox *borderCombo;
     QDoubleSpinBox *sharpenKernelInputs[9];
     QDoubleSpinBox *sobelKernelInputs[9];
 
-    // Ниблак
+    // Локальная бинаризация
     QSpinBox *niblackWindowSpinBox;
     QDoubleSpinBox *niblackKSpinBox;
+    QSpinBox *sauvolaWindowSpinBox;
+    QDoubleSpinBox *sauvolaKSpinBox;
+    QSpinBox *wolfWindowSpinBox;
+    QDoubleSpinBox *wolfKSpinBox;
+    QSpinBox *bernsenWindowSpinBox;
+    QSpinBox *bernsenContrastSpinBox;
+
+    // Многоуровневый Оцу
+    QSpinBox *otsuThresholdsSpinBox;
+
+    // Конвейер: пустой - применяется текущий фильтр
+    FilterPipeline pipeline;
+    QListWidget *pipelineList;
+    QPushButton *addStageBtn, *removeStageBtn, *clearStagesBtn;
+
+    // Предпросмотр: операции над копией размером с processedLabel;
+    // полное разрешение - только по «Применить» и «Сохранить»
+    QCheckBox *previewCheck;
+    QTimer *previewTimer;
+    QImage previewSource;
+    qint64 previewSourceKey = 0;
+    QSize previewSourceSize;
+    bool previewRunning = false;
+    bool previewQueued = false;
+    bool previewShown = false;  // в processedLabel предпросмотр, а не processedImage
+    int previewGeneration = 0;  // результаты устаревших запусков отбрасываются
+    std::shared_ptr<CancellationToken> previewToken;
+
+    // Отмена текущей операции и постепенный вывод готовых полос
+    std::shared_ptr<CancellationToken> processingToken;
+    QPushButton *cancelBtn;
+    QImage progressiveCanvas;
+
+    // Уже вычисленные результаты; хэш исходника пересчитывается при его смене
+    ResultCache resultCache;
+    quint64 originalHash = 0;
+    qint64 originalHashKey = 0;
+
+    // Шаги обработки для отмены и повтора
+    UndoHistory history;
+    QPushButton *undoBtn, *redoBtn;
+    QLabel *historyLabel;
 
     // Прогресс-бар
     QProgressBar *progressBar;
+
+    // Файл трассы из IMAGEFILTER_TRACE; пустой - трассировка выключена
+    QString traceFile;
 };
 
 #endif // MAINWINDOW_H
@@ -0,0 +1,76 @@
+#include "parallel.h"
+#include "filter2d.h"
+#include <QThread>
+#include <QtConcurrent/QtConcurrent>
+#include <algorithm>
+#include <atomic>
+#include <utility>
+#include <vector>
+
+namespace {
+
+std::atomic<int> g_filterThreadCount(0);
+thread_local const CancellationToken *t_cancellationToken = nullptr;
+
+// Полоса [begin, end) кусками по step, с проверкой отмены перед каждым
+void runCancellable(const std::function<void(int, int)> &body, int begin, int end,
+                    const CancellationToken *token, int step) {
+    if (!token) {
+        body(begin, end);
+        return;
+    }
+    for (int y = begin; y < end && !token->isCancelled(); y += step) {
+        body(y, std::min(end, y + step));
+    }
+}
+
+} // namespace
+
+void setFilterThreadCount(int threads) {
+    g_filterThreadCount.store(std::max(0, threads));
+}
+
+int filterThreadCount() {
+    int threads = g_filterThreadCount.load();
+    return threads > 0 ? threads : std::max(1, QThread::idealThreadCount());
+}
+
+CancellationScope::CancellationScope(const CancellationToken *token) : previous(t_cancellationToken) {
+    t_cancellationToken = token;
+}
+
+CancellationScope::~CancellationScope() {
+    t_cancellationToken = previous;
+}
+
+bool isCancelled() {
+    return t_cancellationToken && t_cancellationToken->isCancelled();
+}
+
+void parallelForRows(int count, const std::function<void(int, int)> &body, int minChunk, int cancelCheck) {
+    const CancellationToken *token = t_cancellationToken;
+    if (token && token->isCancelled()) return;
+    const int step = std::max(1, cancelCheck);
+
+    int threads = filterThreadCount();
+    int bandCount = std::min(threads * 4, count / std::max(1, minChunk));
+
+    if (threads <= 1 || bandCount <= 1) {
+        if (count > 0) runCancellable(body, 0, count, token, step);
+        return;
+    }
+
+    std::vector<std::pair<int, int>> bands;
+    bands.reserve(bandCount);
+    for (int i = 0; i < bandCount; ++i) {
+        int begin = static_cast<int>(static_cast<qint64>(count) * i / bandCount);
+        int end = static_cast<int>(static_cast<qint64>(count) * (i + 1) / bandCount);
+        bands.push_back(std::make_pair(begin, end));
+    }
+
+    QtConcurrent::blockingMap(bands, [&body, token, step](const std::pair<int, int> &band) {
+        // Вложенные вызовы из рабочего потока видят тот же токен
+        CancellationScope scope(token);
+        runCancellable(body, band.first, band.second, token, step);
+    });
+}
@@ -0,0 +1,53 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <atomic>
+#include <functional>
+
+// Минимальная высота полосы: меньшие полосы не окупают постановку в пул
+const int MIN_BAND_ROWS = 8;
+
+// Под отменой полосы parallelForRows дробятся до cancelCheck строк (по
+// умолчанию CANCEL_CHECK_ROWS), и между кусками проверяется флаг: после
+// отмены новые куски не начинаются. Если единица диапазона - не строка, а
+// тяжёлая работа (блок БПФ), вызывающий передаёт cancelCheck = 1. Тело,
+// которое на каждый вызов заново заполняет ореол (кольцевой буфер
+// sepFilter2D), передаёт cancelCheck = count и проверяет isCancelled() само
+const int CANCEL_CHECK_ROWS = 64;
+
+// Делит диапазон [0, count) на полосы не короче minChunk и обрабатывает их
+// в пуле QtConcurrent (не больше четырёх полос на поток, см. filterThreadCount).
+// Каждая выходная строка пишется ровно одной полосой, а соседние строки
+// (ореол ядра) только читаются из исходного изображения, поэтому результат
+// совпадает с последовательным проходом бит в бит.
+void parallelForRows(int count, const std::function<void(int, int)> &body,
+                     int minChunk = MIN_BAND_ROWS, int cancelCheck = CANCEL_CHECK_ROWS);
+
+// Флаг отмены, общий для GUI и рабочих потоков
+class CancellationToken {
+public:
+    void cancel() { cancelled.store(true, std::memory_order_relaxed); }
+    bool isCancelled() const { return cancelled.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<bool> cancelled{false};
+};
+
+// Привязывает токен к текущему потоку на время жизни объекта. Все операции
+// filter2d, вызванные в этом потоке, прерываются через parallelForRows;
+// содержимое изображения после отмены не определено
+class CancellationScope {
+public:
+    explicit CancellationScope(const CancellationToken *token);
+    ~CancellationScope();
+    CancellationScope(const CancellationScope &) = delete;
+    CancellationScope &operator=(const CancellationScope &) = delete;
+
+private:
+    const CancellationToken *previous;
+};
+
+// Отменена ли операция текущего потока (false без CancellationScope)
+bool isCancelled();
+
+#endif // PARALLEL_H
@@ -0,0 +1,265 @@
+#include "pipeline.h"
+#include "filter2d.h"
+#include "parallel.h"
+#include "tracing.h"
+#include <QStringList>
+#include <algorithm>
+
+namespace {
+
+bool isGrayscaleConversion(FilterType type) {
+    return type == FilterType::GrayscaleBT601 || type == FilterType::GrayscaleBT709 ||
+           type == FilterType::GrayscaleBT2020;
+}
+
+bool isPointStage(FilterType type) {
+    return isGrayscaleConversion(type) || isGlobalThreshold(type);
+}
+
+LumaStandard lumaStandard(FilterType type) {
+    switch (type) {
+    case FilterType::GrayscaleBT601:  return LumaStandard::BT601;
+    case FilterType::GrayscaleBT2020: return LumaStandard::BT2020;
+    default:                          return LumaStandard::BT709;
+    }
+}
+
+// Конец ряда поточечных стадий, начинающегося с begin
+size_t pointRunEnd(const FilterPipeline &pipeline, size_t begin) {
+    size_t end = begin;
+    while (end < pipeline.size() && isPointStage(pipeline[end].type)) ++end;
+    return end;
+}
+
+// Ряд поточечных стадий [begin, end). Яркость задаёт первая стадия: перевод
+// в серое или BT.709, как convertToGrayscale в бинаризации; дальше
+// изображение уже Grayscale8, и переводы в серое тождественны
+void applyPointStages(QImage &image, const FilterPipeline &pipeline, size_t begin, size_t end) {
+    TRACE_SCOPE("point stages");
+    LumaStandard standard = isGrayscaleConversion(pipeline[begin].type)
+                                ? lumaStandard(pipeline[begin].type) : LumaStandard::BT709;
+    bool thresholds = std::any_of(pipeline.begin() + begin, pipeline.begin() + end,
+                                  [](const FilterSettings &stage) { return isGlobalThreshold(stage.type); });
+    if (!thresholds) {
+        toGrayscale(image, standard);
+        return;
+    }
+
+    GrayHistogram histogram;
+    toGrayscale(image, standard, histogram);
+
+    uchar lut[256];
+    for (int i = 0; i < 256; ++i) lut[i] = static_cast<uchar>(i);
+    for (size_t s = begin; s < end; ++s) {
+        if (!isGlobalThreshold(pipeline[s].type)) continue;
+
+        uchar stageLut[256];
+        globalThresholdLut(pipeline[s], histogram, stageLut);
+
+        // Гистограмма результата стадии - перенумерованная гистограмма входа
+        GrayHistogram mapped;
+        mapped.fill(0);
+        for (int i = 0; i < 256; ++i) mapped[stageLut[i]] += histogram[i];
+        histogram = mapped;
+        for (int i = 0; i < 256; ++i) lut[i] = stageLut[lut[i]];
+    }
+    applyGrayLut(image, lut);
+}
+
+bool parseStageInt(const QString &value, const QString &key, int minimum, int maximum,
+                   int *result, QString *errorMessage) {
+    bool ok = false;
+    int parsed = value.toInt(&ok);
+    if (!ok || parsed < minimum || parsed > maximum) {
+        *errorMessage = QString("Некорректное значение %1: %2").arg(key, value);
+        return false;
+    }
+    *result = parsed;
+    return true;
+}
+
+bool parseStageDouble(const QString &value, const QString &key, double *result, QString *errorMessage) {
+    bool ok = false;
+    double parsed = value.toDouble(&ok);
+    if (!ok) {
+        *errorMessage = QString("Некорректное значение %1: %2").arg(key, value);
+        return false;
+    }
+    *result = parsed;
+    return true;
+}
+
+} // namespace
+
+void applyPipeline(QImage &image, const FilterPipeline &pipeline, std::function<void(int)> progressCallback) {
+    TRACE_SCOPE("applyPipeline");
+    const int total = static_cast<int>(pipeline.size());
+    size_t s = 0;
+    while (s < pipeline.size() && !isCancelled()) {
+        int from = static_cast<int>(100 * s / std::max(1, total));
+        size_t next = s + 1;
+
+        if (isPointStage(pipeline[s].type)) {
+            next = pointRunEnd(pipeline, s);
+            applyPointStages(image, pipeline, s, next);
+        } else {
+            int to = static_cast<int>(100 * next / std::max(1, total));
+            std::function<void(int)> stageCallback;
+            if (progressCallback) {
+                stageCallback = [&progressCallback, from, to](int percent) {
+                    progressCallback(from + (to - from) * percent / 100);
+                };
+            }
+            applyFilterSettings(image, pipeline[s], stageCallback);
+        }
+
+        if (progressCallback) progressCallback(static_cast<int>(100 * next / std::max(1, total)));
+        s = next;
+    }
+}
+
+int pipelinePassCount(const FilterPipeline &pipeline) {
+    int passes = 0;
+    size_t s = 0;
+    while (s < pipeline.size()) {
+        if (!isPointStage(pipeline[s].type)) {
+            ++passes;
+            ++s;
+            continue;
+        }
+        size_t end = pointRunEnd(pipeline, s);
+        bool thresholds = std::any_of(pipeline.begin() + s, pipeline.begin() + end,
+                                      [](const FilterSettings &stage) { return isGlobalThreshold(stage.type); });
+        passes += thresholds ? 2 : 1;
+        s = end;
+    }
+    return passes;
+}
+
+bool parsePipelineStage(const QString &text, const FilterSettings &base,
+                        FilterSettings *stage, QString *errorMessage) {
+    const QStringList parts = text.split(':');
+    FilterSettings result = base;
+    if (!filterTypeFromName(parts.first().trimmed(), &result.type)) {
+        *errorMessage = QString("Неизвестный фильтр: %1").arg(parts.first());
+        return false;
+    }
+
+    for (int i = 1; i < parts.size(); ++i) {
+        const int separator = parts[i].indexOf('=');
+        if (separator <= 0) {
+            *errorMessage = QString("Ожидается ключ=значение: %1").arg(parts[i]);
+            return false;
+        }
+        const QString key = parts[i].left(separator).trimmed().toLower();
+        const QString value = parts[i].mid(separator + 1).trimmed();
+
+        // Окно и k относятся к методу самой стадии
+        int *window = nullptr;
+        double *k = nullptr;
+        switch (result.type) {
+        case FilterType::BinarizeNiblack: window = &result.niblackWindow; k = &result.niblackK; break;
+        case FilterType::BinarizeSauvola: window = &result.sauvolaWindow; k = &result.sauvolaK; break;
+        case FilterType::BinarizeWolf:    window = &result.wolfWindow;    k = &result.wolfK;    break;
+        case FilterType::BinarizeBernsen: window = &result.bernsenWindow; break;
+        default: break;
+        }
+
+        bool ok = true;
+        if (key == "size") {
+            ok = parseStageInt(value, key, 1, 1 << 16, &result.gaussSize, errorMessage);
+        } else if (key == "sigma") {
+            ok = parseStageDouble(value, key, &result.gaussSigma, errorMessage);
+            if (ok && result.gaussSigma <= 0.0) {
+                *errorMessage = QString("Некорректное значение sigma: %1").arg(value);
+                ok = false;
+            }
+        } else if (key == "mode") {
+            if (value == "auto") {
+                result.gaussMode = GaussianMode::Auto;
+            } else if (value == "exact") {
+                result.gaussMode = GaussianMode::Exact;
+            } else if (value == "fast") {
+                result.gaussMode = GaussianMode::Fast;
+            } else {
+                *errorMessage = QString("Неизвестный режим Гаусса: %1").arg(value);
+                ok = false;
+            }
+        } else if (key == "border" && isConvolutionFilter(result.type)) {
+            if (!borderModeFromName(value, &result.border)) {
+                *errorMessage = QString("Неизвестный режим края: %1").arg(value);
+                ok = false;
+            }
+        } else if (key == "window" && window) {
+            ok = parseStageInt(value, key, 1, 1 << 16, window, errorMessage);
+        } else if (key == "k" && k) {
+            ok = parseStageDouble(value, key, k, errorMessage);
+        } else if (key == "contrast") {
+            ok = parseStageInt(value, key, 0, 255, &result.bernsenContrast, errorMessage);
+        } else if (key == "thresholds") {
+            ok = parseStageInt(value, key, 1, MULTI_OTSU_MAX_THRESHOLDS, &result.otsuThresholds, errorMessage);
+        } else if (key == "kernel") {
+            // Внутри стадии значения ядра разделяются ';'
+            const QStringList values = value.split(';');
+            if (values.size() != 9) {
+                *errorMessage = "Ядро должно содержать 9 значений.";
+                return false;
+            }
+            result.kernel.clear();
+            for (const QString &entry : values) {
+                double parsed = 0.0;
+                if (!parseStageDouble(entry.trimmed(), key, &parsed, errorMessage)) return false;
+                result.kernel.push_back(parsed);
+            }
+        } else {
+            *errorMessage = QString("Параметр %1 не относится к фильтру %2").arg(key, filterTypeName(result.type));
+            ok = false;
+        }
+        if (!ok) return false;
+    }
+
+    *stage = result;
+    return true;
+}
+
+QString pipelineStageToString(const FilterSettings &stage) {
+    QString text = filterTypeName(stage.type);
+    switch (stage.type) {
+    case FilterType::GaussianBlur: {
+        const char *mode = stage.gaussMode == GaussianMode::Exact ? "exact"
+                         : stage.gaussMode == GaussianMode::Fast ? "fast" : "auto";
+        text += QString(":size=%1:sigma=%2:mode=%3").arg(stage.gaussSize).arg(stage.gaussSigma).arg(mode);
+        break;
+    }
+    case FilterType::Sharpen:
+    case FilterType::Sobel:
+        if (stage.kernel.size() == 9) {
+            QStringList values;
+            for (double value : stage.kernel) values << QString::number(value);
+            text += ":kernel=" + values.join(';');
+        }
+        break;
+    case FilterType::BinarizeNiblack:
+        text += QString(":window=%1:k=%2").arg(stage.niblackWindow).arg(stage.niblackK);
+        break;
+    case FilterType::BinarizeSauvola:
+        text += QString(":window=%1:k=%2").arg(stage.sauvolaWindow).arg(stage.sauvolaK);
+        break;
+    case FilterType::BinarizeWolf:
+        text += QString(":window=%1:k=%2").arg(stage.wolfWindow).arg(stage.wolfK);
+        break;
+    case FilterType::BinarizeBernsen:
+        text += QString(":window=%1:contrast=%2").arg(stage.bernsenWindow).arg(stage.bernsenContrast);
+        break;
+    case FilterType::BinarizeMultiOtsu:
+        text += QString(":thresholds=%1").arg(stage.otsuThresholds);
+        break;
+    default:
+        break;
+    }
+    // Повторение края по умолчанию не записывается: прежние записи и ключи кэша не меняются
+    if (isConvolutionFilter(stage.type) && stage.border != BorderMode::Replicate) {
+        text += ":border=" + borderModeName(stage.border);
+    }
+    return text;
+}
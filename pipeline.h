@@ -0,0 +1,35 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <QImage>
+#include <QString>
+#include <functional>
+#include <vector>
+#include "filtersettings.h"
+
+// Конвейер: упорядоченный список операций со своими параметрами,
+// общий для GUI и пакетного режима.
+//
+// Подряд идущие поточечные стадии (перевод в серое и глобальные пороги)
+// выполняются слитно, не больше чем за два прохода по изображению:
+// яркость считается вместе с гистограммой, таблицы порогов
+// складываются в одну (гистограмма следующего порога получается
+// перенумерацией предыдущей), и итоговая таблица применяется один раз.
+// Результат совпадает с поочерёдным applyFilterSettings бит в бит.
+typedef std::vector<FilterSettings> FilterPipeline;
+
+void applyPipeline(QImage &image, const FilterPipeline &pipeline,
+                   std::function<void(int)> progressCallback = nullptr);
+
+// Число полных проходов по изображению после слияния (для журнала)
+int pipelinePassCount(const FilterPipeline &pipeline);
+
+// Текстовая запись стадии: имя и параметры через двоеточие,
+//   gaussian:size=15:sigma=3   sauvola:window=31:k=0.3   multiotsu:thresholds=3
+//   sharpen:border=reflect101  (border - у gaussian, sharpen и sobel)
+// Неуказанные параметры берутся из base
+bool parsePipelineStage(const QString &text, const FilterSettings &base,
+                        FilterSettings *stage, QString *errorMessage);
+QString pipelineStageToString(const FilterSettings &stage);
+
+#endif // PIPELINE_H
@@ -0,0 +1,176 @@
+#include "resultcache.h"
+#include "parallel.h"
+#include "tiledimage.h"
+#include <QDir>
+#include <QFile>
+#include <QMutexLocker>
+#include <QStringList>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+const quint64 HASH_SEED = 0x9E3779B97F4A7C15ULL;
+
+inline quint64 mixHash(quint64 hash, quint64 value) {
+    hash ^= value * HASH_SEED;
+    hash = (hash << 31) | (hash >> 33);
+    return hash * 0xBF58476D1CE4E5B9ULL;
+}
+
+// Байты словами по 8, хвост - побайтно
+quint64 hashWords(const uchar *data, size_t length, quint64 hash) {
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        quint64 word;
+        std::memcpy(&word, data + i, sizeof(word));
+        hash = mixHash(hash, word);
+    }
+    for (; i < length; ++i) hash = mixHash(hash, data[i]);
+    return mixHash(hash, length);
+}
+
+} // namespace
+
+quint64 hashBytes(const uchar *data, size_t length) {
+    return hashWords(data, length, HASH_SEED);
+}
+
+quint64 imageContentHash(const QImage &image) {
+    if (image.isNull()) return 0;
+
+    const int height = image.height();
+    const size_t rowBytes = static_cast<size_t>(image.width()) * image.depth() / 8;
+
+    // Строки хэшируются параллельно, затем сворачиваются по порядку
+    std::vector<quint64> rows(static_cast<size_t>(height));
+    parallelForRows(height, [&](int yBegin, int yEnd) {
+        for (int y = yBegin; y < yEnd; ++y) {
+            rows[static_cast<size_t>(y)] = hashBytes(image.constScanLine(y), rowBytes);
+        }
+    });
+
+    quint64 hash = mixHash(mixHash(HASH_SEED, static_cast<quint64>(image.width())),
+                           static_cast<quint64>(height));
+    hash = mixHash(hash, static_cast<quint64>(image.format()));
+    for (quint64 row : rows) hash = mixHash(hash, row);
+    return hash;
+}
+
+QString resultCacheKey(quint64 contentHash, const FilterPipeline &pipeline) {
+    QStringList stages;
+    for (const FilterSettings &stage : pipeline) stages << pipelineStageToString(stage);
+    return QString("%1|%2").arg(contentHash, 16, 16, QChar('0')).arg(stages.join('|'));
+}
+
+ResultCache::ResultCache(qint64 budgetBytes) : budgetBytes(budgetBytes) {}
+
+bool ResultCache::setDiskDirectory(const QString &path, QString *errorMessage) {
+    if (!path.isEmpty() && !QDir().mkpath(path)) {
+        *errorMessage = "не удалось создать каталог кэша " + path;
+        return false;
+    }
+    QMutexLocker locker(&mutex);
+    directory = path;
+    return true;
+}
+
+void ResultCache::setBudget(qint64 budget) {
+    QMutexLocker locker(&mutex);
+    budgetBytes = budget;
+    evict();
+}
+
+qint64 ResultCache::usedBytes() const {
+    QMutexLocker locker(&mutex);
+    return used;
+}
+
+bool ResultCache::find(const QString &key, QImage *result) {
+    QString path;
+    {
+        QMutexLocker locker(&mutex);
+        auto it = index.find(key);
+        if (it != index.end()) {
+            entries.splice(entries.begin(), entries, it.value());
+            *result = entries.front().image;
+            return true;
+        }
+        if (directory.isEmpty()) return false;
+        path = diskPath(key);
+    }
+
+    // Диск читается без блокировки: другие потоки пула не ждут
+    if (!QFile::exists(path)) return false;
+    QString error;
+    QImage image = loadTiledImage(path, &error);
+    if (image.isNull()) return false;
+
+    QMutexLocker locker(&mutex);
+    insertInMemory(key, image);
+    *result = image;
+    return true;
+}
+
+void ResultCache::insert(const QString &key, const QImage &result) {
+    if (result.isNull()) return;
+    QString path;
+    {
+        QMutexLocker locker(&mutex);
+        insertInMemory(key, result);
+        if (directory.isEmpty()) return;
+        path = diskPath(key);
+    }
+
+    // Запись во временный файл и переименование: прерванный запуск
+    // не оставит в кэше недописанный результат
+    TiledImageOptions options;
+    options.compressed = true;
+    QString temporary = path + ".tmp";
+    QString error;
+    if (saveTiledImage(result, temporary, options, &error)) {
+        QFile::remove(path);
+        QFile::rename(temporary, path);
+    } else {
+        QFile::remove(temporary);
+    }
+}
+
+void ResultCache::clear() {
+    QMutexLocker locker(&mutex);
+    entries.clear();
+    index.clear();
+    used = 0;
+}
+
+void ResultCache::insertInMemory(const QString &key, const QImage &image) {
+    auto it = index.find(key);
+    if (it != index.end()) {
+        used -= it.value()->bytes;
+        entries.erase(it.value());
+        index.erase(it);
+    }
+
+    qint64 bytes = static_cast<qint64>(image.sizeInBytes());
+    if (bytes > budgetBytes) return;
+    entries.push_front(Entry{key, image, bytes});
+    index.insert(key, entries.begin());
+    used += bytes;
+    evict();
+}
+
+void ResultCache::evict() {
+    while (used > budgetBytes && !entries.empty()) {
+        used -= entries.back().bytes;
+        index.remove(entries.back().key);
+        entries.pop_back();
+    }
+}
+
+// Имя файла - хэш ключа: ключ содержит символы, недопустимые в путях
+QString ResultCache::diskPath(const QString &key) const {
+    QByteArray bytes = key.toUtf8();
+    quint64 hash = hashBytes(reinterpret_cast<const uchar *>(bytes.constData()),
+                             static_cast<size_t>(bytes.size()));
+    return QDir(directory).filePath(QString("%1.%2").arg(hash, 16, 16, QChar('0')).arg(TILED_IMAGE_SUFFIX));
+}
@@ -0,0 +1,63 @@
+#ifndef RESULTCACHE_H
+#define RESULTCACHE_H
+
+#include <QHash>
+#include <QImage>
+#include <QMutex>
+#include <QString>
+#include <list>
+#include "pipeline.h"
+
+// Кэш результатов обработки. Ключ - хэш содержимого исходного изображения
+// и текстовая запись стадий (pipelineStageToString), так что повторное
+// применение уже опробованных параметров не пересчитывается.
+// В памяти - LRU в пределах бюджета в байтах; в пакетном режиме результаты
+// дополнительно сохраняются в каталог (.ift) и переживают перезапуск.
+
+const int DEFAULT_RESULT_CACHE_MB = 256;
+
+// 64-битный хэш произвольных байтов (также для тайлов истории правок)
+quint64 hashBytes(const uchar *data, size_t length);
+// 64-битный хэш пикселей (без выравнивания строк), размера и формата
+quint64 imageContentHash(const QImage &image);
+QString resultCacheKey(quint64 contentHash, const FilterPipeline &pipeline);
+
+// Потокобезопасен: пакетный режим обращается из всех потоков пула
+class ResultCache {
+public:
+    explicit ResultCache(qint64 budgetBytes = static_cast<qint64>(DEFAULT_RESULT_CACHE_MB) << 20);
+
+    // Пустая строка - без диска
+    bool setDiskDirectory(const QString &path, QString *errorMessage);
+    QString diskDirectory() const { return directory; }
+
+    void setBudget(qint64 budgetBytes);
+    qint64 budget() const { return budgetBytes; }
+    qint64 usedBytes() const;
+
+    // Сначала память, затем диск (найденное на диске поднимается в память)
+    bool find(const QString &key, QImage *result);
+    void insert(const QString &key, const QImage &result);
+    void clear();
+
+private:
+    struct Entry {
+        QString key;
+        QImage image;
+        qint64 bytes;
+    };
+    typedef std::list<Entry> EntryList;
+
+    void insertInMemory(const QString &key, const QImage &image);
+    void evict();
+    QString diskPath(const QString &key) const;
+
+    mutable QMutex mutex;
+    qint64 budgetBytes;
+    qint64 used = 0;
+    EntryList entries;  // в начале - последние использованные
+    QHash<QString, EntryList::iterator> index;
+    QString directory;
+};
+
+#endif // RESULTCACHE_H
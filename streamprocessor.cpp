@@ -0,0 +1,622 @@
+#include "streamprocessor.h"
+#include "filter2d.h"
+#include "parallel.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QImageIOHandler>
+#include <QImageReader>
+#include <QRect>
+#include <QSaveFile>
+#include <QRgb>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+// Ореол рекурсивного Гаусса в сигмах: обрезанный хвост отклика
+// меняет результат не больше чем на единицу яркости
+const double STREAM_IIR_HALO_SIGMAS = 5.0;
+
+// Полоса постепенного вывода не короче стольких ореолов: повторно
+// обработанные строки ореола добавляют не больше четверти работы
+const int MIN_STRIP_ROWS_PER_HALO = 8;
+
+// ============ ЧТЕНИЕ PGM/PPM ============
+
+// Следующее число заголовка PNM; комментарии '#' пропускаются до конца строки
+bool readPnmNumber(QFile &file, int *value) {
+    char c = 0;
+    for (;;) {
+        if (!file.getChar(&c)) return false;
+        if (c == '#') {
+            while (c != '\n' && c != '\r') {
+                if (!file.getChar(&c)) return false;
+            }
+        } else if (c != ' ' && c != '\t' && c != '\n' && c != '\r') {
+            break;
+        }
+    }
+    if (c < '0' || c > '9') return false;
+
+    qint64 number = 0;
+    while (c >= '0' && c <= '9') {
+        number = number * 10 + (c - '0');
+        if (number > 0x7fffffff) return false;
+        // Ровно один пробельный символ после maxval отделяет данные
+        if (!file.getChar(&c)) return false;
+    }
+    if (c != ' ' && c != '\t' && c != '\n' && c != '\r') return false;
+    *value = static_cast<int>(number);
+    return true;
+}
+
+class PnmStripReader : public StripReader {
+public:
+    bool open(const QString &path, QString *errorMessage) {
+        file.setFileName(path);
+        if (!file.open(QIODevice::ReadOnly)) {
+            *errorMessage = "не удалось открыть " + path;
+            return false;
+        }
+        PnmHeader header;
+        if (!readPnmHeader(file, &header, errorMessage)) return false;
+        width = header.width;
+        height = header.height;
+        gray = header.gray;
+        rowBytes = static_cast<qint64>(width) * (gray ? 1 : 3);
+        dataOffset = header.dataOffset;
+        return true;
+    }
+
+    QSize size() const override { return QSize(width, height); }
+    bool isStreaming() const override { return true; }
+
+    QImage readRows(int y, int count) override {
+        QImage strip(width, count, gray ? QImage::Format_Grayscale8 : QImage::Format_RGB32);
+        if (strip.isNull() || !file.seek(dataOffset + rowBytes * y)) return QImage();
+
+        row.resize(static_cast<size_t>(rowBytes));
+        for (int i = 0; i < count; ++i) {
+            if (file.read(row.data(), rowBytes) != rowBytes) return QImage();
+            uchar *dst = strip.scanLine(i);
+            if (gray) {
+                std::memcpy(dst, row.data(), static_cast<size_t>(width));
+                continue;
+            }
+            const uchar *src = reinterpret_cast<const uchar *>(row.data());
+            QRgb *out = reinterpret_cast<QRgb *>(dst);
+            for (int x = 0; x < width; ++x) {
+                out[x] = qRgb(src[3 * x], src[3 * x + 1], src[3 * x + 2]);
+            }
+        }
+        return strip;
+    }
+
+private:
+    QFile file;
+    int width = 0;
+    int height = 0;
+    bool gray = false;
+    qint64 rowBytes = 0;
+    qint64 dataOffset = 0;
+    std::vector<char> row;
+};
+
+// ============ ЧТЕНИЕ ЧЕРЕЗ QIMAGEREADER ============
+
+QImage normalizeStrip(const QImage &image) {
+    if (image.format() == QImage::Format_Grayscale8 || image.format() == QImage::Format_RGB32 ||
+        image.format() == QImage::Format_ARGB32) {
+        return image;
+    }
+    return image.convertToFormat(QImage::Format_RGB32);
+}
+
+// Каждая полоса читается новым QImageReader с clipRect: модуль JPEG
+// декодирует строки только до нижней границы полосы, так что память
+// ограничена, но время растёт с числом полос
+class ImageStripReader : public StripReader {
+public:
+    bool open(const QString &path, QString *errorMessage) {
+        fileName = path;
+        QImageReader reader(path);
+        imageSize = reader.size();
+        streaming = imageSize.isValid() && reader.supportsOption(QImageIOHandler::ClipRect);
+        if (!streaming) {
+            whole = reader.read();
+            if (whole.isNull()) {
+                *errorMessage = "не удалось загрузить: " + reader.errorString();
+                return false;
+            }
+            whole = normalizeStrip(whole);
+            imageSize = whole.size();
+        }
+        return true;
+    }
+
+    QSize size() const override { return imageSize; }
+    bool isStreaming() const override { return streaming; }
+
+    QImage readRows(int y, int count) override {
+        if (!streaming) return whole.copy(0, y, imageSize.width(), count);
+
+        QImageReader reader(fileName);
+        reader.setClipRect(QRect(0, y, imageSize.width(), count));
+        QImage strip = reader.read();
+        if (strip.height() != count) return QImage();
+        return normalizeStrip(strip);
+    }
+
+private:
+    QString fileName;
+    QSize imageSize;
+    bool streaming = false;
+    QImage whole;
+};
+
+// ============ ТАЙЛОВЫЙ ФОРМАТ .IFT ============
+
+// Несжатые тайлы копируются в полосу прямо из отображения файла
+class TiledStripReader : public StripReader {
+public:
+    bool open(const QString &path, QString *errorMessage) {
+        return image.open(path, errorMessage);
+    }
+
+    QSize size() const override { return image.size(); }
+    bool isStreaming() const override { return true; }
+    QImage readRows(int y, int count) override { return normalizeStrip(image.readRows(y, count)); }
+
+private:
+    TiledImage image;
+};
+
+class TiledStripWriter : public StripWriter {
+public:
+    bool open(const QString &path, QSize size, const TiledImageOptions &options, QString *errorMessage) {
+        return writer.open(path, size, options, errorMessage);
+    }
+
+    bool writeRows(const QImage &strip, int fromRow, int count) override {
+        return writer.writeRows(strip, fromRow, count);
+    }
+    bool finish() override { return writer.finish(); }
+    QString errorString() const override { return writer.errorString(); }
+
+private:
+    TiledImageWriter writer;
+};
+
+// ============ ПОЛОСЫ В ПАМЯТИ ============
+
+class MemoryStripReader : public StripReader {
+public:
+    explicit MemoryStripReader(const QImage &source) : image(normalizeStrip(source)) {}
+
+    QSize size() const override { return image.size(); }
+    bool isStreaming() const override { return true; }
+    QImage readRows(int y, int count) override { return image.copy(0, y, image.width(), count); }
+
+private:
+    QImage image;
+};
+
+// Собирает результат и отдаёт каждую готовую полосу наружу
+class MemoryStripWriter : public StripWriter {
+public:
+    MemoryStripWriter(QSize size, std::function<void(const QImage &, int)> onRows)
+        : imageSize(size), callback(onRows) {}
+
+    bool writeRows(const QImage &strip, int fromRow, int count) override {
+        if (result.isNull()) result = QImage(imageSize, strip.format());
+        if (result.isNull() || strip.format() != result.format() || nextRow + count > imageSize.height()) {
+            error = "несовместимая полоса";
+            return false;
+        }
+        size_t rowBytes = static_cast<size_t>(std::min(strip.bytesPerLine(), result.bytesPerLine()));
+        for (int i = 0; i < count; ++i) {
+            std::memcpy(result.scanLine(nextRow + i), strip.constScanLine(fromRow + i), rowBytes);
+        }
+        if (callback) callback(result.copy(0, nextRow, imageSize.width(), count), nextRow);
+        nextRow += count;
+        return true;
+    }
+    bool finish() override { return nextRow == imageSize.height(); }
+    QString errorString() const override { return error; }
+
+    QImage image() const { return result; }
+
+private:
+    QSize imageSize;
+    std::function<void(const QImage &, int)> callback;
+    QImage result;
+    int nextRow = 0;
+    QString error;
+};
+
+// ============ ЗАПИСЬ PGM/PPM ============
+
+class PnmStripWriter : public StripWriter {
+public:
+    bool open(const QString &path, QSize size, QString *errorMessage) {
+        imageSize = size;
+        file.setFileName(path);
+        if (!file.open(QIODevice::WriteOnly)) {
+            *errorMessage = "не удалось создать " + path;
+            return false;
+        }
+        return true;
+    }
+
+    bool writeRows(const QImage &strip, int fromRow, int count) override {
+        if (!headerWritten) {
+            gray = strip.format() == QImage::Format_Grayscale8;
+            QByteArray header = QByteArray(gray ? "P5\n" : "P6\n") +
+                                QByteArray::number(imageSize.width()) + ' ' +
+                                QByteArray::number(imageSize.height()) + "\n255\n";
+            if (file.write(header) != header.size()) {
+                error = file.errorString();
+                return false;
+            }
+            headerWritten = true;
+        }
+        if (nextRow + count > imageSize.height()) {
+            error = "лишние строки";
+            return false;
+        }
+
+        // Полоса другого формата приводится к формату заголовка
+        QImage source = strip;
+        if (gray && source.format() != QImage::Format_Grayscale8) {
+            source = source.convertToFormat(QImage::Format_Grayscale8);
+        } else if (!gray && source.format() != QImage::Format_RGB32 && source.format() != QImage::Format_ARGB32) {
+            source = source.convertToFormat(QImage::Format_RGB32);
+        }
+
+        int width = imageSize.width();
+        qint64 rowBytes = static_cast<qint64>(width) * (gray ? 1 : 3);
+        row.resize(static_cast<size_t>(rowBytes));
+        for (int i = 0; i < count; ++i) {
+            const uchar *src = source.constScanLine(fromRow + i);
+            if (gray) {
+                std::memcpy(row.data(), src, static_cast<size_t>(width));
+            } else {
+                const QRgb *pixels = reinterpret_cast<const QRgb *>(src);
+                for (int x = 0; x < width; ++x) {
+                    row[3 * x] = static_cast<char>(qRed(pixels[x]));
+                    row[3 * x + 1] = static_cast<char>(qGreen(pixels[x]));
+                    row[3 * x + 2] = static_cast<char>(qBlue(pixels[x]));
+                }
+            }
+            if (file.write(row.data(), rowBytes) != rowBytes) {
+                error = file.errorString();
+                return false;
+            }
+        }
+        nextRow += count;
+        return true;
+    }
+
+    bool finish() override {
+        if (nextRow != imageSize.height()) {
+            error = "записаны не все строки";
+            return false;
+        }
+        if (!file.commit()) {
+            error = file.errorString();
+            return false;
+        }
+        return true;
+    }
+
+    QString errorString() const override { return error; }
+
+private:
+    // Временный файл с переименованием в finish(): вывод поверх входа не
+    // обрезает файл, который ещё читается (в том числе через отображение)
+    QSaveFile file;
+    QSize imageSize;
+    bool headerWritten = false;
+    bool gray = false;
+    int nextRow = 0;
+    std::vector<char> row;
+    QString error;
+};
+
+// ============ РАЗБИЕНИЕ НА ПОЛОСЫ ============
+
+// Ореол в строках: сколько соседних строк влияет на результат
+bool isRecursiveGaussian(const FilterSettings &settings) {
+    if (settings.type != FilterType::GaussianBlur) return false;
+    return usesRecursiveGaussian(static_cast<size_t>(settings.gaussSize), settings.gaussSigma, settings.gaussMode);
+}
+
+// Периодический край читает строки с противоположной стороны изображения:
+// такую операцию можно выполнить только одной полосой
+bool wrapsVertically(const FilterSettings &settings) {
+    return isConvolutionFilter(settings.type) && settings.border == BorderMode::Wrap;
+}
+
+int haloRows(const FilterSettings &settings) {
+    switch (settings.type) {
+    case FilterType::GaussianBlur: {
+        if (isRecursiveGaussian(settings)) {
+            // Отклик рекурсивного фильтра бесконечен; за STREAM_IIR_HALO_SIGMAS
+            // сигм вклад обрезанного хвоста меньше половины уровня яркости
+            return static_cast<int>(std::ceil(STREAM_IIR_HALO_SIGMAS * settings.gaussSigma));
+        }
+        return (settings.gaussSize + 1) / 2;
+    }
+    case FilterType::Sharpen:
+    case FilterType::Sobel:
+        return 1;
+    case FilterType::BinarizeNiblack:
+        return settings.niblackWindow / 2;
+    case FilterType::BinarizeSauvola:
+        return settings.sauvolaWindow / 2;
+    case FilterType::BinarizeWolf:
+        return settings.wolfWindow / 2;
+    case FilterType::BinarizeBernsen:
+        return settings.bernsenWindow / 2;
+    default:
+        return 0;
+    }
+}
+
+// Пиковая память обработки полосы на пиксель, с учётом самой полосы
+// и буферов чтения/записи (оценки по рабочим буферам функций filter2d.h)
+int workingBytesPerPixel(const FilterSettings &settings) {
+    switch (settings.type) {
+    case FilterType::GaussianBlur:
+        return 20;  // RGB32 + три канала float у рекурсивного, копии у точного
+    case FilterType::Sharpen:
+    case FilterType::Sobel:
+        return 16;  // полоса, дополненная копия и результат
+    case FilterType::BinarizeNiblack:
+    case FilterType::BinarizeSauvola:
+    case FilterType::BinarizeWolf:
+        return 24;  // две 64-битные таблицы сумм
+    case FilterType::BinarizeBernsen:
+        return 12;  // плоскости минимумов и максимумов
+    default:
+        return 8;   // RGB32 и Grayscale8
+    }
+}
+
+} // namespace
+
+bool readPnmHeader(QFile &file, PnmHeader *header, QString *errorMessage) {
+    char magic[2];
+    int maxValue = 0;
+    if (!file.seek(0) || file.read(magic, 2) != 2 || magic[0] != 'P' || (magic[1] != '5' && magic[1] != '6') ||
+        !readPnmNumber(file, &header->width) || !readPnmNumber(file, &header->height) ||
+        !readPnmNumber(file, &maxValue)) {
+        *errorMessage = "неверный заголовок PGM/PPM";
+        return false;
+    }
+    if (header->width <= 0 || header->height <= 0 || maxValue <= 0 || maxValue > 255) {
+        *errorMessage = "поддерживаются только 8-битные PGM/PPM";
+        return false;
+    }
+    header->gray = magic[1] == '5';
+    header->dataOffset = file.pos();
+    qint64 rowBytes = static_cast<qint64>(header->width) * (header->gray ? 1 : 3);
+    if (file.size() < header->dataOffset + rowBytes * header->height) {
+        *errorMessage = "файл обрезан";
+        return false;
+    }
+    return true;
+}
+
+std::unique_ptr<StripReader> openStripReader(const QString &path, QString *errorMessage) {
+    if (isTiledImageFile(path)) {
+        TiledStripReader *reader = new TiledStripReader;
+        std::unique_ptr<StripReader> result(reader);
+        if (!reader->open(path, errorMessage)) return nullptr;
+        return result;
+    }
+
+    QFile probe(path);
+    char magic[2] = {0, 0};
+    bool pnm = probe.open(QIODevice::ReadOnly) && probe.read(magic, 2) == 2 &&
+               magic[0] == 'P' && (magic[1] == '5' || magic[1] == '6');
+    probe.close();
+
+    if (pnm) {
+        PnmStripReader *reader = new PnmStripReader;
+        std::unique_ptr<StripReader> result(reader);
+        if (!reader->open(path, errorMessage)) return nullptr;
+        return result;
+    }
+    ImageStripReader *reader = new ImageStripReader;
+    std::unique_ptr<StripReader> result(reader);
+    if (!reader->open(path, errorMessage)) return nullptr;
+    return result;
+}
+
+std::unique_ptr<StripWriter> createPnmStripWriter(const QString &path, QSize size, QString *errorMessage) {
+    PnmStripWriter *writer = new PnmStripWriter;
+    std::unique_ptr<StripWriter> result(writer);
+    if (!writer->open(path, size, errorMessage)) return nullptr;
+    return result;
+}
+
+bool isPnmFileName(const QString &path) {
+    QString suffix = QFileInfo(path).suffix().toLower();
+    return suffix == "pgm" || suffix == "ppm" || suffix == "pnm";
+}
+
+std::unique_ptr<StripWriter> createStripWriter(const QString &path, QSize size, QString *errorMessage,
+                                               const TiledImageOptions &tiledOptions) {
+    if (isTiledImageFileName(path)) {
+        TiledStripWriter *writer = new TiledStripWriter;
+        std::unique_ptr<StripWriter> result(writer);
+        if (!writer->open(path, size, tiledOptions, errorMessage)) return nullptr;
+        return result;
+    }
+    if (isPnmFileName(path)) return createPnmStripWriter(path, size, errorMessage);
+    *errorMessage = "потоковый режим сохраняет только PGM/PPM и .ift";
+    return nullptr;
+}
+
+bool isStreamOutputFileName(const QString &path) {
+    return isPnmFileName(path) || isTiledImageFileName(path);
+}
+
+bool planStream(const FilterSettings &settings, int width, qint64 memoryBudget,
+                StreamPlan *plan, QString *errorMessage) {
+    plan->halo = haloRows(settings);
+    plan->twoPass = isGlobalThreshold(settings.type) || settings.type == FilterType::BinarizeWolf;
+
+    qint64 rowBytes = static_cast<qint64>(std::max(1, width)) * workingBytesPerPixel(settings);
+    qint64 rows = memoryBudget / rowBytes - 2 * plan->halo;
+    if (rows < 1) {
+        qint64 required = (2 * plan->halo + 1) * rowBytes;
+        *errorMessage = QString("бюджета памяти не хватает даже на одну строку с ореолом, нужно не меньше %1 МБ")
+                            .arg((required + (1 << 20) - 1) >> 20);
+        return false;
+    }
+    plan->stripRows = static_cast<int>(std::min<qint64>(rows, 1 << 30));
+    return true;
+}
+
+bool processStream(StripReader &reader, StripWriter &writer, const FilterSettings &settings,
+                   qint64 memoryBudget, QString *errorMessage,
+                   std::function<void(int)> progressCallback) {
+    int width = reader.size().width();
+    int height = reader.size().height();
+    StreamPlan plan;
+    if (!planStream(settings, width, memoryBudget, &plan, errorMessage)) return false;
+    if (wrapsVertically(settings) && plan.stripRows < height) {
+        *errorMessage = "режиму края wrap нужно изображение целиком: бюджета памяти не хватает";
+        return false;
+    }
+
+    int strips = (height + plan.stripRows - 1) / plan.stripRows;
+    int totalSteps = std::max(1, plan.twoPass ? 2 * strips : strips);
+    int step = 0;
+    auto report = [&]() {
+        ++step;
+        if (progressCallback) progressCallback(100 * step / totalSteps);
+    };
+
+    // Полоса [y, y + rows) с ореолом, обрезанным по краям изображения
+    auto readStrip = [&](int y, int rows, int *top) {
+        *top = std::max(0, y - plan.halo);
+        int bottom = std::min(height, y + rows + plan.halo);
+        return reader.readRows(*top, bottom - *top);
+    };
+    auto readFailed = [&](int y) {
+        *errorMessage = QString("ошибка чтения строк начиная с %1").arg(y);
+        return false;
+    };
+    auto cancelled = [&]() {
+        *errorMessage = "операция отменена";
+        return false;
+    };
+
+    // Первый проход: гистограмма для глобального порога или статистика Вольфа
+    GrayHistogram histogram;
+    histogram.fill(0);
+    WolfStatistics wolf;
+    if (plan.twoPass) {
+        for (int y = 0; y < height; y += plan.stripRows) {
+            if (isCancelled()) return cancelled();
+            int rows = std::min(plan.stripRows, height - y);
+            int top = 0;
+            QImage strip = readStrip(y, rows, &top);
+            if (strip.isNull()) return readFailed(y);
+
+            if (settings.type == FilterType::BinarizeWolf) {
+                mergeWolfStatistics(wolf, calculateWolfStatistics(strip, settings.wolfWindow,
+                                                                  y - top, y - top + rows));
+            } else {
+                convertToGrayscale(strip);
+                GrayHistogram part = computeGrayHistogram(strip);
+                for (int i = 0; i < 256; ++i) histogram[i] += part[i];
+            }
+            report();
+        }
+    }
+
+    uchar lut[256];
+    if (isGlobalThreshold(settings.type)) globalThresholdLut(settings, histogram, lut);
+
+    // Второй проход: обработка полос и запись полезных строк
+    for (int y = 0; y < height; y += plan.stripRows) {
+        if (isCancelled()) return cancelled();
+        int rows = std::min(plan.stripRows, height - y);
+        int top = 0;
+        QImage strip = readStrip(y, rows, &top);
+        if (strip.isNull()) return readFailed(y);
+
+        if (isGlobalThreshold(settings.type)) {
+            convertToGrayscale(strip);
+            applyGrayLut(strip, lut);
+        } else if (settings.type == FilterType::BinarizeWolf) {
+            binarizeWolf(strip, settings.wolfWindow, settings.wolfK, wolf);
+        } else {
+            applyFilterSettings(strip, settings);
+        }
+        // Прерванная полоса не дописывается
+        if (isCancelled()) return cancelled();
+
+        if (!writer.writeRows(strip, y - top, rows)) {
+            *errorMessage = "ошибка записи: " + writer.errorString();
+            return false;
+        }
+        report();
+    }
+
+    if (!writer.finish()) {
+        *errorMessage = "ошибка записи: " + writer.errorString();
+        return false;
+    }
+    return true;
+}
+
+bool processStream(const QString &inputPath, const QString &outputPath, const FilterSettings &settings,
+                   qint64 memoryBudget, QString *errorMessage,
+                   std::function<void(int)> progressCallback) {
+    if (!isStreamOutputFileName(outputPath)) {
+        *errorMessage = "потоковый режим сохраняет только PGM/PPM и .ift";
+        return false;
+    }
+    std::unique_ptr<StripReader> reader = openStripReader(inputPath, errorMessage);
+    if (!reader) return false;
+    std::unique_ptr<StripWriter> writer = createStripWriter(outputPath, reader->size(), errorMessage);
+    if (!writer) return false;
+    return processStream(*reader, *writer, settings, memoryBudget, errorMessage, progressCallback);
+}
+
+int progressiveStripCount(const FilterSettings &settings, int height, int maxStrips) {
+    // Рекурсивный Гаусс по полосам точен лишь до единицы яркости, край wrap
+    // читает противоположную сторону, а двухпроходным операциям полосы
+    // добавляют второй расчёт яркости и копии
+    if (isRecursiveGaussian(settings) || wrapsVertically(settings) ||
+        isGlobalThreshold(settings.type) || settings.type == FilterType::BinarizeWolf) {
+        return 1;
+    }
+    int strips = std::max(1, maxStrips);
+    int halo = haloRows(settings);
+    if (halo > 0) strips = std::min(strips, height / (MIN_STRIP_ROWS_PER_HALO * halo));
+    return std::max(1, strips);
+}
+
+QImage processImageInStrips(const QImage &image, const FilterSettings &settings, int stripCount,
+                            std::function<void(const QImage &, int)> onRows, QString *errorMessage,
+                            std::function<void(int)> progressCallback) {
+    MemoryStripReader reader(image);
+    MemoryStripWriter writer(image.size(), onRows);
+
+    stripCount = progressiveStripCount(settings, image.height(), stripCount);
+    int height = std::max(1, image.height());
+    int stripRows = (height + std::max(1, stripCount) - 1) / std::max(1, stripCount);
+    qint64 rowBytes = static_cast<qint64>(std::max(1, image.width())) * workingBytesPerPixel(settings);
+    qint64 budget = rowBytes * (stripRows + 2 * haloRows(settings));
+
+    if (!processStream(reader, writer, settings, budget, errorMessage, progressCallback)) return QImage();
+    return writer.image();
+}
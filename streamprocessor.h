@@ -0,0 +1,99 @@
+#ifndef STREAMPROCESSOR_H
+#define STREAMPROCESSOR_H
+
+#include <QFile>
+#include <QImage>
+#include <QSize>
+#include <QString>
+#include <functional>
+#include <memory>
+#include "filtersettings.h"
+#include "tiledimage.h"
+
+// Потоковая обработка изображений, которые не помещаются в память.
+// Изображение читается горизонтальными полосами; к полосе добавляется
+// ореол из соседних строк (половина ядра или окна), поэтому результат
+// совпадает с обработкой целиком. Глобальные пороги (Оцу, Хуанг, ISODATA,
+// многоуровневый Оцу) и Вольф - Жолион работают в два прохода: сначала
+// гистограмма или статистика по всем полосам, затем применение.
+// Высота полосы подбирается так, чтобы пиковая память не превышала бюджет.
+
+const int DEFAULT_STREAM_MEMORY_MB = 256;
+
+// Источник строк изображения
+class StripReader {
+public:
+    virtual ~StripReader() {}
+    virtual QSize size() const = 0;
+    // Строки [y, y + count) в формате Grayscale8, RGB32 или ARGB32; пустое - ошибка чтения
+    virtual QImage readRows(int y, int count) = 0;
+    // false - формат не умеет читать часть изображения, и оно декодировано
+    // целиком при открытии (бюджет памяти не соблюдается)
+    virtual bool isStreaming() const = 0;
+};
+
+// Приёмник строк результата
+class StripWriter {
+public:
+    virtual ~StripWriter() {}
+    // Строки [fromRow, fromRow + count) полосы дописываются следующими
+    // строками изображения (сверху вниз)
+    virtual bool writeRows(const QImage &strip, int fromRow, int count) = 0;
+    virtual bool finish() = 0;
+    virtual QString errorString() const = 0;
+};
+
+// Заголовок бинарного PGM/PPM (P5/P6) с maxval не больше 255
+struct PnmHeader {
+    int width = 0;
+    int height = 0;
+    bool gray = false;
+    qint64 dataOffset = 0;  // начало строк пикселей без выравнивания
+};
+bool readPnmHeader(QFile &file, PnmHeader *header, QString *errorMessage);
+
+// Бинарные PGM/PPM и тайловые файлы .ift читаются с диска по строкам;
+// остальные форматы - через QImageReader с вырезанием полосы, если модуль
+// формата его поддерживает (например, JPEG), иначе изображение декодируется целиком
+std::unique_ptr<StripReader> openStripReader(const QString &path, QString *errorMessage);
+
+// Результат пишется по мере готовности полос: P5 для полутонового
+// результата, P6 для цветного (выбирается по первой полосе)
+std::unique_ptr<StripWriter> createPnmStripWriter(const QString &path, QSize size, QString *errorMessage);
+bool isPnmFileName(const QString &path);
+// Запись полосами в PGM/PPM или .ift, по расширению path
+std::unique_ptr<StripWriter> createStripWriter(const QString &path, QSize size, QString *errorMessage,
+                                               const TiledImageOptions &tiledOptions = TiledImageOptions());
+bool isStreamOutputFileName(const QString &path);
+
+// Разбиение на полосы для данной операции и ширины изображения
+struct StreamPlan {
+    int halo = 0;           // строк ореола сверху и снизу
+    int stripRows = 0;      // полезных строк в полосе
+    bool twoPass = false;   // глобальный порог или статистика Вольфа
+};
+bool planStream(const FilterSettings &settings, int width, qint64 memoryBudget,
+                StreamPlan *plan, QString *errorMessage);
+
+bool processStream(StripReader &reader, StripWriter &writer, const FilterSettings &settings,
+                   qint64 memoryBudget, QString *errorMessage,
+                   std::function<void(int)> progressCallback = nullptr);
+bool processStream(const QString &inputPath, const QString &outputPath, const FilterSettings &settings,
+                   qint64 memoryBudget, QString *errorMessage,
+                   std::function<void(int)> progressCallback = nullptr);
+
+// Число полос постепенного вывода, не больше maxStrips: меньше, если ореол
+// занял бы заметную долю полосы; 1 - полосы не окупаются (глобальные пороги,
+// Вольф, рекурсивный Гаусс, край wrap) и изображение лучше считать целиком
+int progressiveStripCount(const FilterSettings &settings, int height, int maxStrips);
+
+// Изображение в памяти полосами (около stripCount штук, с поправкой
+// progressiveStripCount) для постепенного вывода: готовые строки результата
+// передаются в onRows(rows, y) сразу. Результат совпадает с
+// applyFilterSettings. Под CancellationScope проверяет отмену между
+// полосами; пустой результат - ошибка или отмена
+QImage processImageInStrips(const QImage &image, const FilterSettings &settings, int stripCount,
+                            std::function<void(const QImage &, int)> onRows, QString *errorMessage,
+                            std::function<void(int)> progressCallback = nullptr);
+
+#endif // STREAMPROCESSOR_H
@@ -0,0 +1,426 @@
+#include "tiledimage.h"
+#include "parallel.h"
+#include "streamprocessor.h"
+#include "tracing.h"
+#include <QDataStream>
+#include <QFileInfo>
+#include <algorithm>
+#include <cstring>
+
+// ============ ТАЙЛОВЫЙ ФОРМАТ .IFT ============
+//
+// Заголовок (little-endian, 32 байта):
+//   "IFTILE01", ширина, высота, QImage::Format, ширина и высота тайла, флаги
+// Таблица тайлов сразу за заголовком: для каждого тайла по строкам
+// (смещение, размер) по 8 байт. Данные начинаются с границы страницы.
+// Несжатый тайл всегда полного размера (крайние дополнены нулями),
+// поэтому строки тайла идут с шагом tileWidth * bytesPerPixel.
+
+namespace {
+
+const char TILED_MAGIC[] = "IFTILE01";
+const int TILED_MAGIC_SIZE = 8;
+const int TILED_HEADER_SIZE = 32;
+const int TILED_INDEX_ENTRY_SIZE = 16;
+const qint64 TILED_DATA_ALIGNMENT = 4096;
+const quint32 TILED_FLAG_COMPRESSED = 1;
+// Тайл до 256 МБ: размеры QByteArray ограничены int
+const int TILED_MAX_TILE_SIZE = 8192;
+
+int formatBytesPerPixel(QImage::Format format) {
+    switch (format) {
+    case QImage::Format_Grayscale8: return 1;
+    case QImage::Format_RGB32:
+    case QImage::Format_ARGB32:     return 4;
+    default:                        return 0;
+    }
+}
+
+// Освобождает отображение, когда удаляется последняя копия QImage
+void releaseMappedFile(void *info) {
+    delete static_cast<std::shared_ptr<QFile> *>(info);
+}
+
+QImage wrapMappedImage(const std::shared_ptr<QFile> &file, const uchar *data, int width, int height,
+                       int bytesPerLine, QImage::Format format) {
+    return QImage(data, width, height, bytesPerLine, format,
+                  releaseMappedFile, new std::shared_ptr<QFile>(file));
+}
+
+} // namespace
+
+bool TiledImage::open(const QString &path, QString *errorMessage) {
+    file.reset(new QFile(path));
+    if (!file->open(QIODevice::ReadOnly)) {
+        *errorMessage = "не удалось открыть " + path;
+        return false;
+    }
+
+    char magic[TILED_MAGIC_SIZE];
+    if (file->read(magic, TILED_MAGIC_SIZE) != TILED_MAGIC_SIZE ||
+        std::memcmp(magic, TILED_MAGIC, TILED_MAGIC_SIZE) != 0) {
+        *errorMessage = "не тайловый файл .ift";
+        return false;
+    }
+
+    QDataStream in(file.get());
+    in.setByteOrder(QDataStream::LittleEndian);
+    quint32 width, height, format, tileWidth, tileHeight, flags;
+    in >> width >> height >> format >> tileWidth >> tileHeight >> flags;
+    pixelFormat = static_cast<QImage::Format>(format);
+    bytesPerPixel = formatBytesPerPixel(pixelFormat);
+    if (in.status() != QDataStream::Ok || width == 0 || height == 0 || width > 0x7fffffff ||
+        height > 0x7fffffff || tileWidth == 0 || tileHeight == 0 || tileWidth > TILED_MAX_TILE_SIZE ||
+        tileHeight > TILED_MAX_TILE_SIZE || bytesPerPixel == 0) {
+        *errorMessage = "неверный заголовок .ift";
+        return false;
+    }
+    imageSize = QSize(static_cast<int>(width), static_cast<int>(height));
+    tileDimensions = QSize(static_cast<int>(tileWidth), static_cast<int>(tileHeight));
+    columns = static_cast<int>((width + tileWidth - 1) / tileWidth);
+    rows = static_cast<int>((height + tileHeight - 1) / tileHeight);
+    compressed = (flags & TILED_FLAG_COMPRESSED) != 0;
+
+    const quint64 rawTileBytes = static_cast<quint64>(tileWidth) * tileHeight * bytesPerPixel;
+    const quint64 fileSize = static_cast<quint64>(file->size());
+    // Таблица должна поместиться в файл до выделения памяти под неё:
+    // иначе заголовок в 32 байта может запросить эксабайты
+    const quint64 tileCount = static_cast<quint64>(columns) * static_cast<quint64>(rows);
+    if (fileSize < TILED_HEADER_SIZE || tileCount > (fileSize - TILED_HEADER_SIZE) / TILED_INDEX_ENTRY_SIZE) {
+        *errorMessage = "повреждена таблица тайлов .ift";
+        return false;
+    }
+    entries.resize(static_cast<size_t>(tileCount));
+    for (TileEntry &entry : entries) {
+        in >> entry.offset >> entry.size;
+        bool valid = entry.offset <= fileSize && entry.size <= fileSize - entry.offset &&
+                     (compressed || entry.size == rawTileBytes);
+        if (in.status() != QDataStream::Ok || !valid) {
+            *errorMessage = "повреждена таблица тайлов .ift";
+            return false;
+        }
+    }
+
+    // Без отображения тайлы читаются из файла, это медленнее, но работает
+    mapped = file->map(0, file->size());
+    cachedBand = -1;
+    return true;
+}
+
+QByteArray TiledImage::tileBytes(int index) const {
+    const TileEntry &entry = entries[index];
+    QByteArray raw;
+    if (mapped) {
+        raw = QByteArray::fromRawData(reinterpret_cast<const char *>(mapped + entry.offset),
+                                      static_cast<int>(entry.size));
+    } else if (file->seek(static_cast<qint64>(entry.offset))) {
+        raw = file->read(static_cast<qint64>(entry.size));
+    }
+    if (compressed) return qUncompress(raw);
+    // fromRawData не владеет данными: копия нужна, чтобы пережить отображение
+    return QByteArray(raw.constData(), raw.size());
+}
+
+const QByteArray &TiledImage::bandTile(int ty, int tx) const {
+    if (cachedBand != ty) {
+        cachedTiles.assign(static_cast<size_t>(columns), QByteArray());
+        if (mapped) {
+            // Распаковка тайлов полосы независима
+            parallelForRows(columns, [&](int begin, int end) {
+                for (int x = begin; x < end; ++x) cachedTiles[x] = tileBytes(ty * columns + x);
+            }, 1);
+        } else {
+            // Один QFile нельзя читать из нескольких потоков
+            for (int x = 0; x < columns; ++x) cachedTiles[x] = tileBytes(ty * columns + x);
+        }
+        cachedBand = ty;
+    }
+    return cachedTiles[tx];
+}
+
+QImage TiledImage::tile(int tx, int ty) const {
+    if (tx < 0 || ty < 0 || tx >= columns || ty >= rows) return QImage();
+
+    int tileWidth = tileDimensions.width();
+    int tileHeight = tileDimensions.height();
+    int width = std::min(tileWidth, imageSize.width() - tx * tileWidth);
+    int height = std::min(tileHeight, imageSize.height() - ty * tileHeight);
+    int bytesPerLine = tileWidth * bytesPerPixel;
+    int index = ty * columns + tx;
+
+    if (mapped && !compressed) {
+        return wrapMappedImage(file, mapped + entries[index].offset, width, height, bytesPerLine, pixelFormat);
+    }
+
+    QByteArray bytes = tileBytes(index);
+    if (bytes.size() != bytesPerLine * tileHeight) return QImage();
+    QImage result(width, height, pixelFormat);
+    for (int y = 0; y < height; ++y) {
+        std::memcpy(result.scanLine(y), bytes.constData() + static_cast<size_t>(y) * bytesPerLine,
+                    static_cast<size_t>(width) * bytesPerPixel);
+    }
+    return result;
+}
+
+QImage TiledImage::readRows(int y, int count) const {
+    if (y < 0 || count <= 0 || y + count > imageSize.height()) return QImage();
+
+    int width = imageSize.width();
+    int tileWidth = tileDimensions.width();
+    int tileHeight = tileDimensions.height();
+    size_t tileBytesPerLine = static_cast<size_t>(tileWidth) * bytesPerPixel;
+    size_t rawTileBytes = tileBytesPerLine * tileHeight;
+
+    QImage result(width, count, pixelFormat);
+    if (result.isNull()) return QImage();
+
+    // Полосы тайлов по очереди, строки внутри полосы - параллельно
+    for (int ty = y / tileHeight; ty <= (y + count - 1) / tileHeight; ++ty) {
+        std::vector<const uchar *> sources(static_cast<size_t>(columns));
+        for (int tx = 0; tx < columns; ++tx) {
+            if (mapped && !compressed) {
+                sources[tx] = mapped + entries[ty * columns + tx].offset;
+                continue;
+            }
+            const QByteArray &bytes = bandTile(ty, tx);
+            if (static_cast<size_t>(bytes.size()) != rawTileBytes) return QImage();
+            sources[tx] = reinterpret_cast<const uchar *>(bytes.constData());
+        }
+
+        int bandBegin = std::max(y, ty * tileHeight);
+        int bandEnd = std::min(y + count, (ty + 1) * tileHeight);
+        parallelForRows(bandEnd - bandBegin, [&](int begin, int end) {
+            for (int row = bandBegin + begin; row < bandBegin + end; ++row) {
+                uchar *dst = result.scanLine(row - y);
+                size_t offset = static_cast<size_t>(row - ty * tileHeight) * tileBytesPerLine;
+                for (int tx = 0; tx < columns; ++tx) {
+                    int columnWidth = std::min(tileWidth, width - tx * tileWidth);
+                    std::memcpy(dst + tx * tileBytesPerLine, sources[tx] + offset,
+                                static_cast<size_t>(columnWidth) * bytesPerPixel);
+                }
+            }
+        });
+    }
+    return result;
+}
+
+QImage TiledImage::toImage() const {
+    return readRows(0, imageSize.height());
+}
+
+bool TiledImageWriter::open(const QString &path, QSize size, const TiledImageOptions &writerOptions,
+                            QString *errorMessage) {
+    imageSize = size;
+    options = writerOptions;
+    options.tileSize = std::max(1, std::min(TILED_MAX_TILE_SIZE, options.tileSize));
+    file.setFileName(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        *errorMessage = "не удалось создать " + path;
+        return false;
+    }
+    return true;
+}
+
+bool TiledImageWriter::writeHeader(QImage::Format format) {
+    pixelFormat = format;
+    bytesPerPixel = formatBytesPerPixel(format);
+    int tileSize = options.tileSize;
+    columns = (imageSize.width() + tileSize - 1) / tileSize;
+    rows = (imageSize.height() + tileSize - 1) / tileSize;
+    size_t tileCount = static_cast<size_t>(columns) * rows;
+
+    file.write(TILED_MAGIC, TILED_MAGIC_SIZE);
+    QDataStream out(&file);
+    out.setByteOrder(QDataStream::LittleEndian);
+    out << quint32(imageSize.width()) << quint32(imageSize.height()) << quint32(format)
+        << quint32(tileSize) << quint32(tileSize)
+        << quint32(options.compressed ? TILED_FLAG_COMPRESSED : 0);
+
+    // Таблица заполняется в finish(), когда известны размеры сжатых тайлов
+    indexOffset = TILED_HEADER_SIZE;
+    qint64 indexEnd = indexOffset + static_cast<qint64>(tileCount) * TILED_INDEX_ENTRY_SIZE;
+    dataOffset = (indexEnd + TILED_DATA_ALIGNMENT - 1) / TILED_DATA_ALIGNMENT * TILED_DATA_ALIGNMENT;
+    QByteArray padding(static_cast<int>(dataOffset - TILED_HEADER_SIZE), '\0');
+    if (file.write(padding) != padding.size() || out.status() != QDataStream::Ok) {
+        error = file.errorString();
+        return false;
+    }
+
+    index.reserve(tileCount * 2);
+    band.assign(static_cast<size_t>(columns),
+                std::vector<uchar>(static_cast<size_t>(tileSize) * tileSize * bytesPerPixel, 0));
+    return true;
+}
+
+bool TiledImageWriter::writeRows(const QImage &strip, int fromRow, int count) {
+    if (pixelFormat == QImage::Format_Invalid) {
+        QImage::Format format = strip.format();
+        if (formatBytesPerPixel(format) == 0) format = strip.hasAlphaChannel() ? QImage::Format_ARGB32
+                                                                               : QImage::Format_RGB32;
+        if (!writeHeader(format)) return false;
+    }
+    if (nextRow + count > imageSize.height()) {
+        error = "лишние строки";
+        return false;
+    }
+
+    QImage source = strip.format() == pixelFormat ? strip : strip.convertToFormat(pixelFormat);
+    int tileSize = options.tileSize;
+    size_t tileBytesPerLine = static_cast<size_t>(tileSize) * bytesPerPixel;
+
+    for (int i = 0; i < count; ++i) {
+        const uchar *src = source.constScanLine(fromRow + i);
+        size_t offset = static_cast<size_t>(bandRows) * tileBytesPerLine;
+        for (int tx = 0; tx < columns; ++tx) {
+            int columnWidth = std::min(tileSize, imageSize.width() - tx * tileSize);
+            std::memcpy(band[tx].data() + offset, src + tx * tileBytesPerLine,
+                        static_cast<size_t>(columnWidth) * bytesPerPixel);
+        }
+        ++nextRow;
+        if (++bandRows == tileSize || nextRow == imageSize.height()) {
+            if (!flushBand()) return false;
+        }
+    }
+    return true;
+}
+
+bool TiledImageWriter::flushBand() {
+    std::vector<QByteArray> packed;
+    if (options.compressed) {
+        packed.resize(band.size());
+        parallelForRows(columns, [&](int begin, int end) {
+            for (int tx = begin; tx < end; ++tx) {
+                packed[tx] = qCompress(band[tx].data(), static_cast<int>(band[tx].size()),
+                                       options.compressionLevel);
+            }
+        }, 1);
+    }
+
+    for (int tx = 0; tx < columns; ++tx) {
+        const char *data = options.compressed ? packed[tx].constData()
+                                              : reinterpret_cast<const char *>(band[tx].data());
+        qint64 size = options.compressed ? packed[tx].size() : static_cast<qint64>(band[tx].size());
+        index.push_back(static_cast<quint64>(file.pos()));
+        index.push_back(static_cast<quint64>(size));
+        if (file.write(data, size) != size) {
+            error = file.errorString();
+            return false;
+        }
+        // Крайние тайлы последней полосы дополняются нулями
+        std::fill(band[tx].begin(), band[tx].end(), 0);
+    }
+    bandRows = 0;
+    return true;
+}
+
+bool TiledImageWriter::finish() {
+    if (nextRow != imageSize.height() || pixelFormat == QImage::Format_Invalid) {
+        error = "записаны не все строки";
+        return false;
+    }
+    if (!file.seek(indexOffset)) {
+        error = file.errorString();
+        return false;
+    }
+    QDataStream out(&file);
+    out.setByteOrder(QDataStream::LittleEndian);
+    for (quint64 value : index) out << value;
+    if (out.status() != QDataStream::Ok || !file.commit()) {
+        error = file.errorString();
+        return false;
+    }
+    return true;
+}
+
+bool isTiledImageFile(const QString &path) {
+    QFile file(path);
+    char magic[TILED_MAGIC_SIZE];
+    return file.open(QIODevice::ReadOnly) && file.read(magic, TILED_MAGIC_SIZE) == TILED_MAGIC_SIZE &&
+           std::memcmp(magic, TILED_MAGIC, TILED_MAGIC_SIZE) == 0;
+}
+
+bool isTiledImageFileName(const QString &path) {
+    return QFileInfo(path).suffix().compare(TILED_IMAGE_SUFFIX, Qt::CaseInsensitive) == 0;
+}
+
+QImage loadTiledImage(const QString &path, QString *errorMessage) {
+    TiledImage tiled;
+    if (!tiled.open(path, errorMessage)) return QImage();
+    QImage image = tiled.toImage();
+    if (image.isNull()) *errorMessage = "повреждены данные тайлов";
+    return image;
+}
+
+bool saveTiledImage(const QImage &image, const QString &path, const TiledImageOptions &options,
+                    QString *errorMessage) {
+    TiledImageWriter writer;
+    if (!writer.open(path, image.size(), options, errorMessage)) return false;
+    if (!writer.writeRows(image, 0, image.height()) || !writer.finish()) {
+        *errorMessage = writer.errorString();
+        return false;
+    }
+    return true;
+}
+
+// ============ PGM/PPM БЕЗ ДЕКОДИРОВАНИЯ ============
+
+QImage mapPnmImage(const QString &path, QString *errorMessage) {
+    std::shared_ptr<QFile> file(new QFile(path));
+    if (!file->open(QIODevice::ReadOnly)) {
+        *errorMessage = "не удалось открыть " + path;
+        return QImage();
+    }
+    PnmHeader header;
+    if (!readPnmHeader(*file, &header, errorMessage)) return QImage();
+
+    const uchar *data = file->map(0, file->size());
+    if (!data) {
+        *errorMessage = "не удалось отобразить файл в память";
+        return QImage();
+    }
+    int bytesPerLine = header.width * (header.gray ? 1 : 3);
+    return wrapMappedImage(file, data + header.dataOffset, header.width, header.height, bytesPerLine,
+                           header.gray ? QImage::Format_Grayscale8 : QImage::Format_RGB888);
+}
+
+bool loadImageFile(const QString &path, QImage *image, QString *errorMessage) {
+    TRACE_SCOPE("decode");
+    if (isTiledImageFile(path)) {
+        *image = loadTiledImage(path, errorMessage);
+        return !image->isNull();
+    }
+
+    // 16-битные и текстовые PNM, а также неудачное отображение - через QImage
+    QString mapError;
+    if (isPnmFileName(path)) {
+        *image = mapPnmImage(path, &mapError);
+        if (!image->isNull()) return true;
+    }
+    if (!image->load(path)) {
+        *errorMessage = mapError.isEmpty() ? QString("не удалось загрузить") : mapError;
+        return false;
+    }
+    return true;
+}
+
+bool saveImageFile(const QImage &image, const QString &path, const TiledImageOptions &options,
+                   QString *errorMessage) {
+    TRACE_SCOPE("encode");
+    if (isTiledImageFileName(path)) return saveTiledImage(image, path, options, errorMessage);
+
+    if (isPnmFileName(path)) {
+        std::unique_ptr<StripWriter> writer = createPnmStripWriter(path, image.size(), errorMessage);
+        if (!writer) return false;
+        if (!writer->writeRows(image, 0, image.height()) || !writer->finish()) {
+            *errorMessage = writer->errorString();
+            return false;
+        }
+        return true;
+    }
+
+    if (!image.save(path)) {
+        *errorMessage = "не удалось сохранить";
+        return false;
+    }
+    return true;
+}
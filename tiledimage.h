@@ -0,0 +1,122 @@
+#ifndef TILEDIMAGE_H
+#define TILEDIMAGE_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QImage>
+#include <QSaveFile>
+#include <QSize>
+#include <QString>
+#include <memory>
+#include <vector>
+
+// Собственный тайловый формат .ift для промежуточных файлов многошаговой
+// обработки: заголовок, таблица тайлов и тайлы фиксированного размера.
+// Строки тайла лежат подряд в формате Grayscale8, RGB32 или ARGB32
+// (порядок байт машины). Несжатый файл отображается в память целиком,
+// и тайлы отдаются как QImage поверх отображения без копирования;
+// сжатые тайлы (qCompress) распаковываются по запросу.
+
+const char TILED_IMAGE_SUFFIX[] = "ift";
+const int DEFAULT_TILE_SIZE = 256;
+
+struct TiledImageOptions {
+    int tileSize = DEFAULT_TILE_SIZE;
+    bool compressed = false;
+    int compressionLevel = -1;  // как у qCompress: -1 - уровень zlib по умолчанию
+};
+
+// Чтение .ift; не потокобезопасно (кэш распакованной полосы тайлов)
+class TiledImage {
+public:
+    bool open(const QString &path, QString *errorMessage);
+
+    QSize size() const { return imageSize; }
+    QImage::Format format() const { return pixelFormat; }
+    QSize tileSize() const { return tileDimensions; }
+    int tileColumns() const { return columns; }
+    int tileRows() const { return rows; }
+    bool isCompressed() const { return compressed; }
+    // false - отображение не удалось, тайлы читаются из файла
+    bool isMapped() const { return mapped != nullptr; }
+
+    // Тайл (tx, ty); у несжатого отображённого файла - без копирования,
+    // только для чтения (запись в пиксели сделает глубокую копию)
+    QImage tile(int tx, int ty) const;
+    // Строки [y, y + count) всего изображения
+    QImage readRows(int y, int count) const;
+    QImage toImage() const;
+
+private:
+    struct TileEntry {
+        quint64 offset;
+        quint64 size;
+    };
+
+    QByteArray tileBytes(int index) const;
+    const QByteArray &bandTile(int ty, int tx) const;
+
+    std::shared_ptr<QFile> file;
+    const uchar *mapped = nullptr;
+    QSize imageSize;
+    QImage::Format pixelFormat = QImage::Format_Invalid;
+    QSize tileDimensions;
+    int columns = 0;
+    int rows = 0;
+    int bytesPerPixel = 0;
+    bool compressed = false;
+    std::vector<TileEntry> entries;
+
+    // Последняя распакованная полоса тайлов: полосы чтения перекрываются ореолом
+    mutable int cachedBand = -1;
+    mutable std::vector<QByteArray> cachedTiles;
+};
+
+// Запись .ift сверху вниз; в памяти одна полоса тайлов
+class TiledImageWriter {
+public:
+    bool open(const QString &path, QSize size, const TiledImageOptions &options, QString *errorMessage);
+    // Строки [fromRow, fromRow + count) полосы дописываются следующими строками;
+    // формат файла выбирается по первой полосе
+    bool writeRows(const QImage &strip, int fromRow, int count);
+    bool finish();
+    QString errorString() const { return error; }
+
+private:
+    bool writeHeader(QImage::Format format);
+    bool flushBand();
+
+    // Файл заменяется только в finish(): запись поверх открытого (в том
+    // числе отображённого) источника не портит его
+    QSaveFile file;
+    QSize imageSize;
+    TiledImageOptions options;
+    QImage::Format pixelFormat = QImage::Format_Invalid;
+    int bytesPerPixel = 0;
+    int columns = 0;
+    int rows = 0;
+    qint64 indexOffset = 0;
+    qint64 dataOffset = 0;
+    int nextRow = 0;
+    int bandRows = 0;
+    std::vector<std::vector<uchar>> band;
+    std::vector<quint64> index;
+    QString error;
+};
+
+bool isTiledImageFile(const QString &path);      // по сигнатуре
+bool isTiledImageFileName(const QString &path);  // по расширению
+QImage loadTiledImage(const QString &path, QString *errorMessage);
+bool saveTiledImage(const QImage &image, const QString &path, const TiledImageOptions &options,
+                    QString *errorMessage);
+
+// PGM/PPM без декодирования: P5 - Grayscale8, P6 - RGB888 прямо поверх
+// отображения файла; отображение живёт, пока жива хотя бы одна копия QImage
+QImage mapPnmImage(const QString &path, QString *errorMessage);
+
+// Загрузка и сохранение с учётом .ift и PGM/PPM, остальное - QImage::load/save
+bool loadImageFile(const QString &path, QImage *image, QString *errorMessage);
+bool saveImageFile(const QImage &image, const QString &path, const TiledImageOptions &options,
+                   QString *errorMessage);
+
+#endif // TILEDIMAGE_H
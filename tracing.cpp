@@ -0,0 +1,157 @@
+#include "tracing.h"
+#include <QByteArray>
+#include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+std::atomic<bool> g_tracingEnabled(false);
+
+namespace {
+
+struct TraceEvent {
+    const char *name;
+    qint64 begin;
+    qint64 end;
+    int thread;
+};
+
+struct TraceLog {
+    QMutex mutex;
+    std::vector<TraceEvent> events;
+    qint64 dropped = 0;
+};
+
+TraceLog &traceLog() {
+    static TraceLog log;
+    return log;
+}
+
+std::atomic<qint64> g_traceOrigin(0);
+std::atomic<int> g_nextTraceThread(0);
+
+qint64 steadyNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Потоки нумеруются по первому интервалу: в трассе это дорожки tid
+int traceThread() {
+    thread_local int id = g_nextTraceThread.fetch_add(1) + 1;
+    return id;
+}
+
+} // namespace
+
+void setTracingEnabled(bool enabled) {
+    if (enabled && g_traceOrigin.load() == 0) g_traceOrigin.store(steadyNs());
+    g_tracingEnabled.store(enabled);
+}
+
+qint64 traceTimestampNs() {
+    return steadyNs() - g_traceOrigin.load(std::memory_order_relaxed);
+}
+
+void recordTraceSpan(const char *name, qint64 beginNs, qint64 endNs) {
+    const int thread = traceThread();
+    TraceLog &log = traceLog();
+    QMutexLocker locker(&log.mutex);
+    if (log.events.size() >= static_cast<size_t>(MAX_TRACE_EVENTS)) {
+        ++log.dropped;
+        return;
+    }
+    log.events.push_back(TraceEvent{name, beginNs, endNs, thread});
+}
+
+int traceEventCount() {
+    TraceLog &log = traceLog();
+    QMutexLocker locker(&log.mutex);
+    return static_cast<int>(log.events.size());
+}
+
+QStringList traceSummary(int fromEvent, int limit) {
+    struct Stage {
+        QByteArray name;
+        qint64 total = 0;
+        int count = 0;
+    };
+    // Ключ - текст имени: одинаковые литералы разных файлов могут иметь разные адреса
+    QHash<QByteArray, int> index;
+    std::vector<Stage> stages;
+    {
+        TraceLog &log = traceLog();
+        QMutexLocker locker(&log.mutex);
+        for (size_t i = static_cast<size_t>(std::max(0, fromEvent)); i < log.events.size(); ++i) {
+            const TraceEvent &event = log.events[i];
+            QByteArray name(event.name);
+            auto it = index.find(name);
+            if (it == index.end()) {
+                it = index.insert(name, static_cast<int>(stages.size()));
+                stages.push_back(Stage());
+                stages.back().name = name;
+            }
+            Stage &stage = stages[static_cast<size_t>(it.value())];
+            stage.total += event.end - event.begin;
+            stage.count++;
+        }
+    }
+
+    std::sort(stages.begin(), stages.end(),
+              [](const Stage &a, const Stage &b) { return a.total > b.total; });
+    QStringList lines;
+    for (const Stage &stage : stages) {
+        if (limit > 0 && lines.size() >= limit) break;
+        QString line = QString("%1: %2 мс").arg(QString::fromUtf8(stage.name)).arg(stage.total / 1e6, 0, 'f', 1);
+        if (stage.count > 1) line += QString(" (x%1)").arg(stage.count);
+        lines << line;
+    }
+    return lines;
+}
+
+bool writeChromeTrace(const QString &path, QString *errorMessage) {
+    QByteArray json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    {
+        TraceLog &log = traceLog();
+        QMutexLocker locker(&log.mutex);
+        // Полные события (ph = X), время в микросекундах
+        for (size_t i = 0; i < log.events.size(); ++i) {
+            const TraceEvent &event = log.events[i];
+            if (i > 0) json += ",\n";
+            json += "{\"name\":\"";
+            json += event.name;
+            json += "\",\"ph\":\"X\",\"pid\":1,\"tid\":";
+            json += QByteArray::number(event.thread);
+            json += ",\"ts\":";
+            json += QByteArray::number(event.begin / 1e3, 'f', 3);
+            json += ",\"dur\":";
+            json += QByteArray::number((event.end - event.begin) / 1e3, 'f', 3);
+            json += "}";
+        }
+        json += "\n],\"otherData\":{\"droppedEvents\":";
+        json += QByteArray::number(log.dropped);
+        json += "}}\n";
+    }
+
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly) || file.write(json) != json.size()) {
+        *errorMessage = "не удалось записать трассу " + path;
+        return false;
+    }
+    return true;
+}
+
+void clearTrace() {
+    TraceLog &log = traceLog();
+    QMutexLocker locker(&log.mutex);
+    log.events.clear();
+    log.dropped = 0;
+}
+
+QString traceFileFromEnvironment() {
+    const QString path = QString::fromLocal8Bit(qgetenv("IMAGEFILTER_TRACE"));
+    if (!path.isEmpty()) setTracingEnabled(true);
+    return path;
+}
@@ -0,0 +1,72 @@
+#ifndef TRACING_H
+#define TRACING_H
+
+#include <QString>
+#include <QStringList>
+#include <atomic>
+
+// Трассировка горячих участков: TRACE_SCOPE("имя") отмечает интервал до
+// конца блока. Выключенная трассировка стоит одну relaxed-загрузку флага на
+// интервал, а при сборке с IMAGEFILTER_NO_TRACING макрос пустой. Включённая
+// копит интервалы всех потоков (имя - строковый литерал, не копируется),
+// пишет их в формате Chrome Trace (chrome://tracing, ui.perfetto.dev)
+// и сводит по стадиям.
+//
+// Включается переменной окружения IMAGEFILTER_TRACE=<файл.json> (GUI и
+// пакетный режим) или ключом --trace <файл.json> пакетного режима. GUI
+// записывает трассу при выходе и по Ctrl+Shift+T.
+
+// Дальше интервалы отбрасываются (около 32 МБ журнала)
+const int MAX_TRACE_EVENTS = 1 << 20;
+
+extern std::atomic<bool> g_tracingEnabled;
+
+inline bool tracingEnabled() {
+    return g_tracingEnabled.load(std::memory_order_relaxed);
+}
+void setTracingEnabled(bool enabled);
+
+// Наносекунды монотонных часов от включения трассировки
+qint64 traceTimestampNs();
+void recordTraceSpan(const char *name, qint64 beginNs, qint64 endNs);
+
+class TraceScope {
+public:
+    explicit TraceScope(const char *spanName) : name(nullptr), begin(0) {
+        if (tracingEnabled()) {
+            name = spanName;
+            begin = traceTimestampNs();
+        }
+    }
+    ~TraceScope() {
+        if (name) recordTraceSpan(name, begin, traceTimestampNs());
+    }
+    TraceScope(const TraceScope &) = delete;
+    TraceScope &operator=(const TraceScope &) = delete;
+
+private:
+    const char *name;
+    qint64 begin;
+};
+
+#ifdef IMAGEFILTER_NO_TRACING
+#define TRACE_SCOPE(name) do {} while (0)
+#else
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+#endif
+
+// Число записанных интервалов: сводка с этой позиции охватывает только
+// последующие операции
+int traceEventCount();
+// Стадии по убыванию суммарного времени, «имя: N мс (xK)»; время вложенных
+// стадий входит и в объемлющую. limit > 0 - не больше стольких строк
+QStringList traceSummary(int fromEvent = 0, int limit = 0);
+bool writeChromeTrace(const QString &path, QString *errorMessage);
+void clearTrace();
+
+// Путь из IMAGEFILTER_TRACE; если задан, трассировка включается
+QString traceFileFromEnvironment();
+
+#endif // TRACING_H
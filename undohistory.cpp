@@ -0,0 +1,153 @@
+#include "undohistory.h"
+#include "parallel.h"
+#include "resultcache.h"
+#include <algorithm>
+#include <cstring>
+
+UndoHistory::UndoHistory(qint64 budgetBytes) : budgetBytes(budgetBytes) {}
+
+void UndoHistory::push(const QImage &image, const QString &label) {
+    if (image.isNull()) return;
+    while (states.size() > current + 1) states.removeLast();
+    states.append(makeState(image, label));
+    current = states.size() - 1;
+
+    // Старые шаги уходят, пока история не уложится в бюджет; текущее состояние остаётся
+    while (tileBytes > budgetBytes && current > 0) {
+        states.removeFirst();
+        --current;
+    }
+    collectGarbage();
+}
+
+void UndoHistory::clear() {
+    states.clear();
+    current = -1;
+    collectGarbage();
+}
+
+QImage UndoHistory::undo() {
+    if (!canUndo()) return QImage();
+    return toImage(states[--current]);
+}
+
+QImage UndoHistory::redo() {
+    if (!canRedo()) return QImage();
+    return toImage(states[++current]);
+}
+
+QString UndoHistory::currentLabel() const {
+    return current >= 0 ? states[current].label : QString();
+}
+
+UndoHistory::State UndoHistory::makeState(const QImage &source, const QString &label) {
+    // Тайлы режутся по байтам: форматы меньше байта на пиксель расширяются
+    QImage image = source;
+    if (image.depth() % 8 != 0) {
+        image = image.convertToFormat(image.hasAlphaChannel() ? QImage::Format_ARGB32 : QImage::Format_RGB32);
+    }
+
+    State state;
+    state.label = label;
+    state.size = image.size();
+    state.format = image.format();
+    state.colorTable = image.colorTable();
+
+    const int width = image.width();
+    const int height = image.height();
+    const int bytesPerPixel = image.depth() / 8;
+    const int columns = (width + HISTORY_TILE_SIZE - 1) / HISTORY_TILE_SIZE;
+    const int rows = (height + HISTORY_TILE_SIZE - 1) / HISTORY_TILE_SIZE;
+    const size_t count = static_cast<size_t>(columns) * rows;
+
+    // Копирование и хэширование тайлов - параллельно, пул - последовательно
+    std::vector<QByteArray> bytes(count);
+    std::vector<quint64> hashes(count);
+    parallelForRows(rows, [&](int tyBegin, int tyEnd) {
+        for (int ty = tyBegin; ty < tyEnd; ++ty) {
+            int y0 = ty * HISTORY_TILE_SIZE;
+            int tileHeight = std::min(HISTORY_TILE_SIZE, height - y0);
+            for (int tx = 0; tx < columns; ++tx) {
+                int x0 = tx * HISTORY_TILE_SIZE;
+                int rowBytes = std::min(HISTORY_TILE_SIZE, width - x0) * bytesPerPixel;
+                size_t index = static_cast<size_t>(ty) * columns + tx;
+                QByteArray &tile = bytes[index];
+                tile.resize(rowBytes * tileHeight);
+                for (int y = 0; y < tileHeight; ++y) {
+                    std::memcpy(tile.data() + static_cast<size_t>(y) * rowBytes,
+                                image.constScanLine(y0 + y) + static_cast<size_t>(x0) * bytesPerPixel,
+                                static_cast<size_t>(rowBytes));
+                }
+                hashes[index] = hashBytes(reinterpret_cast<const uchar *>(tile.constData()),
+                                          static_cast<size_t>(tile.size()));
+            }
+        }
+    }, 1);
+
+    state.tiles.reserve(count);
+    for (size_t i = 0; i < count; ++i) state.tiles.push_back(internTile(bytes[i], hashes[i]));
+    return state;
+}
+
+UndoHistory::Tile UndoHistory::internTile(const QByteArray &bytes, quint64 hash) {
+    std::vector<std::weak_ptr<const QByteArray>> &candidates = pool[hash];
+    for (const std::weak_ptr<const QByteArray> &candidate : candidates) {
+        Tile tile = candidate.lock();
+        if (tile && *tile == bytes) return tile;
+    }
+
+    // Память тайла возвращается в счётчик вместе с последней ссылкой
+    qint64 *counter = &tileBytes;
+    Tile tile(new QByteArray(bytes), [counter](const QByteArray *data) {
+        *counter -= data->size();
+        delete data;
+    });
+    tileBytes += bytes.size();
+    candidates.push_back(tile);
+    return tile;
+}
+
+QImage UndoHistory::toImage(const State &state) const {
+    QImage image(state.size, state.format);
+    if (image.isNull()) return image;
+    if (!state.colorTable.isEmpty()) image.setColorTable(state.colorTable);
+
+    const int width = state.size.width();
+    const int height = state.size.height();
+    const int bytesPerPixel = image.depth() / 8;
+    const int columns = (width + HISTORY_TILE_SIZE - 1) / HISTORY_TILE_SIZE;
+    const int rows = (height + HISTORY_TILE_SIZE - 1) / HISTORY_TILE_SIZE;
+
+    parallelForRows(rows, [&](int tyBegin, int tyEnd) {
+        for (int ty = tyBegin; ty < tyEnd; ++ty) {
+            int y0 = ty * HISTORY_TILE_SIZE;
+            int tileHeight = std::min(HISTORY_TILE_SIZE, height - y0);
+            for (int tx = 0; tx < columns; ++tx) {
+                int x0 = tx * HISTORY_TILE_SIZE;
+                int rowBytes = std::min(HISTORY_TILE_SIZE, width - x0) * bytesPerPixel;
+                const QByteArray &tile = *state.tiles[static_cast<size_t>(ty) * columns + tx];
+                for (int y = 0; y < tileHeight; ++y) {
+                    std::memcpy(image.scanLine(y0 + y) + static_cast<size_t>(x0) * bytesPerPixel,
+                                tile.constData() + static_cast<size_t>(y) * rowBytes,
+                                static_cast<size_t>(rowBytes));
+                }
+            }
+        }
+    }, 1);
+    return image;
+}
+
+// Пул держит слабые ссылки: освободившиеся тайлы вычищаются после удаления шагов
+void UndoHistory::collectGarbage() {
+    for (auto it = pool.begin(); it != pool.end();) {
+        std::vector<std::weak_ptr<const QByteArray>> &candidates = it.value();
+        candidates.erase(std::remove_if(candidates.begin(), candidates.end(),
+                                        [](const std::weak_ptr<const QByteArray> &tile) { return tile.expired(); }),
+                         candidates.end());
+        if (candidates.empty()) {
+            it = pool.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
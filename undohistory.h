@@ -0,0 +1,70 @@
+#ifndef UNDOHISTORY_H
+#define UNDOHISTORY_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QImage>
+#include <QString>
+#include <QVector>
+#include <memory>
+#include <vector>
+
+// История правок для отмены и повтора. Каждое состояние хранится тайлами
+// (HISTORY_TILE_SIZE x HISTORY_TILE_SIZE), а тайлы с одинаковым содержимым -
+// один раз: общий пул находит их по хэшу и сравнивает байты. Тайлы, которые
+// шаг не изменил, и повторяющиеся тайлы (белый фон после бинаризации)
+// не занимают новой памяти. Тайл неизменяем и живёт, пока на него ссылается
+// хотя бы одно состояние. При превышении бюджета удаляются самые старые шаги.
+
+const int HISTORY_TILE_SIZE = 128;
+const int DEFAULT_HISTORY_MB = 512;
+
+class UndoHistory {
+public:
+    explicit UndoHistory(qint64 budgetBytes = static_cast<qint64>(DEFAULT_HISTORY_MB) << 20);
+    // Тайлы ссылаются на счётчик памяти истории
+    UndoHistory(const UndoHistory &) = delete;
+    UndoHistory &operator=(const UndoHistory &) = delete;
+
+    // Новое состояние после текущего; ветка повтора отбрасывается
+    void push(const QImage &image, const QString &label);
+    void clear();
+
+    bool canUndo() const { return current > 0; }
+    bool canRedo() const { return current + 1 < states.size(); }
+    // Предыдущее (следующее) состояние; пустое, если шага нет
+    QImage undo();
+    QImage redo();
+
+    int stepCount() const { return states.size(); }
+    QString currentLabel() const;
+    // Байты уникальных тайлов всех состояний
+    qint64 memoryBytes() const { return tileBytes; }
+    qint64 budget() const { return budgetBytes; }
+
+private:
+    typedef std::shared_ptr<const QByteArray> Tile;
+
+    struct State {
+        QString label;
+        QSize size;
+        QImage::Format format = QImage::Format_Invalid;
+        QVector<QRgb> colorTable;
+        std::vector<Tile> tiles;  // по строкам тайлов
+    };
+
+    State makeState(const QImage &image, const QString &label);
+    Tile internTile(const QByteArray &bytes, quint64 hash);
+    QImage toImage(const State &state) const;
+    void collectGarbage();
+
+    qint64 budgetBytes;
+    qint64 tileBytes = 0;  // объявлен до состояний: тайлы уменьшают его при разрушении
+    QVector<State> states;
+    int current = -1;
+
+    // Пул: хэш содержимого -> тайлы (при совпадении хэшей у разных байтов - несколько)
+    QHash<quint64, std::vector<std::weak_ptr<const QByteArray>>> pool;
+};
+
+#endif // UNDOHISTORY_H